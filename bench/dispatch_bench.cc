@@ -0,0 +1,179 @@
+// microbenchmark for the interpreter's dispatch.
+//
+// Runs small lox loops walking the tree, in the vm with switch dispatch
+// and in the vm with computed gotos, each with and without
+// superinstructions, and in the numeric register tier, and reports the
+// time per loop iteration and per instruction dispatched. Build with -DLOXC_BUILD_BENCHMARKS=ON and run
+// ./dispatch_bench.
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "op.h"
+#include "vm.h"
+#include "numeric.h"
+#include "scan.h"
+#include "parse.h"
+#include "resolve.h"
+#include "globals.h"
+#include "callable.h"
+
+namespace
+{
+    struct program
+    {
+        const char* name;
+        const char* source;
+        double n;
+    };
+
+    // Every program defines loop(n), whose loop body has no branches, so
+    // each iteration runs the same instructions.
+    const program programs[] = {
+        {"count", R"(
+fun loop(n) {
+    var i = 0;
+    while (i < n) {
+        i = i + 1;
+    }
+    return i;
+}
+)", 2e7},
+        {"arithmetic", R"(
+fun loop(n) {
+    var i = 0;
+    var x = 0;
+    while (i < n) {
+        x = x + i * 2 - (x / 3);
+        i = i + 1;
+    }
+    return x;
+}
+)", 1e7},
+        {"locals and logic", R"(
+fun loop(n) {
+    var i = 0;
+    var a = 0;
+    var b = 1;
+    while (i < n) {
+        var t = a;
+        a = b;
+        b = t;
+        var either = a or b;
+        var both = a == 1 and !(b == 1);
+        i = i + 1;
+    }
+    return a;
+}
+)", 1e7},
+    };
+
+    struct config
+    {
+        const char* name;
+        vm::mode mode;
+        bool fuse;
+        bool numeric;
+    };
+
+    // Plain switch first: the others are compared against its count.
+    const config configs[] = {
+        {"switch", vm::SWITCH, false, false},
+        {"switch+super", vm::SWITCH, true, false},
+        {"threaded", vm::THREADED, false, false},
+        {"threaded+super", vm::THREADED, true, false},
+        {"threaded+numeric", vm::THREADED, true, true},
+        {"tree", vm::TREE, false, false},
+    };
+
+    // Instructions in one iteration of the loop ending in code's last
+    // backward jump.
+    size_t loop_length(const vm::chunk& code)
+    {
+        for (size_t i = code.code.size(); i-- > 0; )
+            if (code.code[i].op == vm::JUMP && size_t(code.code[i].a) <= i)
+                return i - code.code[i].a + 1;
+        return 0;
+    }
+
+    size_t loop_length(const vm::numeric_chunk& code)
+    {
+        for (size_t i = code.code.size(); i-- > 0; )
+            if (code.code[i].op == vm::N_JUMP && size_t(code.code[i].c) <= i)
+                return i - code.code[i].c + 1;
+        return 0;
+    }
+
+    // Runs p's loop once under c.
+    // @return seconds per iteration, and the instructions per iteration
+    // if c ran in the vm.
+    std::pair<double, size_t> measure(const program& p, const config& c)
+    {
+        Globals globals;
+        op::interpreter interp(globals);
+        interp.exec = c.mode;
+        interp.superinstructions = c.fuse;
+        interp.numeric = c.numeric;
+
+        Scanner scanner;
+        Parser parser;
+        Resolver resolver;
+        std::optional<loxc::token_list> tokens = scanner.run(p.source);
+        std::optional<std::vector<Stmt>> stmts = parser.parse(std::move(tokens.value()));
+        loxc::function_layout layout = resolver.run(stmts.value()).value();
+        interp.run(stmts.value(), layout);
+
+        Val* loop = globals.lookup("loop");
+        const loxc::callable& f = *std::get<std::shared_ptr<loxc::callable>>(*loop);
+        loxc::lexeme where{loxc::ID, 0, loxc::intern("loop")};
+
+        // Once untimed, to compile the body.
+        interp.call_value(f, {Val(1.0)}, where);
+
+        auto start = std::chrono::steady_clock::now();
+        interp.call_value(f, {Val(p.n)}, where);
+        std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+
+        size_t length = 0;
+        auto decl = std::get<std::shared_ptr<FuncStmt>>(stmts.value().front());
+        if (decl->code && decl->code->numeric)
+            length = loop_length(*decl->code->numeric);
+        else if (decl->code)
+            length = loop_length(*decl->code);
+        return {took.count() / p.n, length};
+    }
+}
+
+int main()
+{
+    if ( ! vm::threaded_dispatch() )
+        std::printf("computed gotos are not available; threaded runs the switch\n\n");
+
+    for (const program& p : programs)
+    {
+        std::printf("%s, %.0f iterations\n", p.name, p.n);
+        std::printf("  %-16s %10s %14s %14s\n", "", "ns/iter", "dispatch/iter", "ns/dispatch");
+
+        // The tree walker does the work of the plain instruction set, so
+        // its time per instruction is counted against that.
+        size_t plain = 0;
+        for (const config& c : configs)
+        {
+            auto [seconds, length] = measure(p, c);
+            if (c.mode == vm::SWITCH && ! c.fuse)
+                plain = length;
+            size_t shown = length ? length : plain;
+            double ns = seconds * 1e9;
+            if (shown)
+                std::printf("  %-16s %10.2f %14zu %14.2f\n", c.name, ns, shown, ns / shown);
+            else
+                std::printf("  %-16s %10.2f %14s %14s\n", c.name, ns, "-", "-");
+        }
+        std::printf("\n");
+    }
+    return 0;
+}
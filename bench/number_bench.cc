@@ -0,0 +1,103 @@
+// microbenchmark for number formatting and parsing.
+//
+// Compares the iostream and stod paths loxc used to print and scan numbers
+// with loxc::format_number and loxc::parse_number. Build with
+// -DLOXC_BUILD_BENCHMARKS=ON and run ./number_bench.
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "number.h"
+
+namespace
+{
+    // Keeps the optimizer from throwing away work whose result is unused.
+    volatile size_t sink;
+
+    template <typename F>
+    void measure(const char* name, size_t ops, F f)
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double, std::nano> took = std::chrono::steady_clock::now() - start;
+        std::printf("%-32s %8.1f ns/op\n", name, took.count() / ops);
+    }
+
+    std::vector<double> sample(size_t n)
+    {
+        std::mt19937_64 rng(42);
+        std::uniform_real_distribution<double> real(-1e6, 1e6);
+        std::uniform_int_distribution<int> integer(0, 100000);
+
+        std::vector<double> out;
+        for (size_t i = 0; i < n; ++i)
+            // A mix of integers, which loops mostly produce, and fractions.
+            out.push_back(i % 2 ? real(rng) : integer(rng));
+        return out;
+    }
+}
+
+int main()
+{
+    const size_t n = 1000000;
+    std::vector<double> numbers = sample(n);
+
+    std::printf("formatting %zu numbers\n", n);
+
+    measure("std::ostream << double", n, [&] {
+        std::ostringstream o;
+        for (double d : numbers)
+            o << d;
+        sink = o.str().size();
+    });
+
+    measure("snprintf %.17g", n, [&] {
+        char buf[32];
+        size_t total = 0;
+        for (double d : numbers)
+            total += std::snprintf(buf, sizeof(buf), "%.17g", d);
+        sink = total;
+    });
+
+    measure("loxc::format_number", n, [&] {
+        char buf[loxc::number_buffer_size];
+        size_t total = 0;
+        for (double d : numbers)
+            total += loxc::format_number(d, buf);
+        sink = total;
+    });
+
+    std::vector<std::string> text;
+    for (double d : numbers)
+    {
+        char buf[loxc::number_buffer_size];
+        text.emplace_back(buf, loxc::format_number(d, buf));
+    }
+
+    std::printf("parsing %zu numbers\n", n);
+
+    measure("std::stod(std::string)", n, [&] {
+        double total = 0;
+        for (const std::string& s : text)
+            // The scanner used to build a temporary string per number.
+            total += std::stod(std::string(s.begin(), s.end()));
+        sink = static_cast<size_t>(total);
+    });
+
+    measure("loxc::parse_number", n, [&] {
+        double total = 0;
+        for (const std::string& s : text)
+        {
+            double d = 0;
+            loxc::parse_number(s.data(), s.data() + s.size(), d);
+            total += d;
+        }
+        sink = static_cast<size_t>(total);
+    });
+
+    return 0;
+}
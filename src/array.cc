@@ -0,0 +1,498 @@
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <string>
+
+#include "array.h"
+#include "callable.h"
+#include "op.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && ! defined(LOXC_NO_SIMD)
+#define LOXC_AVX2_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    // Reductions keep this many partial results, two vectors' worth, so
+    // one add needn't wait on the last.
+    const size_t lanes = 8;
+
+    // The scalar kernels. Each does its arithmetic in the same order as
+    // the vector kernel below it.
+
+    void add_scalar(const double* a, const double* b, double* out, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            out[i] = a[i] + b[i];
+    }
+
+    void mul_scalar(const double* a, const double* b, double* out, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            out[i] = a[i] * b[i];
+    }
+
+    void scale_scalar(const double* a, double k, double* out, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            out[i] = a[i] * k;
+    }
+
+    // Folds the partial sums as the vector code does: the two vectors
+    // together, then the halves of the result, then the pair left.
+    double fold_sum(const double* l)
+    {
+        double t0 = l[0] + l[4], t1 = l[1] + l[5], t2 = l[2] + l[6], t3 = l[3] + l[7];
+        return (t0 + t2) + (t1 + t3);
+    }
+
+    double sum_scalar(const double* a, size_t n)
+    {
+        double l[lanes] = {};
+        size_t i = 0;
+        for (; i + lanes <= n; i += lanes)
+            for (size_t k = 0; k < lanes; ++k)
+                l[k] += a[i + k];
+        double s = fold_sum(l);
+        for (; i < n; ++i)
+            s += a[i];
+        return s;
+    }
+
+    double dot_scalar(const double* a, const double* b, size_t n)
+    {
+        double l[lanes] = {};
+        size_t i = 0;
+        for (; i + lanes <= n; i += lanes)
+            for (size_t k = 0; k < lanes; ++k)
+                l[k] += a[i + k] * b[i + k];
+        double s = fold_sum(l);
+        for (; i < n; ++i)
+            s += a[i] * b[i];
+        return s;
+    }
+
+    // What minpd and maxpd do with each pair of lanes, NaNs included.
+    inline double min2(double x, double y) { return x < y ? x : y; }
+    inline double max2(double x, double y) { return x > y ? x : y; }
+
+    template <double (*pick)(double, double)>
+    double fold_pick(const double* l)
+    {
+        double t0 = pick(l[0], l[4]), t1 = pick(l[1], l[5]);
+        double t2 = pick(l[2], l[6]), t3 = pick(l[3], l[7]);
+        return pick(pick(t0, t2), pick(t1, t3));
+    }
+
+    template <double (*pick)(double, double)>
+    double pick_scalar(const double* a, size_t n)
+    {
+        size_t i = 0;
+        double s = a[0];
+        if (n >= lanes)
+        {
+            double l[lanes];
+            for (size_t k = 0; k < lanes; ++k)
+                l[k] = a[k];
+            for (i = lanes; i + lanes <= n; i += lanes)
+                for (size_t k = 0; k < lanes; ++k)
+                    l[k] = pick(a[i + k], l[k]);
+            s = fold_pick<pick>(l);
+        }
+        for (; i < n; ++i)
+            s = pick(a[i], s);
+        return s;
+    }
+
+    /**
+     * Scans four at a time: each of the four adds in its neighbour, then
+     * the one two back, and then the running total. Adding the zeroes the
+     * vector code shifts in matters too, as it turns -0 into 0.
+     */
+    void prefix_sum_scalar(const double* a, double* out, size_t n)
+    {
+        double carry = 0.0;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            double y0 = a[i] + 0.0, y1 = a[i + 1] + a[i];
+            double y2 = a[i + 2] + a[i + 1], y3 = a[i + 3] + a[i + 2];
+            double z0 = y0 + 0.0, z1 = y1 + 0.0, z2 = y2 + y0, z3 = y3 + y1;
+            out[i] = z0 + carry;
+            out[i + 1] = z1 + carry;
+            out[i + 2] = z2 + carry;
+            out[i + 3] = z3 + carry;
+            carry = out[i + 3];
+        }
+        for (; i < n; ++i)
+            out[i] = carry = carry + a[i];
+    }
+
+#ifdef LOXC_AVX2_KERNELS
+
+    // The vector kernels. Plain AVX2, without FMA, whose single rounding
+    // of a * b + c the scalar kernels couldn't match.
+
+    __attribute__((target("avx2")))
+    void add_avx2(const double* a, const double* b, double* out, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+            _mm256_storeu_pd(out + i,
+                _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        for (; i < n; ++i)
+            out[i] = a[i] + b[i];
+    }
+
+    __attribute__((target("avx2")))
+    void mul_avx2(const double* a, const double* b, double* out, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+            _mm256_storeu_pd(out + i,
+                _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        for (; i < n; ++i)
+            out[i] = a[i] * b[i];
+    }
+
+    __attribute__((target("avx2")))
+    void scale_avx2(const double* a, double k, double* out, size_t n)
+    {
+        __m256d by = _mm256_set1_pd(k);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+            _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), by));
+        for (; i < n; ++i)
+            out[i] = a[i] * k;
+    }
+
+    __attribute__((target("avx2")))
+    double fold_sum_avx2(__m256d lo, __m256d hi)
+    {
+        __m256d t = _mm256_add_pd(lo, hi);
+        __m128d h = _mm_add_pd(_mm256_castpd256_pd128(t), _mm256_extractf128_pd(t, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(h, _mm_unpackhi_pd(h, h)));
+    }
+
+    __attribute__((target("avx2")))
+    double sum_avx2(const double* a, size_t n)
+    {
+        __m256d lo = _mm256_setzero_pd(), hi = _mm256_setzero_pd();
+        size_t i = 0;
+        for (; i + lanes <= n; i += lanes)
+        {
+            lo = _mm256_add_pd(lo, _mm256_loadu_pd(a + i));
+            hi = _mm256_add_pd(hi, _mm256_loadu_pd(a + i + 4));
+        }
+        double s = fold_sum_avx2(lo, hi);
+        for (; i < n; ++i)
+            s += a[i];
+        return s;
+    }
+
+    __attribute__((target("avx2")))
+    double dot_avx2(const double* a, const double* b, size_t n)
+    {
+        __m256d lo = _mm256_setzero_pd(), hi = _mm256_setzero_pd();
+        size_t i = 0;
+        for (; i + lanes <= n; i += lanes)
+        {
+            lo = _mm256_add_pd(lo,
+                _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+            hi = _mm256_add_pd(hi,
+                _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+        }
+        double s = fold_sum_avx2(lo, hi);
+        for (; i < n; ++i)
+            s += a[i] * b[i];
+        return s;
+    }
+
+    __attribute__((target("avx2")))
+    double min_avx2(const double* a, size_t n)
+    {
+        if (n < lanes)
+            return pick_scalar<min2>(a, n);
+        __m256d lo = _mm256_loadu_pd(a), hi = _mm256_loadu_pd(a + 4);
+        size_t i = lanes;
+        for (; i + lanes <= n; i += lanes)
+        {
+            lo = _mm256_min_pd(_mm256_loadu_pd(a + i), lo);
+            hi = _mm256_min_pd(_mm256_loadu_pd(a + i + 4), hi);
+        }
+        __m256d t = _mm256_min_pd(lo, hi);
+        __m128d h = _mm_min_pd(_mm256_castpd256_pd128(t), _mm256_extractf128_pd(t, 1));
+        double s = _mm_cvtsd_f64(_mm_min_sd(h, _mm_unpackhi_pd(h, h)));
+        for (; i < n; ++i)
+            s = min2(a[i], s);
+        return s;
+    }
+
+    __attribute__((target("avx2")))
+    double max_avx2(const double* a, size_t n)
+    {
+        if (n < lanes)
+            return pick_scalar<max2>(a, n);
+        __m256d lo = _mm256_loadu_pd(a), hi = _mm256_loadu_pd(a + 4);
+        size_t i = lanes;
+        for (; i + lanes <= n; i += lanes)
+        {
+            lo = _mm256_max_pd(_mm256_loadu_pd(a + i), lo);
+            hi = _mm256_max_pd(_mm256_loadu_pd(a + i + 4), hi);
+        }
+        __m256d t = _mm256_max_pd(lo, hi);
+        __m128d h = _mm_max_pd(_mm256_castpd256_pd128(t), _mm256_extractf128_pd(t, 1));
+        double s = _mm_cvtsd_f64(_mm_max_sd(h, _mm_unpackhi_pd(h, h)));
+        for (; i < n; ++i)
+            s = max2(a[i], s);
+        return s;
+    }
+
+    __attribute__((target("avx2")))
+    void prefix_sum_avx2(const double* a, double* out, size_t n)
+    {
+        const __m256d zero = _mm256_setzero_pd();
+        __m256d carry = zero;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            __m256d x = _mm256_loadu_pd(a + i);
+            // [0, x0, x1, x2]
+            __m256d by1 = _mm256_blend_pd(
+                _mm256_permute4x64_pd(x, _MM_SHUFFLE(2, 1, 0, 0)), zero, 0x1);
+            x = _mm256_add_pd(x, by1);
+            // [0, 0, x0, x1]
+            __m256d by2 = _mm256_permute2f128_pd(x, x, 0x08);
+            x = _mm256_add_pd(x, by2);
+            x = _mm256_add_pd(x, carry);
+            _mm256_storeu_pd(out + i, x);
+            carry = _mm256_permute4x64_pd(x, _MM_SHUFFLE(3, 3, 3, 3));
+        }
+        double c = _mm256_cvtsd_f64(carry);
+        for (; i < n; ++i)
+            out[i] = c = c + a[i];
+    }
+
+#endif
+
+    struct table
+    {
+        void (*add)(const double*, const double*, double*, size_t);
+        void (*mul)(const double*, const double*, double*, size_t);
+        void (*scale)(const double*, double, double*, size_t);
+        double (*sum)(const double*, size_t);
+        double (*dot)(const double*, const double*, size_t);
+        double (*min)(const double*, size_t);
+        double (*max)(const double*, size_t);
+        void (*prefix_sum)(const double*, double*, size_t);
+        bool vectorized;
+    };
+
+    // Picked once, on first use, by what the CPU running us supports.
+    const table& kernel()
+    {
+        static const table chosen = []{
+#ifdef LOXC_AVX2_KERNELS
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2"))
+                return table{add_avx2, mul_avx2, scale_avx2, sum_avx2, dot_avx2,
+                    min_avx2, max_avx2, prefix_sum_avx2, true};
+#endif
+            return table{add_scalar, mul_scalar, scale_scalar, sum_scalar, dot_scalar,
+                pick_scalar<min2>, pick_scalar<max2>, prefix_sum_scalar, false};
+        }();
+        return chosen;
+    }
+
+    using array = std::shared_ptr<loxc::float64_array>;
+
+    // args, checked to be the given number of arrays then one number.
+    void expect(const op::interpreter& interp, const char* builtin, const std::vector<Val>& args,
+        size_t arrays, bool number, const char* usage)
+    {
+        if (args.size() != arrays + number)
+            throw op::builtin_error(interp, builtin, usage);
+        for (size_t i = 0; i < arrays; ++i)
+            if ( ! std::holds_alternative<array>(args[i]) )
+                throw op::builtin_error(interp, builtin, usage);
+        if (number && ! std::holds_alternative<double>(args[arrays]))
+            throw op::builtin_error(interp, builtin, usage);
+    }
+
+    const loxc::float64_array& same_length(const op::interpreter& interp, const char* builtin,
+        const std::vector<Val>& args)
+    {
+        const loxc::float64_array& a = *std::get<array>(args[0]);
+        if (a.size() != std::get<array>(args[1])->size())
+            throw op::builtin_error(interp, builtin, "Arrays must be the same length.");
+        return a;
+    }
+
+    // A new zeroed array of n doubles, or the builtin's error if there
+    // isn't the memory for it.
+    array allocate(const op::interpreter& interp, const char* builtin, size_t n)
+    {
+        try
+        {
+            return std::make_shared<loxc::float64_array>(n);
+        }
+        catch (const std::bad_alloc&)
+        {
+            throw op::builtin_error(interp, builtin,
+                "Not enough memory for an array of " + std::to_string(n) + " doubles.");
+        }
+    }
+
+    size_t index(const op::interpreter& interp, const char* builtin,
+        const loxc::float64_array& a, double i)
+    {
+        if ( ! (i >= 0 && i < a.size()) || std::floor(i) != i )
+            throw op::builtin_error(interp, builtin, "Index out of range.");
+        return static_cast<size_t>(i);
+    }
+}
+
+void kernels::add(const double* a, const double* b, double* out, size_t n)
+{
+    kernel().add(a, b, out, n);
+}
+
+void kernels::mul(const double* a, const double* b, double* out, size_t n)
+{
+    kernel().mul(a, b, out, n);
+}
+
+void kernels::scale(const double* a, double k, double* out, size_t n)
+{
+    kernel().scale(a, k, out, n);
+}
+
+double kernels::sum(const double* a, size_t n)
+{
+    return kernel().sum(a, n);
+}
+
+double kernels::dot(const double* a, const double* b, size_t n)
+{
+    return kernel().dot(a, b, n);
+}
+
+double kernels::min(const double* a, size_t n)
+{
+    return kernel().min(a, n);
+}
+
+double kernels::max(const double* a, size_t n)
+{
+    return kernel().max(a, n);
+}
+
+void kernels::prefix_sum(const double* a, double* out, size_t n)
+{
+    kernel().prefix_sum(a, out, n);
+}
+
+bool kernels::vectorized()
+{
+    return kernel().vectorized;
+}
+
+Val arrays::make(op::interpreter& interp, std::vector<Val> args)
+{
+    double n = args.size() == 1 && std::holds_alternative<double>(args[0])
+        ? std::get<double>(args[0]) : -1;
+    // Also false for NaN and infinity, so the cast below is always defined.
+    if ( ! (n >= 0 && n <= loxc::float64_array::max_size) || std::floor(n) != n )
+        throw op::builtin_error(interp, "Float64Array", "Float64Array expects a length.");
+    return allocate(interp, "Float64Array", static_cast<size_t>(n));
+}
+
+Val arrays::get(op::interpreter& interp, std::vector<Val> args)
+{
+    expect(interp, "array_get", args, 1, true, "array_get expects an array and an index.");
+    const loxc::float64_array& a = *std::get<array>(args[0]);
+    return a.data()[index(interp, "array_get", a, std::get<double>(args[1]))];
+}
+
+Val arrays::set(op::interpreter& interp, std::vector<Val> args)
+{
+    const char* usage = "array_set expects an array, an index and a number.";
+    if (args.size() != 3 || ! std::holds_alternative<double>(args[2]))
+        throw op::builtin_error(interp, "array_set", usage);
+    // expect checks the array and the index alone.
+    double value = std::get<double>(args[2]);
+    args.pop_back();
+    expect(interp, "array_set", args, 1, true, usage);
+    loxc::float64_array& a = *std::get<array>(args[0]);
+    return a.data()[index(interp, "array_set", a, std::get<double>(args[1]))] = value;
+}
+
+Val arrays::add(op::interpreter& interp, std::vector<Val> args)
+{
+    expect(interp, "array_add", args, 2, false, "array_add expects two arrays.");
+    const loxc::float64_array& a = same_length(interp, "array_add", args);
+    auto out = allocate(interp, "array_add", a.size());
+    kernels::add(a.data(), std::get<array>(args[1])->data(), out->data(), a.size());
+    return out;
+}
+
+Val arrays::mul(op::interpreter& interp, std::vector<Val> args)
+{
+    expect(interp, "array_mul", args, 2, false, "array_mul expects two arrays.");
+    const loxc::float64_array& a = same_length(interp, "array_mul", args);
+    auto out = allocate(interp, "array_mul", a.size());
+    kernels::mul(a.data(), std::get<array>(args[1])->data(), out->data(), a.size());
+    return out;
+}
+
+Val arrays::scale(op::interpreter& interp, std::vector<Val> args)
+{
+    expect(interp, "array_scale", args, 1, true, "array_scale expects an array and a number.");
+    const loxc::float64_array& a = *std::get<array>(args[0]);
+    auto out = allocate(interp, "array_scale", a.size());
+    kernels::scale(a.data(), std::get<double>(args[1]), out->data(), a.size());
+    return out;
+}
+
+Val arrays::sum(op::interpreter& interp, std::vector<Val> args)
+{
+    expect(interp, "array_sum", args, 1, false, "array_sum expects an array.");
+    const loxc::float64_array& a = *std::get<array>(args[0]);
+    return kernels::sum(a.data(), a.size());
+}
+
+Val arrays::dot(op::interpreter& interp, std::vector<Val> args)
+{
+    expect(interp, "array_dot", args, 2, false, "array_dot expects two arrays.");
+    const loxc::float64_array& a = same_length(interp, "array_dot", args);
+    return kernels::dot(a.data(), std::get<array>(args[1])->data(), a.size());
+}
+
+Val arrays::min(op::interpreter& interp, std::vector<Val> args)
+{
+    expect(interp, "array_min", args, 1, false, "array_min expects an array.");
+    const loxc::float64_array& a = *std::get<array>(args[0]);
+    if (a.size() == 0)
+        throw op::builtin_error(interp, "array_min", "Can't take the minimum of an empty array.");
+    return kernels::min(a.data(), a.size());
+}
+
+Val arrays::max(op::interpreter& interp, std::vector<Val> args)
+{
+    expect(interp, "array_max", args, 1, false, "array_max expects an array.");
+    const loxc::float64_array& a = *std::get<array>(args[0]);
+    if (a.size() == 0)
+        throw op::builtin_error(interp, "array_max", "Can't take the maximum of an empty array.");
+    return kernels::max(a.data(), a.size());
+}
+
+Val arrays::prefix_sum(op::interpreter& interp, std::vector<Val> args)
+{
+    expect(interp, "array_prefix_sum", args, 1, false, "array_prefix_sum expects an array.");
+    const loxc::float64_array& a = *std::get<array>(args[0]);
+    auto out = allocate(interp, "array_prefix_sum", a.size());
+    kernels::prefix_sum(a.data(), out->data(), a.size());
+    return out;
+}
@@ -0,0 +1,120 @@
+// typed arrays of doubles, and the kernels that work on them whole.
+#ifndef array_h
+#define array_h
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "val.h"
+
+namespace op
+{
+    struct interpreter;
+}
+
+namespace loxc
+{
+
+/**
+ * A lox Float64Array: a fixed number of doubles, zeroed when made, kept
+ * contiguous in storage aligned for the widest vector loads. Unlike an
+ * instance's fields these are never boxed, so the kernels below can run
+ * over them directly.
+ */
+class float64_array
+{
+public:
+    static constexpr size_t alignment = 32;
+    // The most doubles one can hold, 2 GiB of them.
+    static constexpr size_t max_size = size_t(1) << 28;
+
+    explicit float64_array(size_t n) : n(n)
+    {
+        // aligned_alloc wants a multiple of the alignment, and at least
+        // one of it.
+        size_t bytes = (n * sizeof(double) + alignment - 1) / alignment * alignment;
+        if (bytes == 0)
+            bytes = alignment;
+        storage.reset(static_cast<double*>(std::aligned_alloc(alignment, bytes)));
+        if ( ! storage )
+            throw std::bad_alloc();
+        std::memset(storage.get(), 0, bytes);
+    }
+
+    size_t size() const { return n; }
+    double* data() { return storage.get(); }
+    const double* data() const { return storage.get(); }
+
+private:
+    struct release
+    {
+        void operator()(double* p) const { std::free(p); }
+    };
+
+    std::unique_ptr<double[], release> storage;
+    size_t n;
+};
+
+} // namespace loxc
+
+/**
+ * Bulk operations over arrays of doubles. Where the CPU has AVX2 they run
+ * four lanes at a time; elsewhere, or when built with -DLOXC_SIMD=OFF, a
+ * scalar loop does the same work.
+ *
+ * The two give bit for bit the same answers. Reductions (sum, dot, min,
+ * max) and the prefix sum add in the order the vector code does, lane by
+ * lane, rather than left to right, and neither uses fused multiply-add,
+ * so a script's output doesn't depend on the machine it ran on.
+ *
+ * out may be the same array as an input.
+ */
+namespace kernels
+{
+
+void add(const double* a, const double* b, double* out, size_t n);
+void mul(const double* a, const double* b, double* out, size_t n);
+void scale(const double* a, double k, double* out, size_t n);
+double sum(const double* a, size_t n);
+double dot(const double* a, const double* b, size_t n);
+// n must not be 0.
+double min(const double* a, size_t n);
+double max(const double* a, size_t n);
+// out[i] = a[0] + ... + a[i].
+void prefix_sum(const double* a, double* out, size_t n);
+
+// Whether this process runs the AVX2 versions.
+bool vectorized();
+
+} // namespace kernels
+
+/**
+ * The lox side: Float64Array(n) makes an array of n zeroes, read and
+ * written with array_get(a, i) and array_set(a, i, x) and measured with
+ * len(a). The bulk operations take whole arrays: array_add, array_mul and
+ * array_scale return new ones, as does array_prefix_sum, while array_sum,
+ * array_dot, array_min and array_max return a number.
+ */
+namespace arrays
+{
+
+// The builtins. args as lox passed them.
+Val make(op::interpreter& interp, std::vector<Val> args);
+Val get(op::interpreter& interp, std::vector<Val> args);
+Val set(op::interpreter& interp, std::vector<Val> args);
+Val add(op::interpreter& interp, std::vector<Val> args);
+Val mul(op::interpreter& interp, std::vector<Val> args);
+Val scale(op::interpreter& interp, std::vector<Val> args);
+Val sum(op::interpreter& interp, std::vector<Val> args);
+Val dot(op::interpreter& interp, std::vector<Val> args);
+Val min(op::interpreter& interp, std::vector<Val> args);
+Val max(op::interpreter& interp, std::vector<Val> args);
+Val prefix_sum(op::interpreter& interp, std::vector<Val> args);
+
+} // namespace arrays
+
+#endif
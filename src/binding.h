@@ -0,0 +1,91 @@
+// what a name in the source refers to, as worked out by the resolver.
+#ifndef binding_h
+#define binding_h
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "val.h"
+
+namespace loxc
+{
+
+// A local captured by a closure is boxed in a heap allocated cell that the
+// declaring frame and every closure capturing it share.
+using cell = std::shared_ptr<Val>;
+
+/**
+ * Every variable reference and declaration carries a binding. The
+ * resolver decides where the name lives:
+ *
+ * - SLOT: a local that no closure captures. It lives in the current
+ *   call's frame on the interpreter's value stack.
+ * - CELL: a local of the current call that some closure captures. The
+ *   frame holds the cell it is boxed in.
+ * - UPVALUE: a local of an enclosing function, reached through the cells
+ *   the running closure captured.
+ * - GLOBAL: everything else. Global references additionally keep an
+ *   inline cache of the slot they resolved to, see globals.h.
+ */
+struct binding
+{
+    enum kind_t
+    {
+        UNRESOLVED,
+        SLOT,
+        CELL,
+        UPVALUE,
+        GLOBAL,
+    };
+
+    kind_t kind = UNRESOLVED;
+
+    // SLOT and CELL: index into the frame's slots or cells.
+    // UPVALUE: index into the running closure's captures.
+    int index = 0;
+
+    // On declarations: whether any closure refers to the variable.
+    bool captured = false;
+
+    // On declarations: whether the name was already declared in the same
+    // scope, by an earlier declaration or, for a function, by its block
+    // ahead of time. The declaration then assigns into that variable's
+    // slot or cell instead of making a new one.
+    bool redeclares = false;
+
+    // GLOBAL: the cached slot, valid while `version` matches the version
+    // of the globals table doing the lookup.
+    Val* cached = nullptr;
+    uint64_t version = 0;
+};
+
+/**
+ * Where a new closure finds a variable it captures: either a cell in the
+ * frame creating it or one of the creating closure's own captures.
+ */
+struct capture
+{
+    bool local;
+    int index;
+};
+
+/**
+ * What the resolver worked out about a function (or the top level code):
+ * how big its frame is, where its parameters go and what it captures.
+ */
+struct function_layout
+{
+    size_t slots = 0;
+    size_t cells = 0;
+    std::vector<binding> params;
+    std::vector<capture> captures;
+    // whether params[0] is a method's implicit `this`.
+    bool receiver = false;
+    // whether the body yields, making calls return a generator.
+    bool generator = false;
+};
+
+} // namespace loxc
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef async_h
+#define async_h
+
+#include <memory>
+#include <vector>
+
+#include "callable.h"
+#include "events.h"
+#include "val.h"
+
+namespace builtins
+{
+    // setTimeout(f, ms): calls f after ms milliseconds, returning an id
+    // for clearTimeout.
+    auto set_timeout = std::make_shared<loxc::callable>("<setTimeout builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return events::set_timeout(interp, std::move(args));
+    });
+
+    // clearTimeout(id): cancels a timer that hasn't gone off.
+    auto clear_timeout = std::make_shared<loxc::callable>("<clearTimeout builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return events::clear_timeout(interp, std::move(args));
+    });
+
+    // readFile(path, f): reads the file, then calls f(error, text).
+    auto read_file = std::make_shared<loxc::callable>("<readFile builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return events::read_file(interp, std::move(args));
+    });
+
+    // writeFile(path, text, f): replaces the file's contents, then calls
+    // f(error).
+    auto write_file = std::make_shared<loxc::callable>("<writeFile builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return events::write_file(interp, std::move(args));
+    });
+}
+
+#endif
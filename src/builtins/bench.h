@@ -0,0 +1,86 @@
+#ifndef bench_h
+#define bench_h
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "callable.h"
+#include "op.h"
+#include "output.h"
+#include "stats.h"
+#include "val.h"
+
+namespace builtins
+{
+    // Heap allocations lox has made on this thread so far. Only builds
+    // with LOXC_STATS count them.
+    inline uint64_t allocations()
+    {
+        const loxc::stats::counters_t& c = loxc::stats::counters;
+        return c.callables + c.instances + c.cells + c.strings;
+    }
+
+    /**
+     * bench(f, iterations): calls f with no arguments a tenth as many
+     * times again as a warmup, so that its code is compiled and the
+     * caches are filled, then times each of the given iterations alone.
+     * Prints the fastest, median and 99th percentile call in nanoseconds,
+     * and the allocations per call, and returns the median.
+     *
+     * Each timing includes reading the clock, some tens of nanoseconds.
+     * The iterations are a whole number up to bench_limit, whose timings
+     * are all kept to sort.
+     */
+    constexpr double bench_limit = 10000000;
+
+    auto bench = std::make_shared<loxc::callable>("<bench builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        auto f = args.size() == 2 ? std::get_if<std::shared_ptr<loxc::callable>>(&args[0]) : nullptr;
+        const double* n = args.size() == 2 ? std::get_if<double>(&args[1]) : nullptr;
+        // Also false for NaN, so the cast below is always defined.
+        bool counted = n && *n >= 1 && *n <= bench_limit && std::floor(*n) == *n;
+        if ( ! f || ! counted )
+            throw op::builtin_error(interp, "bench",
+                "bench expects a function and a whole number of iterations from 1 to 10000000.");
+        const loxc::callable& fn = **f;
+        size_t iterations = static_cast<size_t>(*n);
+        loxc::lexeme where = op::builtin_site(interp, "bench");
+
+        for (size_t i = 0; i < iterations / 10 + 1; ++i)
+            interp.call_value(fn, {}, where);
+
+        std::vector<double> samples(iterations);
+        uint64_t allocated = allocations();
+        for (double& sample : samples)
+        {
+            auto start = std::chrono::steady_clock::now();
+            interp.call_value(fn, {}, where);
+            std::chrono::duration<double, std::nano> took = std::chrono::steady_clock::now() - start;
+            sample = took.count();
+        }
+        allocated = allocations() - allocated;
+
+        std::sort(samples.begin(), samples.end());
+        double median = samples[samples.size() / 2];
+        double p99 = samples[std::min(samples.size() - 1, samples.size() * 99 / 100)];
+
+        loxc::output::record line(loxc::out());
+        loxc::out() << "[bench] " << fn.str << ": " << iterations << " calls, ns min "
+            << static_cast<size_t>(samples.front()) << " median " << static_cast<size_t>(median)
+            << " p99 " << static_cast<size_t>(p99) << ", allocations per call ";
+#ifdef LOXC_STATS
+        loxc::out() << static_cast<double>(allocated) / iterations;
+#else
+        loxc::out() << "n/a";
+#endif
+        loxc::out() << '\n';
+        loxc::out().sync();
+        return median;
+    });
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef clock_h
+#define clock_h
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "callable.h"
+#include "val.h"
+
+namespace builtins
+{
+    // Nanoseconds on a monotonic clock, for timing rather than telling
+    // the time: only differences between readings mean anything.
+    inline double now_ns()
+    {
+        return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    auto clock_ns = std::make_shared<loxc::callable>("<clock_ns builtin>",
+    [](op::interpreter&, std::vector<Val> args)-> Val{
+        return now_ns();
+    });
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef done_h
+#define done_h
+
+#include <memory>
+#include <vector>
+
+#include "callable.h"
+#include "op.h"
+#include "val.h"
+
+namespace builtins
+{
+    // done(g): whether the generator g has returned, so that calling it
+    // again only gives nil.
+    auto done = std::make_shared<loxc::callable>("<done builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        auto f = args.size() == 1 ? std::get_if<std::shared_ptr<loxc::callable>>(&args[0]) : nullptr;
+        auto g = f ? (*f)->as<loxc::callable::generator>() : nullptr;
+        if ( ! g )
+            throw op::builtin_error(interp, "done", "Can only ask a generator if it is done.");
+        return g->state->done;
+    });
+}
+
+#endif
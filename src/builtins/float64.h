@@ -0,0 +1,77 @@
+#ifndef float64_h
+#define float64_h
+
+#include <memory>
+#include <vector>
+
+#include "array.h"
+#include "callable.h"
+#include "val.h"
+
+namespace builtins
+{
+    // Float64Array(n): a new array of n zeroes.
+    auto float64_array = std::make_shared<loxc::callable>("<Float64Array builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return arrays::make(interp, std::move(args));
+    });
+
+    // array_get(a, i): the number at index i.
+    auto array_get = std::make_shared<loxc::callable>("<array_get builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return arrays::get(interp, std::move(args));
+    });
+
+    // array_set(a, i, x): stores x at index i, returning it.
+    auto array_set = std::make_shared<loxc::callable>("<array_set builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return arrays::set(interp, std::move(args));
+    });
+
+    // array_add(a, b), array_mul(a, b): a new array of the sums or
+    // products of each pair of elements.
+    auto array_add = std::make_shared<loxc::callable>("<array_add builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return arrays::add(interp, std::move(args));
+    });
+
+    auto array_mul = std::make_shared<loxc::callable>("<array_mul builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return arrays::mul(interp, std::move(args));
+    });
+
+    // array_scale(a, k): a new array of each element times k.
+    auto array_scale = std::make_shared<loxc::callable>("<array_scale builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return arrays::scale(interp, std::move(args));
+    });
+
+    // array_sum(a), array_dot(a, b), array_min(a), array_max(a).
+    auto array_sum = std::make_shared<loxc::callable>("<array_sum builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return arrays::sum(interp, std::move(args));
+    });
+
+    auto array_dot = std::make_shared<loxc::callable>("<array_dot builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return arrays::dot(interp, std::move(args));
+    });
+
+    auto array_min = std::make_shared<loxc::callable>("<array_min builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return arrays::min(interp, std::move(args));
+    });
+
+    auto array_max = std::make_shared<loxc::callable>("<array_max builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return arrays::max(interp, std::move(args));
+    });
+
+    // array_prefix_sum(a): a new array of running totals.
+    auto array_prefix_sum = std::make_shared<loxc::callable>("<array_prefix_sum builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return arrays::prefix_sum(interp, std::move(args));
+    });
+}
+
+#endif
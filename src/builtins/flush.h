@@ -0,0 +1,22 @@
+#ifndef flush_h
+#define flush_h
+
+#include <memory>
+#include <vector>
+
+#include "callable.h"
+#include "output.h"
+#include "val.h"
+
+namespace builtins
+{
+    // Pushes anything lox has printed so far out to stdout.
+    auto flush = std::make_shared<loxc::callable>("<flush builtin>",
+    [](op::interpreter&, std::vector<Val> args)-> Val{
+        loxc::output::record all(loxc::out());
+        loxc::out().flush();
+        return std::monostate{};
+    });
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef len_h
+#define len_h
+
+#include <memory>
+#include <vector>
+
+#include "array.h"
+#include "callable.h"
+#include "object.h"
+#include "op.h"
+#include "val.h"
+
+namespace builtins
+{
+    // len(x): the bytes in a string, or the elements of a list, map or
+    // array.
+    auto len = std::make_shared<loxc::callable>("<len builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        if (args.size() == 1)
+        {
+            if (auto s = std::get_if<std::string>(&args[0]))
+                return static_cast<double>(s->size());
+            if (auto l = std::get_if<std::shared_ptr<loxc::list>>(&args[0]))
+                return static_cast<double>((*l)->items.size());
+            if (auto m = std::get_if<std::shared_ptr<loxc::map>>(&args[0]))
+                return static_cast<double>((*m)->entries.size());
+            if (auto a = std::get_if<std::shared_ptr<loxc::float64_array>>(&args[0]))
+                return static_cast<double>((*a)->size());
+        }
+        throw op::builtin_error(interp, "len", "len expects a string, a list, a map or an array.");
+    });
+}
+
+#endif
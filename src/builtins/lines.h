@@ -0,0 +1,21 @@
+#ifndef lines_h
+#define lines_h
+
+#include <memory>
+#include <vector>
+
+#include "callable.h"
+#include "files.h"
+#include "val.h"
+
+namespace builtins
+{
+    // lines(path): a function returning the file's next line on each
+    // call, then nil.
+    auto lines = std::make_shared<loxc::callable>("<lines builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return files::lines(interp, std::move(args));
+    });
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef list_h
+#define list_h
+
+#include <memory>
+#include <vector>
+
+#include "callable.h"
+#include "lists.h"
+#include "val.h"
+
+namespace builtins
+{
+    // List(a, b, ...): a new list of the arguments.
+    auto list = std::make_shared<loxc::callable>("<List builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return lists::make(interp, std::move(args));
+    });
+
+    // list_get(l, i): the element at index i.
+    auto list_get = std::make_shared<loxc::callable>("<list_get builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return lists::get(interp, std::move(args));
+    });
+
+    // list_set(l, i, x): stores x at index i, returning it.
+    auto list_set = std::make_shared<loxc::callable>("<list_set builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return lists::set(interp, std::move(args));
+    });
+
+    // list_push(l, x): adds x at the end, returning it.
+    auto list_push = std::make_shared<loxc::callable>("<list_push builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return lists::push(interp, std::move(args));
+    });
+
+    // list_pop(l): removes and returns the last element.
+    auto list_pop = std::make_shared<loxc::callable>("<list_pop builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return lists::pop(interp, std::move(args));
+    });
+}
+
+#endif
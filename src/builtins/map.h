@@ -0,0 +1,44 @@
+#ifndef map_h
+#define map_h
+
+#include <memory>
+#include <vector>
+
+#include "callable.h"
+#include "lists.h"
+#include "val.h"
+
+namespace builtins
+{
+    // Map(): a new, empty map.
+    auto map = std::make_shared<loxc::callable>("<Map builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return maps::make(interp, std::move(args));
+    });
+
+    // map_get(m, key): the value set for key, or nil.
+    auto map_get = std::make_shared<loxc::callable>("<map_get builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return maps::get(interp, std::move(args));
+    });
+
+    // map_set(m, key, x): sets key to x, returning it.
+    auto map_set = std::make_shared<loxc::callable>("<map_set builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return maps::set(interp, std::move(args));
+    });
+
+    // map_has(m, key): whether key is set.
+    auto map_has = std::make_shared<loxc::callable>("<map_has builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return maps::has(interp, std::move(args));
+    });
+
+    // map_keys(m): a list of the keys, in the order first set.
+    auto map_keys = std::make_shared<loxc::callable>("<map_keys builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return maps::keys(interp, std::move(args));
+    });
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef serialize_h
+#define serialize_h
+
+#include <memory>
+#include <vector>
+
+#include "callable.h"
+#include "json.h"
+#include "val.h"
+
+namespace builtins
+{
+    // json_parse(text): the value text spells in JSON.
+    auto json_parse = std::make_shared<loxc::callable>("<json_parse builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return json::parse_builtin(interp, std::move(args));
+    });
+
+    // json_stringify(value): value as JSON text.
+    auto json_stringify = std::make_shared<loxc::callable>("<json_stringify builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return json::stringify_builtin(interp, std::move(args));
+    });
+
+    // json_print(value): prints value as JSON.
+    auto json_print = std::make_shared<loxc::callable>("<json_print builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return json::print_builtin(interp, std::move(args));
+    });
+}
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef spawn_h
+#define spawn_h
+
+#include <memory>
+#include <vector>
+
+#include "callable.h"
+#include "parallel.h"
+#include "text.h"
+#include "val.h"
+
+namespace builtins
+{
+    // spawn(f, args...): calls f on another thread, handing back a future.
+    auto spawn = std::make_shared<loxc::callable>("<spawn builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return parallel::spawn(interp, std::move(args));
+    });
+
+    // join(future): waits for a spawned call and returns what it did.
+    // join(list, separator) joins strings instead; see text.h.
+    auto join = std::make_shared<loxc::callable>("<join builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        if ( ! args.empty() && std::holds_alternative<std::shared_ptr<loxc::list>>(args[0]) )
+            return text::join(interp, std::move(args));
+        return parallel::join(interp, std::move(args));
+    });
+}
+
+#endif
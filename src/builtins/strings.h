@@ -0,0 +1,38 @@
+#ifndef strings_h
+#define strings_h
+
+#include <memory>
+#include <vector>
+
+#include "callable.h"
+#include "text.h"
+#include "val.h"
+
+namespace builtins
+{
+    // substr(s, start, length): part of s, to its end without a length.
+    auto substr = std::make_shared<loxc::callable>("<substr builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return text::substr(interp, std::move(args));
+    });
+
+    // find(s, needle, from): where needle next occurs in s, or -1.
+    auto find = std::make_shared<loxc::callable>("<find builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return text::find(interp, std::move(args));
+    });
+
+    // split(s, separator): a list of the pieces of s between separators.
+    auto split = std::make_shared<loxc::callable>("<split builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return text::split(interp, std::move(args));
+    });
+
+    // replace(s, old, new): s with every old replaced by new.
+    auto replace = std::make_shared<loxc::callable>("<replace builtin>",
+    [](op::interpreter& interp, std::vector<Val> args)-> Val{
+        return text::replace(interp, std::move(args));
+    });
+}
+
+#endif
@@ -7,12 +7,10 @@
 #include "callable.h"
 #include "val.h"
 
-class Enviroment;
-
 namespace builtins
 {
     auto time = std::make_shared<loxc::callable>("<time builtin>", 
-    [](std::vector<Val> args)-> Val{
+    [](op::interpreter&, std::vector<Val> args)-> Val{
         // gross I know.
         return static_cast<double>(::time(0));
     });
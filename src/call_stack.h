@@ -0,0 +1,71 @@
+// the stack of lox function calls that are currently executing.
+#ifndef call_stack_h
+#define call_stack_h
+
+#include <string>
+#include <vector>
+
+#include "token.h"
+
+namespace loxc
+{
+    struct callable;
+}
+
+namespace op
+{
+
+/**
+ * A single lox call. Frames are small and stored contiguously so walking
+ * the stack (for a backtrace, say) stays cheap.
+ */
+struct frame
+{
+    const loxc::callable* callee;
+    loxc::lexeme site; // the call's closing paren
+};
+
+/**
+ * The interpreter's explicit call stack. Every lox call pushes a frame
+ * here before it runs and pops it on the way out, and pushing past
+ * max_depth raises a "Stack overflow." runtime error instead of running
+ * the process out of native stack. So does pushing with less than a
+ * fixed reserve of the thread's native stack left, since the native
+ * frames a lox call takes up depend on the code it runs.
+ */
+class call_stack
+{
+public:
+    static constexpr size_t default_max_depth = 4096;
+
+    explicit call_stack(size_t max_depth = default_max_depth)
+    : max_depth(max_depth)
+    {
+        frames.reserve(max_depth);
+    }
+
+    // Throws op::runtime_error on overflow. Defined in op.cc.
+    void push(const loxc::callable* callee, const loxc::lexeme& site);
+    void pop() { frames.pop_back(); }
+
+    size_t depth() const { return frames.size(); }
+    size_t limit() const { return max_depth; }
+    // The line of the innermost call site, or 0 at the top level.
+    int line() const { return frames.empty() ? 0 : frames.back().site.line; }
+    // The innermost call site. Only valid while a call is running.
+    const loxc::lexeme& site() const { return frames.back().site; }
+
+    /**
+     * Formats the stack innermost call first. Runs of frames beyond the
+     * first few are elided so a runaway recursion stays readable.
+     */
+    std::string backtrace() const;
+
+private:
+    std::vector<frame> frames;
+    size_t max_depth;
+};
+
+} // namespace op
+
+#endif
@@ -2,23 +2,156 @@
 #define callable_h
 
 #include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <variant>
 #include <vector>
 
 #include "val.h"
+#include "object.h"
+#include "source.h"
 
-class Enviroment;
+namespace op
+{
+    struct interpreter;
+}
+
+struct FuncStmt;
+class Globals;
+
+namespace parallel
+{
+    struct task;
+}
+
+namespace op
+{
+    struct generator;
+}
 
 namespace loxc
 {
+    /**
+     * Anything that can be called from lox. `func` is handed the
+     * interpreter making the call so that lox functions run on the
+     * caller's call stack. What else there is to know about it depends on
+     * what kind of callable it is, held in `kind`.
+     */
     struct callable
     {
+        using function = std::function<Val(op::interpreter&, std::vector<Val>)>;
+
+        // For lox code a module defined, the module's globals, which it
+        // runs against wherever it is called from. Null for the rest,
+        // which run against the calling interpreter's own.
+        struct module_code
+        {
+            Globals* env = nullptr;
+        };
+
+        // A builtin, or another function written in C++.
+        struct native
+        {
+            // Whether other threads can call it too. See parallel.h.
+            bool shareable = true;
+        };
+
+        // A function declared in lox.
+        struct lox_function : module_code
+        {
+            // The text of the declaration from its '(' to the end of its
+            // body.
+            loxc::source_span source;
+            // For a function declared by a statement, the declaration.
+            // Calls the vm inlined check they still reach it.
+            const FuncStmt* decl = nullptr;
+            // Whether it captures nothing, so can be rebuilt from source
+            // alone and called from other threads.
+            bool portable = false;
+        };
+
+        // A method as its class holds it, taking the instance first.
+        struct method : module_code {};
+
+        // A method read off an instance, which it carries along, so it
+        // can't cross threads.
+        struct bound_method : module_code {};
+
+        // A class, which is called to make an instance.
+        struct lox_class : module_code
+        {
+            std::shared_ptr<loxc::klass> cls;
+        };
+
+        // A future, which joins the spawned call it waits on.
+        struct future
+        {
+            std::shared_ptr<parallel::task> task;
+        };
+
+        // A call to a generator function, whose frame belongs to one
+        // thread.
+        struct generator : module_code
+        {
+            std::shared_ptr<op::generator> state;
+        };
+
+        using kinds = std::variant<native, lox_function, method, bound_method,
+            lox_class, future, generator>;
+
         std::string str;
-        std::function<Val(std::vector<Val>)> func;
+        function func;
+        kinds kind;
+
+        callable(std::string str, function func):
+        str(std::move(str)), func(std::move(func)), kind(native{}) {}
+
+        callable(std::string str, function func, kinds kind):
+        str(std::move(str)), func(std::move(func)), kind(std::move(kind)) {}
+
+        // The kind of callable it is, if it is a K.
+        template <typename K>
+        const K* as() const { return std::get_if<K>(&kind); }
+
+        Globals* env() const
+        {
+            return std::visit([](const auto& k) -> Globals* {
+                if constexpr (std::is_base_of_v<module_code, std::decay_t<decltype(k)>>)
+                    return k.env;
+                else
+                    return nullptr;
+                }, kind);
+        }
+
+        // For a function declared by a statement, the declaration.
+        const FuncStmt* declaration() const
+        {
+            auto f = as<lox_function>();
+            return f ? f->decl : nullptr;
+        }
+
+        // Moves lox code a module defined onto another copy of its globals.
+        void rebind(Globals* to)
+        {
+            std::visit([to](auto& k) {
+                if constexpr (std::is_base_of_v<module_code, std::decay_t<decltype(k)>>)
+                    k.env = to;
+                }, kind);
+        }
 
-        callable(std::string str,
-            std::function<Val(std::vector<Val>)> func):
-        str(std::move(str)), func(std::move(func)) {}
+        // Whether other threads can call it too. See parallel.h.
+        bool shareable() const
+        {
+            if (auto n = as<native>())
+                return n->shareable;
+            if (auto f = as<lox_function>())
+                return f->portable;
+            if (auto c = as<lox_class>())
+                return c->cls->shareable;
+            return ! (as<bound_method>() || as<generator>());
+        }
     };
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,424 @@
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "events.h"
+#include "callable.h"
+#include "op.h"
+
+namespace
+{
+    using clock = std::chrono::steady_clock;
+
+    // A lox function to call back, and the builtin and line that asked
+    // for it, which is where errors calling it are reported.
+    struct callback
+    {
+        std::shared_ptr<loxc::callable> f;
+        loxc::lexeme where;
+    };
+
+    // What an I/O thread hands back to the loop.
+    struct completion
+    {
+        uint64_t id;
+        bool failed = false;
+        std::string error;
+        std::string text;
+    };
+
+    // An I/O operation in flight. Reads call back with the text they got.
+    struct request
+    {
+        callback cb;
+        bool has_text;
+    };
+
+    // The number of threads doing blocking I/O for the loop.
+    const size_t io_threads = 4;
+
+    std::string describe(const char* verb, const std::string& path, int error)
+    {
+        return std::string("Couldn't ") + verb + " '" + path + "': "
+            + std::system_category().message(error) + ".";
+    }
+
+    completion read_all(uint64_t id, const std::string& path)
+    {
+        completion done{id};
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            done.failed = true;
+            done.error = describe("read", path, errno);
+            return done;
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0)
+            done.text.reserve(st.st_size);
+
+        char buf[1 << 16];
+        for (;;)
+        {
+            ssize_t n = ::read(fd, buf, sizeof(buf));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+            {
+                done.failed = true;
+                done.error = describe("read", path, errno);
+                break;
+            }
+            if (n == 0)
+                break;
+            done.text.append(buf, n);
+        }
+        ::close(fd);
+        return done;
+    }
+
+    completion write_all(uint64_t id, const std::string& path, const std::string& text)
+    {
+        completion done{id};
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (fd < 0)
+        {
+            done.failed = true;
+            done.error = describe("write", path, errno);
+            return done;
+        }
+
+        const char* data = text.data();
+        size_t left = text.size();
+        while (left)
+        {
+            ssize_t n = ::write(fd, data, left);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+            {
+                done.failed = true;
+                done.error = describe("write", path, errno);
+                break;
+            }
+            data += n;
+            left -= n;
+        }
+        if (::close(fd) != 0 && ! done.failed)
+        {
+            done.failed = true;
+            done.error = describe("write", path, errno);
+        }
+        return done;
+    }
+
+    /**
+     * Timers, I/O in flight and the threads doing it. Everything but the
+     * job queue and the finished list belongs to the interpreter's thread.
+     */
+    class loop
+    {
+    public:
+        loop()
+        {
+            epoll = ::epoll_create1(EPOLL_CLOEXEC);
+            timer = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            wakeup = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            for (int fd : {timer, wakeup})
+            {
+                epoll_event ev{};
+                ev.events = EPOLLIN;
+                ev.data.fd = fd;
+                ::epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &ev);
+            }
+        }
+
+        ~loop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(jobs_lock);
+                stopping = true;
+            }
+            jobs_ready.notify_all();
+            for (std::thread& t : threads)
+                t.join();
+            ::close(wakeup);
+            ::close(timer);
+            ::close(epoll);
+        }
+
+        uint64_t add_timer(callback cb, double ms)
+        {
+            uint64_t id = next_id++;
+            std::chrono::duration<double, std::milli> wanted(ms > 0 ? ms : 0);
+            clock::time_point now = clock::now();
+            // A delay longer than the clock can count up to waits as long
+            // as it can, rather than wrapping around to the past.
+            clock::duration room = clock::time_point::max() - now;
+            clock::duration delay = wanted >= room ? room
+                : std::chrono::duration_cast<clock::duration>(wanted);
+            clock::time_point at = now + delay;
+            // Ids only grow, so timers due at once run in the order set.
+            timers.emplace(std::make_pair(at, id), std::move(cb));
+            timer_at.emplace(id, at);
+            return id;
+        }
+
+        void cancel_timer(uint64_t id)
+        {
+            auto found = timer_at.find(id);
+            if (found == timer_at.end())
+                return;
+            timers.erase({found->second, id});
+            timer_at.erase(found);
+        }
+
+        // Runs work on an I/O thread, calling cb with its outcome.
+        void submit(callback cb, bool has_text, std::function<completion(uint64_t)> work)
+        {
+            uint64_t id = next_id++;
+            in_flight.emplace(id, request{std::move(cb), has_text});
+
+            {
+                std::lock_guard<std::mutex> lock(jobs_lock);
+                if (threads.empty())
+                    for (size_t i = 0; i < io_threads; ++i)
+                        threads.emplace_back([this]{ work_loop(); });
+                jobs.push_back([this, id, work = std::move(work)]{ finish(work(id)); });
+            }
+            jobs_ready.notify_one();
+        }
+
+        void run(op::interpreter& interp)
+        {
+            while ( ! timers.empty() || ! in_flight.empty() || ! ready.empty() )
+            {
+                fire_timers(interp);
+                deliver(interp);
+
+                if (timers.empty() && in_flight.empty())
+                    continue;
+                if ( ! timers.empty() && timers.begin()->first.first <= clock::now() )
+                    continue;
+                arm();
+                wait();
+            }
+        }
+
+    private:
+        // Runs every timer that is due, earliest first.
+        void fire_timers(op::interpreter& interp)
+        {
+            clock::time_point now = clock::now();
+            while ( ! timers.empty() && timers.begin()->first.first <= now )
+            {
+                auto first = timers.begin();
+                callback cb = std::move(first->second);
+                timer_at.erase(first->first.second);
+                timers.erase(first);
+                interp.call_value(*cb.f, {}, cb.where);
+            }
+        }
+
+        // Calls back for every finished I/O operation.
+        void deliver(op::interpreter& interp)
+        {
+            {
+                std::lock_guard<std::mutex> lock(finished_lock);
+                for (completion& c : finished)
+                    ready.push_back(std::move(c));
+                finished.clear();
+            }
+
+            // One at a time, so an error in a callback leaves the rest
+            // for later.
+            while ( ! ready.empty() )
+            {
+                completion c = std::move(ready.front());
+                ready.pop_front();
+                auto found = in_flight.find(c.id);
+                request r = std::move(found->second);
+                in_flight.erase(found);
+
+                std::vector<Val> args;
+                args.push_back(c.failed ? Val(std::move(c.error)) : Val());
+                if (r.has_text)
+                    args.push_back(c.failed ? Val() : Val(std::move(c.text)));
+                interp.call_value(*r.cb.f, std::move(args), r.cb.where);
+            }
+        }
+
+        // Sets the timerfd to go off with the earliest timer, if any.
+        void arm()
+        {
+            itimerspec spec{};
+            if ( ! timers.empty() )
+            {
+                auto since = timers.begin()->first.first.time_since_epoch();
+                auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(since).count();
+                spec.it_value.tv_sec = ns / 1000000000;
+                spec.it_value.tv_nsec = ns % 1000000000;
+                // All zeroes would disarm it instead.
+                if (ns == 0)
+                    spec.it_value.tv_nsec = 1;
+            }
+            ::timerfd_settime(timer, TFD_TIMER_ABSTIME, &spec, nullptr);
+        }
+
+        // Blocks until a timer goes off or an I/O thread finishes.
+        void wait()
+        {
+            epoll_event evs[2];
+            int n = ::epoll_wait(epoll, evs, 2, -1);
+            for (int i = 0; i < n; ++i)
+            {
+                // Both count events in eight bytes, read to reset them.
+                uint64_t count;
+                (void)::read(evs[i].data.fd, &count, sizeof(count));
+            }
+        }
+
+        void work_loop()
+        {
+            for (;;)
+            {
+                std::function<void()> job;
+                {
+                    std::unique_lock<std::mutex> lock(jobs_lock);
+                    jobs_ready.wait(lock, [&]{ return stopping || ! jobs.empty(); });
+                    if (stopping)
+                        return;
+                    job = std::move(jobs.front());
+                    jobs.pop_front();
+                }
+                job();
+            }
+        }
+
+        // On an I/O thread: hands c back to the loop and wakes it.
+        void finish(completion c)
+        {
+            {
+                std::lock_guard<std::mutex> lock(finished_lock);
+                finished.push_back(std::move(c));
+            }
+            uint64_t one = 1;
+            (void)::write(wakeup, &one, sizeof(one));
+        }
+
+        int epoll;
+        int timer;
+        int wakeup;
+        uint64_t next_id = 1;
+
+        std::map<std::pair<clock::time_point, uint64_t>, callback> timers;
+        std::unordered_map<uint64_t, clock::time_point> timer_at;
+        std::unordered_map<uint64_t, request> in_flight;
+        std::deque<completion> ready;
+
+        std::mutex jobs_lock;
+        std::condition_variable jobs_ready;
+        std::deque<std::function<void()>> jobs;
+        std::vector<std::thread> threads;
+        bool stopping = false;
+
+        std::mutex finished_lock;
+        std::vector<completion> finished;
+    };
+
+    loop& the_loop()
+    {
+        static loop l;
+        return l;
+    }
+
+    // The callback an event builtin was passed, checking it can wait for
+    // one at all.
+    callback expect_callback(const op::interpreter& interp, const char* builtin,
+        const Val& v, const char* usage)
+    {
+        if (interp.worker)
+            throw op::builtin_error(interp, builtin,
+                "Can't wait on timers or I/O in a spawned call.");
+        auto f = std::get_if<std::shared_ptr<loxc::callable>>(&v);
+        if ( ! f )
+            throw op::builtin_error(interp, builtin, usage);
+        return callback{*f, op::builtin_site(interp, builtin)};
+    }
+}
+
+void events::run(op::interpreter& interp)
+{
+    the_loop().run(interp);
+}
+
+Val events::set_timeout(op::interpreter& interp, std::vector<Val> args)
+{
+    const char* usage = "setTimeout expects a function and a delay in milliseconds.";
+    if (args.size() != 2 || ! std::holds_alternative<double>(args[1]))
+        throw op::builtin_error(interp, "setTimeout", usage);
+    if ( ! std::isfinite(std::get<double>(args[1])) )
+        throw op::builtin_error(interp, "setTimeout", "setTimeout expects a finite delay.");
+    callback cb = expect_callback(interp, "setTimeout", args[0], usage);
+    return static_cast<double>(the_loop().add_timer(std::move(cb), std::get<double>(args[1])));
+}
+
+Val events::clear_timeout(op::interpreter& interp, std::vector<Val> args)
+{
+    if (args.size() != 1 || ! std::holds_alternative<double>(args[0]))
+        throw op::builtin_error(interp, "clearTimeout",
+            "clearTimeout expects a timer id.");
+    // Ids are whole numbers from 1 up, exact as doubles up to 2^53; like
+    // an id whose timer is gone, anything else names no timer.
+    double id = std::get<double>(args[0]);
+    if (id >= 1 && id <= 9007199254740992.0 && std::floor(id) == id)
+        the_loop().cancel_timer(static_cast<uint64_t>(id));
+    return std::monostate{};
+}
+
+Val events::read_file(op::interpreter& interp, std::vector<Val> args)
+{
+    const char* usage = "readFile expects a path and a function.";
+    if (args.size() != 2 || ! std::holds_alternative<std::string>(args[0]))
+        throw op::builtin_error(interp, "readFile", usage);
+    callback cb = expect_callback(interp, "readFile", args[1], usage);
+    the_loop().submit(std::move(cb), true,
+        [path = std::get<std::string>(std::move(args[0]))](uint64_t id) {
+            return read_all(id, path);
+        });
+    return std::monostate{};
+}
+
+Val events::write_file(op::interpreter& interp, std::vector<Val> args)
+{
+    const char* usage = "writeFile expects a path, a string and a function.";
+    if (args.size() != 3 || ! std::holds_alternative<std::string>(args[0]) ||
+        ! std::holds_alternative<std::string>(args[1]))
+        throw op::builtin_error(interp, "writeFile", usage);
+    callback cb = expect_callback(interp, "writeFile", args[2], usage);
+    the_loop().submit(std::move(cb), false,
+        [path = std::get<std::string>(std::move(args[0])),
+         text = std::get<std::string>(std::move(args[1]))](uint64_t id) {
+            return write_all(id, path, text);
+        });
+    return std::monostate{};
+}
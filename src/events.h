@@ -0,0 +1,50 @@
+// an event loop for lox: timers and file I/O that call back when done.
+#ifndef events_h
+#define events_h
+
+#include <vector>
+
+#include "val.h"
+
+namespace op
+{
+    struct interpreter;
+}
+
+/**
+ * setTimeout(f, ms) calls f after ms milliseconds; readFile(path, f) and
+ * writeFile(path, text, f) start the I/O and return at once, calling f
+ * when it completes. None of these calls run anything themselves: after
+ * an input's top level code finishes, the loop waits for timers and I/O
+ * and runs each callback in turn on the interpreter's thread, until
+ * nothing is left pending. So lox code is never interrupted and a single
+ * process overlaps as many reads and writes as it cares to start.
+ *
+ * The loop waits in epoll on two descriptors: a timerfd armed for the
+ * earliest timer, and an eventfd that I/O threads signal when they finish.
+ * Regular files are always "ready" to epoll, so reads and writes block on
+ * a small pool of threads rather than on the loop; those threads only move
+ * bytes and never touch lox values.
+ *
+ * Callbacks follow node's order of arguments: an error message, or nil on
+ * success, then the result if there is one.
+ */
+namespace events
+{
+
+/**
+ * Runs callbacks until no timer or I/O is pending. A runtime error in a
+ * callback propagates out, leaving what is still pending for the next
+ * run.
+ */
+void run(op::interpreter& interp);
+
+// The builtins. args as lox passed them.
+Val set_timeout(op::interpreter& interp, std::vector<Val> args);
+Val clear_timeout(op::interpreter& interp, std::vector<Val> args);
+Val read_file(op::interpreter& interp, std::vector<Val> args);
+Val write_file(op::interpreter& interp, std::vector<Val> args);
+
+} // namespace events
+
+#endif
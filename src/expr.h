@@ -16,6 +16,11 @@
 #include <vector>
 #include "token.h"
 #include "val.h"
+#include "binding.h"
+#include "shape.h"
+
+// compiled function bodies, see vm.h.
+namespace vm { struct chunk; }
 
 using Expr = std::variant<
 	std::monostate,
@@ -26,6 +31,9 @@ using Expr = std::variant<
 	std::shared_ptr<struct VarExpr>,
 	std::shared_ptr<struct RedefExpr>,
 	std::shared_ptr<struct LogicExpr>,
+	std::shared_ptr<struct GetExpr>,
+	std::shared_ptr<struct SetExpr>,
+	std::shared_ptr<struct SuperExpr>,
 	std::shared_ptr<struct CallExpr>,
 	std::shared_ptr<struct FunExpr> >;
 
@@ -34,10 +42,10 @@ using Expr = std::variant<
 struct BinaryExpr
 {
 	Expr left;
-	loxc::token op;
+	loxc::lexeme op;
 	Expr right;
 
-	BinaryExpr (Expr left_in, loxc::token op_in, Expr right_in)
+	BinaryExpr (Expr left_in, loxc::lexeme op_in, Expr right_in)
 		: left(std::move(left_in)), op(std::move(op_in)), right(std::move(right_in)) {}
 };
 
@@ -59,58 +67,108 @@ struct LiteralExpr
 
 struct UnaryExpr
 {
-	loxc::token op;
+	loxc::lexeme op;
 	Expr right;
 
-	UnaryExpr (loxc::token op_in, Expr right_in)
+	UnaryExpr (loxc::lexeme op_in, Expr right_in)
 		: op(std::move(op_in)), right(std::move(right_in)) {}
 };
 
 struct VarExpr
 {
-	loxc::token name;
+	loxc::lexeme name;
 
-	VarExpr (loxc::token name_in)
+	VarExpr (loxc::lexeme name_in)
 		: name(std::move(name_in)) {}
+
+	// annotations
+	loxc::binding bind{};
 };
 
 struct RedefExpr
 {
-	loxc::token name;
+	loxc::lexeme name;
 	Expr value;
 
-	RedefExpr (loxc::token name_in, Expr value_in)
+	RedefExpr (loxc::lexeme name_in, Expr value_in)
 		: name(std::move(name_in)), value(std::move(value_in)) {}
+
+	// annotations
+	loxc::binding bind{};
 };
 
 struct LogicExpr
 {
 	Expr left;
-	loxc::token op;
+	loxc::lexeme op;
 	Expr right;
 
-	LogicExpr (Expr left_in, loxc::token op_in, Expr right_in)
+	LogicExpr (Expr left_in, loxc::lexeme op_in, Expr right_in)
 		: left(std::move(left_in)), op(std::move(op_in)), right(std::move(right_in)) {}
 };
 
+struct GetExpr
+{
+	Expr object;
+	loxc::lexeme name;
+
+	GetExpr (Expr object_in, loxc::lexeme name_in)
+		: object(std::move(object_in)), name(std::move(name_in)) {}
+
+	// annotations
+	loxc::property_cache cache{};
+};
+
+struct SetExpr
+{
+	Expr object;
+	loxc::lexeme name;
+	Expr value;
+
+	SetExpr (Expr object_in, loxc::lexeme name_in, Expr value_in)
+		: object(std::move(object_in)), name(std::move(name_in)), value(std::move(value_in)) {}
+
+	// annotations
+	loxc::property_cache cache{};
+};
+
+struct SuperExpr
+{
+	loxc::lexeme keyword;
+	loxc::lexeme method;
+
+	SuperExpr (loxc::lexeme keyword_in, loxc::lexeme method_in)
+		: keyword(std::move(keyword_in)), method(std::move(method_in)) {}
+
+	// annotations
+	loxc::binding super_bind{};
+	loxc::binding this_bind{};
+};
+
 struct CallExpr
 {
 	Expr callee;
-	loxc::token closing_paren;
+	loxc::lexeme closing_paren;
 	std::vector<Expr> args;
 
-	CallExpr (Expr callee_in, loxc::token closing_paren_in, std::vector<Expr> args_in)
+	CallExpr (Expr callee_in, loxc::lexeme closing_paren_in, std::vector<Expr> args_in)
 		: callee(std::move(callee_in)), closing_paren(std::move(closing_paren_in)), args(std::move(args_in)) {}
 };
 
 struct FunExpr
 {
-	std::vector<loxc::token> params;
+	std::vector<loxc::lexeme> params;
 	Stmt body;
-	loxc::token closing_paren;
+	loxc::lexeme closing_paren;
 
-	FunExpr (std::vector<loxc::token> params_in, Stmt body_in, loxc::token closing_paren_in)
+	FunExpr (std::vector<loxc::lexeme> params_in, Stmt body_in, loxc::lexeme closing_paren_in)
 		: params(std::move(params_in)), body(std::move(body_in)), closing_paren(std::move(closing_paren_in)) {}
+
+	// annotations
+	loxc::function_layout layout{};
+	loxc::source_span span{};
+	std::shared_ptr<loxc::deferred_body> deferred{};
+	std::shared_ptr<vm::chunk> code{};
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,183 @@
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "files.h"
+#include "callable.h"
+#include "op.h"
+#include "stats.h"
+
+namespace
+{
+    // Drops the "\n" or "\r\n" a line view may end with.
+    std::string_view chomp(std::string_view line)
+    {
+        if ( ! line.empty() && line.back() == '\r' )
+            line.remove_suffix(1);
+        return line;
+    }
+
+    /**
+     * Lines straight out of a mapping of the whole file. Only the part
+     * being scanned need be in memory, and the kernel is told the file
+     * is read front to back, so it reads ahead and drops pages behind.
+     */
+    class mapped_reader : public files::line_reader
+    {
+    public:
+        mapped_reader(const char* data, size_t size) : data(data), size(size) {}
+
+        ~mapped_reader()
+        {
+            ::munmap(const_cast<char*>(data), size);
+        }
+
+        bool next(std::string_view& line) override
+        {
+            if (at >= size)
+                return false;
+            const void* nl = std::memchr(data + at, '\n', size - at);
+            size_t end = nl ? static_cast<const char*>(nl) - data : size;
+            line = chomp(std::string_view(data + at, end - at));
+            at = end + 1;
+            return true;
+        }
+
+    private:
+        const char* data;
+        size_t size;
+        size_t at = 0;
+    };
+
+    /**
+     * Lines read(2) into a buffer, for input that can't be mapped. The
+     * buffer doubles when a line doesn't fit.
+     */
+    class stream_reader : public files::line_reader
+    {
+    public:
+        stream_reader(int fd, bool owned) : fd(fd), owned(owned), buffer(1 << 16) {}
+
+        ~stream_reader()
+        {
+            if (owned)
+                ::close(fd);
+        }
+
+        bool next(std::string_view& line) override
+        {
+            for (;;)
+            {
+                if (const void* nl = std::memchr(buffer.data() + start, '\n', end - start))
+                {
+                    size_t stop = static_cast<const char*>(nl) - buffer.data();
+                    line = chomp(std::string_view(buffer.data() + start, stop - start));
+                    start = stop + 1;
+                    return true;
+                }
+                if (finished)
+                {
+                    if (start == end)
+                        return false;
+                    line = chomp(std::string_view(buffer.data() + start, end - start));
+                    start = end;
+                    return true;
+                }
+                fill();
+            }
+        }
+
+    private:
+        // Moves what's left to the front, grows the buffer if that's all
+        // of it, and reads more after it.
+        void fill()
+        {
+            std::memmove(buffer.data(), buffer.data() + start, end - start);
+            end -= start;
+            start = 0;
+            if (end == buffer.size())
+                buffer.resize(buffer.size() * 2);
+
+            ssize_t n;
+            do
+                n = ::read(fd, buffer.data() + end, buffer.size() - end);
+            while (n < 0 && errno == EINTR);
+            if (n <= 0)
+                finished = true;
+            else
+                end += n;
+        }
+
+        int fd;
+        bool owned;
+        std::vector<char> buffer;
+        size_t start = 0;
+        size_t end = 0;
+        bool finished = false;
+    };
+}
+
+std::unique_ptr<files::line_reader> files::open_lines(const std::string& path, std::string& error)
+{
+    if (path == "-")
+        return std::make_unique<stream_reader>(STDIN_FILENO, false);
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        error = std::system_category().message(errno);
+        return nullptr;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        void* data = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            ::madvise(data, st.st_size, MADV_SEQUENTIAL);
+            ::close(fd);
+            return std::make_unique<mapped_reader>(static_cast<const char*>(data), st.st_size);
+        }
+    }
+    // Files in /proc and the like say they are empty, so they are read
+    // rather than mapped too.
+    return std::make_unique<stream_reader>(fd, true);
+}
+
+Val files::lines(op::interpreter& interp, std::vector<Val> args)
+{
+    loxc::lexeme where = op::builtin_site(interp, "lines");
+    if (args.size() != 1 || ! std::holds_alternative<std::string>(args[0]))
+        throw op::runtime_error(where, "lines expects a path.");
+    const std::string& path = std::get<std::string>(args[0]);
+
+    std::string error;
+    std::shared_ptr<line_reader> reader = open_lines(path, error);
+    if ( ! reader )
+        throw op::runtime_error(where, "Couldn't read '" + path + "': " + error + ".");
+
+    auto f = std::make_shared<loxc::callable>("<lines " + path + ">",
+    [reader](op::interpreter&, std::vector<Val>) mutable -> Val{
+        std::string_view line;
+        if ( ! reader || ! reader->next(line) )
+        {
+            // Unmapped or closed as soon as it's done with.
+            reader.reset();
+            return std::monostate{};
+        }
+        LOXC_COUNT(strings, 1);
+        LOXC_COUNT(string_bytes, line.size());
+        return std::string(line);
+    },
+    // Its place in the file can't be copied to another thread.
+    loxc::callable::native{false});
+    return f;
+}
@@ -0,0 +1,57 @@
+// reading files line by line, for scripts that process input.
+#ifndef files_h
+#define files_h
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "val.h"
+
+namespace op
+{
+    struct interpreter;
+}
+
+/**
+ * lines(path) opens a file and returns a function that reads it: each
+ * call returns the next line, without its "\n" or "\r\n", and nil once
+ * the file is finished. A path of "-" reads standard input.
+ *
+ * Regular files are mapped into memory, so a read is a scan for the next
+ * newline and a copy of the line, and nothing more of the file is held
+ * than the page cache keeps. Pipes, terminals and files that can't be
+ * mapped fall back to read(2) into a buffer.
+ */
+namespace files
+{
+
+/**
+ * A source of lines, whose views last until the next call to next.
+ */
+class line_reader
+{
+public:
+    virtual ~line_reader() = default;
+
+    // Sets line to the next line and returns true, or returns false at
+    // the end of the input.
+    virtual bool next(std::string_view& line) = 0;
+};
+
+/**
+ * Opens path, or standard input for "-", to read by lines.
+ *
+ * @param error set to what went wrong if the file can't be opened.
+ * @return nullptr if the file can't be opened.
+ */
+std::unique_ptr<line_reader> open_lines(const std::string& path, std::string& error);
+
+// The builtin. args as lox passed them.
+Val lines(op::interpreter& interp, std::vector<Val> args);
+
+} // namespace files
+
+#endif
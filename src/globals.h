@@ -0,0 +1,111 @@
+// the table of global variables.
+#ifndef globals_h
+#define globals_h
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "val.h"
+#include "binding.h"
+
+/**
+ * Globals live in slots that never move once created, so a reference can
+ * cache a pointer to its slot (see loxc::binding) and skip the name lookup
+ * on later executions.
+ *
+ * Every table carries a version drawn from a process wide counter. It
+ * changes whenever an existing global is redefined, which invalidates
+ * every cached slot at once. Because versions are never reused, a cache
+ * filled in against one table is never mistaken as valid for another.
+ */
+class Globals
+{
+public:
+    Globals() : ver(next_version()) {}
+
+    Globals(const Globals&) = delete;
+    Globals& operator=(const Globals&) = delete;
+
+    /**
+     * Defines or redefines a global.
+     *
+     * @return the slot holding the value.
+     */
+    Val* define(const std::string& name, Val value)
+    {
+        auto where = index.find(name);
+        if (where != index.end())
+        {
+            ver = next_version();
+            Val* slot = &slots[where->second];
+            *slot = std::move(value);
+            return slot;
+        }
+        index.emplace(name, slots.size());
+        slots.push_back(std::move(value));
+        return &slots.back();
+    }
+
+    /**
+     * @return the slot for name or nullptr if it has not been defined.
+     */
+    Val* lookup(const std::string& name)
+    {
+        auto where = index.find(name);
+        return where == index.end() ? nullptr : &slots[where->second];
+    }
+
+    /**
+     * Lookup through an inline cache. On a hit this is a compare and a
+     * load; on a miss the cache is refilled.
+     *
+     * @return the slot for name or nullptr if it has not been defined.
+     */
+    Val* lookup(const std::string& name, loxc::binding& cache)
+    {
+        if (cache.version == ver)
+            return cache.cached;
+
+        Val* slot = lookup(name);
+        if (slot)
+        {
+            cache.cached = slot;
+            cache.version = ver;
+        }
+        return slot;
+    }
+
+    uint64_t version() const { return ver; }
+
+    /**
+     * Calls f(name, value) for every global in the order they were first
+     * defined.
+     */
+    template <typename F>
+    void for_each(F f) const
+    {
+        std::vector<const std::string*> names(slots.size());
+        for (const auto& entry : index)
+            names[entry.second] = &entry.first;
+        for (size_t i = 0; i < slots.size(); ++i)
+            f(*names[i], slots[i]);
+    }
+
+private:
+    static uint64_t next_version()
+    {
+        static std::atomic<uint64_t> counter{1};
+        return counter++;
+    }
+
+    std::unordered_map<std::string, size_t> index;
+    // A deque so that growing the table never moves existing slots.
+    std::deque<Val> slots;
+    uint64_t ver;
+};
+
+#endif
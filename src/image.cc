@@ -0,0 +1,382 @@
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "image.h"
+#include "callable.h"
+#include "reporter.h"
+
+namespace
+{
+    const char magic[8] = {'l', 'o', 'x', 'c', 'i', 'm', 'g', '1'};
+
+    // Scoped so the names don't collide with the token types.
+    enum class kind : uint8_t
+    {
+        NIL,
+        NUMBER,
+        BOOL,
+        STRING,
+        FUNCTION,
+        BUILTIN,
+        ALIAS,
+    };
+
+    // The builtins, in the order they were defined.
+    std::vector<std::pair<std::string, Val>> builtins;
+
+    // The name f was defined under as a builtin, or null if it isn't one.
+    const std::string* builtin_name(const loxc::callable& f)
+    {
+        for (const auto& [name, value] : builtins)
+            if (auto b = std::get_if<std::shared_ptr<loxc::callable>>(&value); b && b->get() == &f)
+                return &name;
+        return nullptr;
+    }
+
+    const Val* builtin(std::string_view name)
+    {
+        for (const auto& entry : builtins)
+            if (entry.first == name)
+                return &entry.second;
+        return nullptr;
+    }
+
+    class writer
+    {
+    public:
+        explicit writer(const char* path) : file(path, std::ios::binary | std::ios::trunc) {}
+
+        bool ok() const { return file.good(); }
+
+        void raw(const void* data, size_t size)
+        {
+            file.write(static_cast<const char*>(data), size);
+        }
+        void u8(uint8_t b) { raw(&b, 1); }
+        void record(kind k) { u8(static_cast<uint8_t>(k)); }
+        void u32(uint32_t n) { raw(&n, sizeof(n)); }
+        void text(std::string_view s)
+        {
+            u32(s.size());
+            raw(s.data(), s.size());
+        }
+
+    private:
+        std::ofstream file;
+    };
+
+    // Reads records out of the mapped image. Every read checks that the
+    // image is long enough, so a truncated file is an error, not a crash.
+    class reader
+    {
+    public:
+        reader(const char* data, size_t size) : at(data), end(data + size) {}
+
+        bool done() const { return at == end; }
+
+        bool raw(void* out, size_t size)
+        {
+            if (static_cast<size_t>(end - at) < size)
+                return false;
+            std::memcpy(out, at, size);
+            at += size;
+            return true;
+        }
+        bool text(std::string_view& out)
+        {
+            uint32_t size;
+            if ( ! raw(&size, sizeof(size)) || static_cast<size_t>(end - at) < size )
+                return false;
+            out = std::string_view(at, size);
+            at += size;
+            return true;
+        }
+
+    private:
+        const char* at;
+        const char* end;
+    };
+
+    // The declaration that rebuilds f as the global name.
+    std::string declaration(const std::string& name, const loxc::callable& f)
+    {
+        std::string text(f.as<loxc::callable::lox_function>()->source.text());
+        if (f.str == name)
+            return "fun " + name + text + "\n";
+        return "var " + name + " = anon" + text + ";\n";
+    }
+
+    // Why value can't be rebuilt from an image, or null if it can.
+    const char* unsaveable(const Val& value)
+    {
+        if (auto f = std::get_if<std::shared_ptr<loxc::callable>>(&value))
+        {
+            if ((*f)->as<loxc::callable::lox_class>())
+                return "classes can't be saved.";
+            if ((*f)->as<loxc::callable::future>() || (*f)->as<loxc::callable::generator>())
+                return "futures and generators can't be saved.";
+            if ((*f)->env())
+                return "functions imported from modules can't be saved.";
+            auto lox = (*f)->as<loxc::callable::lox_function>();
+            if ( ! lox && ! builtin_name(**f) )
+                return "bound methods and natives other than the builtins can't be saved.";
+            if (lox && ! lox->portable)
+                return "it captures local variables.";
+            return nullptr;
+        }
+        if (std::holds_alternative<std::monostate>(value) ||
+            std::holds_alternative<double>(value) ||
+            std::holds_alternative<bool>(value) ||
+            std::holds_alternative<std::string>(value))
+            return nullptr;
+        if (std::holds_alternative<std::shared_ptr<loxc::float64_array>>(value) ||
+            std::holds_alternative<std::shared_ptr<loxc::list>>(value) ||
+            std::holds_alternative<std::shared_ptr<loxc::map>>(value))
+            return "arrays, lists and maps can't be saved.";
+        return "instances can't be saved.";
+    }
+
+    bool load(Globals& globals, Session& session, reader in)
+    {
+        char header[sizeof(magic)];
+        if ( ! in.raw(header, sizeof(header)) || std::memcmp(header, magic, sizeof(magic)) != 0 )
+            return false;
+
+        // Nothing is defined until every record is read, so a builtin
+        // the image rebinds under another name is still found by its own
+        // when a later record refers to it. Functions are compiled
+        // together last.
+        std::vector<std::pair<std::string, Val>> values;
+        std::string functions;
+        std::vector<std::pair<std::string, std::string>> aliases;
+
+        while ( ! in.done() )
+        {
+            uint8_t k;
+            std::string_view name;
+            if ( ! in.raw(&k, 1) || ! in.text(name) )
+                return false;
+
+            switch (static_cast<kind>(k))
+            {
+            case kind::NIL:
+                values.emplace_back(name, std::monostate{});
+                break;
+            case kind::NUMBER:
+            {
+                double d;
+                if ( ! in.raw(&d, sizeof(d)) )
+                    return false;
+                values.emplace_back(name, d);
+                break;
+            }
+            case kind::BOOL:
+            {
+                uint8_t b;
+                if ( ! in.raw(&b, 1) )
+                    return false;
+                values.emplace_back(name, b != 0);
+                break;
+            }
+            case kind::STRING:
+            {
+                std::string_view s;
+                if ( ! in.text(s) )
+                    return false;
+                values.emplace_back(name, std::string(s));
+                break;
+            }
+            case kind::FUNCTION:
+            {
+                std::string_view decl;
+                if ( ! in.text(decl) )
+                    return false;
+                functions += decl;
+                break;
+            }
+            case kind::BUILTIN:
+            {
+                std::string_view of;
+                const Val* value;
+                if ( ! in.text(of) || ! (value = builtin(of)) )
+                    return false;
+                values.emplace_back(name, *value);
+                break;
+            }
+            case kind::ALIAS:
+            {
+                std::string_view of;
+                if ( ! in.text(of) )
+                    return false;
+                aliases.emplace_back(name, of);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+
+        for (auto& [name, value] : values)
+            globals.define(name, std::move(value));
+        if ( ! functions.empty() && session.run(std::move(functions)) != GOOD )
+            return false;
+
+        // The same function again, so it stays equal to itself.
+        for (const auto& [name, of] : aliases)
+        {
+            const Val* value = globals.lookup(of);
+            if ( ! value )
+                return false;
+            globals.define(name, *value);
+        }
+        return true;
+    }
+}
+
+void loxc::configure_images(const Globals& globals)
+{
+    builtins.clear();
+    globals.for_each([](const std::string& name, const Val& value) {
+        builtins.emplace_back(name, value);
+    });
+}
+
+bool loxc::dump_image(const Globals& globals, const char* path)
+{
+    // Check everything first, so a program the image could not rebuild
+    // leaves no image behind rather than one that fails to load.
+    bool saveable = true;
+    globals.for_each([&](const std::string& name, const Val& value) {
+        if (const char* why = unsaveable(value))
+        {
+            Reporter::error("Can't save '" + name + "' in the image: " + why);
+            saveable = false;
+        }
+    });
+    if ( ! saveable )
+        return false;
+
+    writer out(path);
+    if ( ! out.ok() )
+    {
+        Reporter::error("Could not write image '" + std::string(path) + "'");
+        return false;
+    }
+    out.raw(magic, sizeof(magic));
+
+    // A function held by several globals is declared once, under the
+    // name it was declared with if one of them is that, and the others
+    // are saved as aliases of it.
+    std::unordered_map<const loxc::callable*, std::string> declared_as;
+    globals.for_each([&](const std::string& name, const Val& value) {
+        if (auto f = std::get_if<std::shared_ptr<loxc::callable>>(&value))
+        {
+            auto found = declared_as.find(f->get());
+            if (found == declared_as.end())
+                declared_as.emplace(f->get(), name);
+            else if (name == (*f)->str)
+                found->second = name;
+        }
+    });
+
+    globals.for_each([&](const std::string& name, const Val& value) {
+        if (auto f = std::get_if<std::shared_ptr<loxc::callable>>(&value))
+        {
+            if (const std::string* of = builtin_name(**f))
+            {
+                // Every run defines the builtins under their own names.
+                if (*of == name)
+                    return;
+                out.record(kind::BUILTIN);
+                out.text(name);
+                out.text(*of);
+                return;
+            }
+            const std::string& primary = declared_as[f->get()];
+            if (primary != name)
+            {
+                out.record(kind::ALIAS);
+                out.text(name);
+                out.text(primary);
+                return;
+            }
+            out.record(kind::FUNCTION);
+            out.text(name);
+            out.text(declaration(name, **f));
+        }
+        else if (std::holds_alternative<std::monostate>(value))
+        {
+            out.record(kind::NIL);
+            out.text(name);
+        }
+        else if (auto d = std::get_if<double>(&value))
+        {
+            out.record(kind::NUMBER);
+            out.text(name);
+            out.raw(d, sizeof(*d));
+        }
+        else if (auto b = std::get_if<bool>(&value))
+        {
+            out.record(kind::BOOL);
+            out.text(name);
+            out.u8(*b);
+        }
+        else if (auto s = std::get_if<std::string>(&value))
+        {
+            out.record(kind::STRING);
+            out.text(name);
+            out.text(*s);
+        }
+    });
+
+    if ( ! out.ok() )
+    {
+        Reporter::error("Could not write image '" + std::string(path) + "'");
+        return false;
+    }
+    return true;
+}
+
+bool loxc::load_image(Globals& globals, Session& session, const char* path)
+{
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        Reporter::error("Could not open image '" + std::string(path) + "'");
+        return false;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        Reporter::error("Not a loxc image '" + std::string(path) + "'");
+        return false;
+    }
+
+    void* data = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+    {
+        Reporter::error("Could not map image '" + std::string(path) + "'");
+        return false;
+    }
+
+    bool ok = load(globals, session, reader(static_cast<const char*>(data), st.st_size));
+    ::munmap(data, st.st_size);
+
+    if ( ! ok )
+        Reporter::error("Not a loxc image '" + std::string(path) + "'");
+    return ok;
+}
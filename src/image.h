@@ -0,0 +1,59 @@
+// startup images: the globals left behind by a script, saved so later runs
+// can start from them without running the script again.
+#ifndef image_h
+#define image_h
+
+#include "globals.h"
+#include "session.h"
+
+namespace loxc
+{
+
+/**
+ * An image holds every global that can be rebuilt without running the
+ * code that made it: nil, numbers, booleans, strings and lox functions
+ * that capture nothing. Functions are saved as the text of their
+ * declaration and recompiled on load, which costs a scan and parse of
+ * the function bodies alone, not a rerun of the script that built the
+ * values. A builtin under its own name is skipped since every run
+ * defines it itself; one bound to another name is saved as the name of
+ * the builtin and bound to it again on load. Closures over locals,
+ * classes, instances, bound methods, lists, maps, arrays, futures,
+ * generators and functions imported from modules can't be rebuilt, so a
+ * global holding one is an error and no image is written.
+ *
+ * The file is a magic string followed by one record per global:
+ *
+ *     u8 kind, u32 name length, name, payload
+ *
+ * where the payload is 8 bytes of double for a number, a u8 for a bool,
+ * and a u32 length and bytes for a string, a function or a builtin's
+ * name. Integers are in host byte order; images are not meant to move
+ * between machines.
+ */
+
+/**
+ * Records the builtins, which images refer to by the names they are
+ * defined under here. Call once they are defined.
+ */
+void configure_images(const Globals& builtins);
+
+/**
+ * Writes the globals to path.
+ *
+ * @return false after reporting an error if a global can't be saved or
+ * the file could not be written.
+ */
+bool dump_image(const Globals& globals, const char* path);
+
+/**
+ * Maps the image at path and defines its globals, compiling its functions
+ * with session.
+ *
+ * @return false after reporting an error if the image could not be read.
+ */
+bool load_image(Globals& globals, Session& session, const char* path);
+
+} // namespace loxc
+
+#endif
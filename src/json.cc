@@ -0,0 +1,625 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "json.h"
+#include "array.h"
+#include "callable.h"
+#include "number.h"
+#include "object.h"
+#include "op.h"
+#include "output.h"
+#include "stats.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    // Deeper nesting than this is refused rather than risk the native
+    // stack, parsing or writing.
+    const size_t max_depth = 1000;
+
+    /**
+     * The length of the run at the start of [p, end) that a JSON string
+     * can hold as it is: up to the first quote, backslash or control
+     * character. SSE2 is part of x86-64, so this needs no check of the
+     * CPU and tests 16 bytes a step.
+     */
+    size_t plain_run(const char* p, const char* end)
+    {
+        const char* start = p;
+#ifdef __SSE2__
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i control = _mm_set1_epi8(0x1f);
+        for (; end - p >= 16; p += 16)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            __m128i special = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                // v <= 0x1f, unsigned
+                _mm_cmpeq_epi8(_mm_max_epu8(v, control), control));
+            if (int mask = _mm_movemask_epi8(special))
+                return p - start + __builtin_ctz(mask);
+        }
+#endif
+        for (; p < end; ++p)
+        {
+            unsigned char c = *p;
+            if (c == '"' || c == '\\' || c < 0x20)
+                break;
+        }
+        return p - start;
+    }
+
+    struct syntax_error
+    {
+        const char* at;
+        const char* what;
+    };
+
+    /**
+     * A recursive descent parser straight over the text, building values
+     * as it goes.
+     */
+    class parser
+    {
+    public:
+        parser(std::string_view text) : begin(text.data()), p(text.data()), end(p + text.size()) {}
+
+        Val document()
+        {
+            Val v = value(0);
+            skip_space();
+            if (p != end)
+                fail("Unexpected text after the value.");
+            return v;
+        }
+
+        size_t offset(const char* at) const { return at - begin; }
+
+    private:
+        [[noreturn]] void fail(const char* what) { throw syntax_error{p, what}; }
+
+        void skip_space()
+        {
+            while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+                ++p;
+        }
+
+        // Skips the literal word if it's next.
+        bool word(const char* w, size_t n)
+        {
+            if (static_cast<size_t>(end - p) < n || std::memcmp(p, w, n) != 0)
+                return false;
+            p += n;
+            return true;
+        }
+
+        Val value(size_t depth)
+        {
+            skip_space();
+            if (p == end)
+                fail("Expected a value.");
+            switch (*p)
+            {
+                case '{': return object(depth + 1);
+                case '[': return array(depth + 1);
+                case '"': return string();
+                case 't': if (word("true", 4)) return true; break;
+                case 'f': if (word("false", 5)) return false; break;
+                case 'n': if (word("null", 4)) return std::monostate{}; break;
+                default:
+                    if (*p == '-' || (*p >= '0' && *p <= '9'))
+                        return number();
+            }
+            fail("Expected a value.");
+        }
+
+        Val object(size_t depth)
+        {
+            if (depth > max_depth)
+                fail("Nested too deeply.");
+            ++p;
+            size_t base = fields.size();
+            skip_space();
+            if (p < end && *p == '}')
+                ++p;
+            else
+                for (;;)
+                {
+                    skip_space();
+                    if (p == end || *p != '"')
+                        fail("Expected a string key.");
+                    std::string key = text();
+                    skip_space();
+                    if (p == end || *p != ':')
+                        fail("Expected ':'.");
+                    ++p;
+                    Val v = value(depth);
+                    fields.emplace_back(std::move(key), std::move(v));
+                    skip_space();
+                    if (p < end && *p == ',')
+                    {
+                        ++p;
+                        continue;
+                    }
+                    if (p < end && *p == '}')
+                    {
+                        ++p;
+                        break;
+                    }
+                    fail("Expected ',' or '}'.");
+                }
+
+            auto m = std::make_shared<loxc::map>();
+            m->entries.reserve(fields.size() - base);
+            for (size_t i = base; i < fields.size(); ++i)
+                m->set(std::move(fields[i].first), std::move(fields[i].second));
+            fields.resize(base);
+            return m;
+        }
+
+        Val array(size_t depth)
+        {
+            if (depth > max_depth)
+                fail("Nested too deeply.");
+            ++p;
+            size_t base = items.size();
+            skip_space();
+            if (p < end && *p == ']')
+                ++p;
+            else
+                for (;;)
+                {
+                    Val v = value(depth);
+                    items.push_back(std::move(v));
+                    skip_space();
+                    if (p < end && *p == ',')
+                    {
+                        ++p;
+                        continue;
+                    }
+                    if (p < end && *p == ']')
+                    {
+                        ++p;
+                        break;
+                    }
+                    fail("Expected ',' or ']'.");
+                }
+
+            auto l = std::make_shared<loxc::list>();
+            l->items.assign(std::make_move_iterator(items.begin() + base),
+                std::make_move_iterator(items.end()));
+            items.resize(base);
+            return l;
+        }
+
+        Val string()
+        {
+            std::string s = text();
+            LOXC_COUNT(strings, 1);
+            LOXC_COUNT(string_bytes, s.size());
+            return s;
+        }
+
+        // The string starting at p, unescaped.
+        std::string text()
+        {
+            ++p;
+            std::string s;
+            for (;;)
+            {
+                size_t run = plain_run(p, end);
+                s.append(p, run);
+                p += run;
+                if (p == end)
+                    fail("Unterminated string.");
+                if (*p == '"')
+                {
+                    ++p;
+                    return s;
+                }
+                if (*p != '\\')
+                    fail("Control character in string.");
+                if (++p == end)
+                    fail("Unterminated string.");
+                switch (*p++)
+                {
+                    case '"': s += '"'; break;
+                    case '\\': s += '\\'; break;
+                    case '/': s += '/'; break;
+                    case 'b': s += '\b'; break;
+                    case 'f': s += '\f'; break;
+                    case 'n': s += '\n'; break;
+                    case 'r': s += '\r'; break;
+                    case 't': s += '\t'; break;
+                    case 'u': code_point(s); break;
+                    default: --p; fail("Invalid escape.");
+                }
+            }
+        }
+
+        uint32_t hex4()
+        {
+            if (end - p < 4)
+                fail("Invalid \\u escape.");
+            uint32_t u = 0;
+            for (int i = 0; i < 4; ++i, ++p)
+            {
+                char c = *p;
+                u <<= 4;
+                if (c >= '0' && c <= '9') u |= c - '0';
+                else if (c >= 'a' && c <= 'f') u |= c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F') u |= c - 'A' + 10;
+                else fail("Invalid \\u escape.");
+            }
+            return u;
+        }
+
+        // Appends the UTF-8 for the \u escape after p, and a second one
+        // if it completes a surrogate pair.
+        void code_point(std::string& s)
+        {
+            uint32_t u = hex4();
+            if (u >= 0xdc00 && u <= 0xdfff)
+                fail("Unpaired surrogate in \\u escape.");
+            if (u >= 0xd800 && u <= 0xdbff)
+            {
+                if (end - p < 2 || p[0] != '\\' || p[1] != 'u')
+                    fail("Unpaired surrogate in \\u escape.");
+                p += 2;
+                uint32_t low = hex4();
+                if (low < 0xdc00 || low > 0xdfff)
+                    fail("Unpaired surrogate in \\u escape.");
+                u = 0x10000 + ((u - 0xd800) << 10) + (low - 0xdc00);
+            }
+
+            if (u < 0x80)
+                s += static_cast<char>(u);
+            else if (u < 0x800)
+            {
+                s += static_cast<char>(0xc0 | u >> 6);
+                s += static_cast<char>(0x80 | (u & 0x3f));
+            }
+            else if (u < 0x10000)
+            {
+                s += static_cast<char>(0xe0 | u >> 12);
+                s += static_cast<char>(0x80 | (u >> 6 & 0x3f));
+                s += static_cast<char>(0x80 | (u & 0x3f));
+            }
+            else
+            {
+                s += static_cast<char>(0xf0 | u >> 18);
+                s += static_cast<char>(0x80 | (u >> 12 & 0x3f));
+                s += static_cast<char>(0x80 | (u >> 6 & 0x3f));
+                s += static_cast<char>(0x80 | (u & 0x3f));
+            }
+        }
+
+        bool digits()
+        {
+            const char* start = p;
+            while (p < end && *p >= '0' && *p <= '9')
+                ++p;
+            return p != start;
+        }
+
+        // Checks the JSON grammar, which is stricter than from_chars, and
+        // leaves the conversion to it.
+        Val number()
+        {
+            const char* start = p;
+            if (*p == '-')
+                ++p;
+            const char* whole = p;
+            if (p < end && *p == '0')
+                ++p;
+            else if ( ! digits() )
+                fail("Invalid number.");
+            const char* point = p;
+            if (p < end && *p == '.')
+            {
+                ++p;
+                if ( ! digits() )
+                    fail("Invalid number.");
+            }
+            const char* exponent = p;
+            if (p < end && (*p == 'e' || *p == 'E'))
+            {
+                ++p;
+                if (p < end && (*p == '+' || *p == '-'))
+                    ++p;
+                if ( ! digits() )
+                    fail("Invalid number.");
+            }
+            double d;
+            if ( ! loxc::parse_number(start, p, d) )
+                d = saturate(*start == '-', whole, point, exponent);
+            return d;
+        }
+
+        /**
+         * The value of a number too large or too small for a double, which
+         * JSON allows: infinity or zero of its sign, as strtod gives. Whole
+         * is its integer digits up to point, where any fraction starts,
+         * and exponent where any exponent starts; p is its end.
+         */
+        double saturate(bool negative, const char* whole, const char* point,
+            const char* exponent)
+        {
+            // The power of ten of the leading digit, give or take one,
+            // which is plenty to tell 1e400 from 1e-400.
+            long scale = point - whole;
+            if (*whole == '0')
+            {
+                scale = 0;
+                for (const char* c = point + 1; c < exponent && *c == '0'; ++c)
+                    --scale;
+            }
+            if (exponent < p)
+            {
+                const char* c = exponent + 1;
+                bool down = *c == '-';
+                if (*c == '+' || *c == '-')
+                    ++c;
+                long e = 0;
+                for (; c < p && e < 100000; ++c)
+                    e = e * 10 + (*c - '0');
+                scale += down ? -e : e;
+            }
+            double magnitude = scale > 0 ? HUGE_VAL : 0.0;
+            return negative ? -magnitude : magnitude;
+        }
+
+        const char* begin;
+        const char* p;
+        const char* end;
+
+        /**
+         * The elements of the lists and maps being parsed, innermost last.
+         * Each is moved out into a vector of the right size once it's
+         * complete, so a container is allocated once rather than grown.
+         */
+        std::vector<Val> items;
+        std::vector<std::pair<std::string, Val>> fields;
+    };
+
+    struct string_sink
+    {
+        std::string& s;
+        void put(char c) { s += c; }
+        void put(std::string_view v) { s.append(v); }
+    };
+
+    struct output_sink
+    {
+        loxc::output& o;
+        void put(char c) { o << c; }
+        void put(std::string_view v) { o << v; }
+    };
+
+    struct unwritable
+    {
+        std::string what;
+    };
+
+    /**
+     * Writes values as JSON to a sink, as it walks them. Lists and maps
+     * being written are kept track of to catch cycles.
+     */
+    template <typename sink>
+    class writer
+    {
+    public:
+        explicit writer(sink out) : out(out) {}
+
+        void value(const Val& v)
+        {
+            switch (v.index())
+            {
+                case 0:
+                    out.put("null"); break;
+                case 1:
+                    number(std::get<double>(v)); break;
+                case 2:
+                    string(std::get<std::string>(v)); break;
+                case 3:
+                    out.put(std::get<bool>(v) ? std::string_view("true") : std::string_view("false"));
+                    break;
+                case 7:
+                    list(*std::get<std::shared_ptr<loxc::list>>(v)); break;
+                case 8:
+                    map(*std::get<std::shared_ptr<loxc::map>>(v)); break;
+                default:
+                    throw unwritable{"Only nil, numbers, strings, booleans, lists and maps "
+                        "can be written as JSON."};
+            }
+        }
+
+    private:
+        void number(double d)
+        {
+            if ( ! std::isfinite(d) )
+            {
+                out.put("null");
+                return;
+            }
+            char tmp[loxc::number_buffer_size];
+            out.put(std::string_view(tmp, loxc::format_number(d, tmp)));
+        }
+
+        void string(std::string_view s)
+        {
+            static const char hex[] = "0123456789abcdef";
+            out.put('"');
+            for (;;)
+            {
+                size_t run = plain_run(s.data(), s.data() + s.size());
+                out.put(s.substr(0, run));
+                if (run == s.size())
+                    break;
+                unsigned char c = s[run];
+                s.remove_prefix(run + 1);
+                switch (c)
+                {
+                    case '"': out.put("\\\""); break;
+                    case '\\': out.put("\\\\"); break;
+                    case '\b': out.put("\\b"); break;
+                    case '\f': out.put("\\f"); break;
+                    case '\n': out.put("\\n"); break;
+                    case '\r': out.put("\\r"); break;
+                    case '\t': out.put("\\t"); break;
+                    default:
+                        out.put("\\u00");
+                        out.put(hex[c >> 4]);
+                        out.put(hex[c & 0xf]);
+                }
+            }
+            out.put('"');
+        }
+
+        void list(const loxc::list& l)
+        {
+            enter(&l);
+            out.put('[');
+            for (size_t i = 0; i < l.items.size(); ++i)
+            {
+                if (i)
+                    out.put(',');
+                value(l.items[i]);
+            }
+            out.put(']');
+            leave(&l);
+        }
+
+        void map(const loxc::map& m)
+        {
+            enter(&m);
+            out.put('{');
+            for (size_t i = 0; i < m.entries.size(); ++i)
+            {
+                if (i)
+                    out.put(',');
+                string(m.entries[i].first);
+                out.put(':');
+                value(m.entries[i].second);
+            }
+            out.put('}');
+            leave(&m);
+        }
+
+        void enter(const void* container)
+        {
+            if (active.size() == max_depth)
+                throw unwritable{"Nested too deeply to write as JSON."};
+            if ( ! active.insert(container).second )
+                throw unwritable{"Can't write a cycle as JSON."};
+        }
+
+        void leave(const void* container)
+        {
+            active.erase(container);
+        }
+
+        sink out;
+        std::unordered_set<const void*> active;
+    };
+}
+
+Val json::parse(std::string_view text, std::string& error)
+{
+    parser p(text);
+    try
+    {
+        return p.document();
+    } catch (const syntax_error& e)
+    {
+        error = "Invalid JSON at byte " + std::to_string(p.offset(e.at)) + ": " + e.what;
+        return std::monostate{};
+    }
+}
+
+bool json::stringify(const Val& v, std::string& out, std::string& error)
+{
+    size_t start = out.size();
+    try
+    {
+        writer<string_sink>(string_sink{out}).value(v);
+        return true;
+    } catch (const unwritable& e)
+    {
+        out.resize(start);
+        error = e.what;
+        return false;
+    }
+}
+
+bool json::stringify(const Val& v, loxc::output& out, std::string& error)
+{
+    // What's in the output buffer may already be on its way out, so the
+    // value is walked once to check it all can be written first.
+    try
+    {
+        struct null_sink
+        {
+            void put(char) {}
+            void put(std::string_view) {}
+        };
+        writer<null_sink>(null_sink{}).value(v);
+    } catch (const unwritable& e)
+    {
+        error = e.what;
+        return false;
+    }
+    writer<output_sink>(output_sink{out}).value(v);
+    return true;
+}
+
+Val json::parse_builtin(op::interpreter& interp, std::vector<Val> args)
+{
+    if (args.size() != 1 || ! std::holds_alternative<std::string>(args[0]))
+        throw op::builtin_error(interp, "json_parse", "json_parse expects a string.");
+    std::string problem;
+    Val v = parse(std::get<std::string>(args[0]), problem);
+    if ( ! problem.empty() )
+        throw op::builtin_error(interp, "json_parse", problem);
+    return v;
+}
+
+Val json::stringify_builtin(op::interpreter& interp, std::vector<Val> args)
+{
+    if (args.size() != 1)
+        throw op::builtin_error(interp, "json_stringify", "json_stringify expects a value.");
+    std::string text, problem;
+    if ( ! stringify(args[0], text, problem) )
+        throw op::builtin_error(interp, "json_stringify", problem);
+    LOXC_COUNT(strings, 1);
+    LOXC_COUNT(string_bytes, text.size());
+    return text;
+}
+
+Val json::print_builtin(op::interpreter& interp, std::vector<Val> args)
+{
+    if (args.size() != 1)
+        throw op::builtin_error(interp, "json_print", "json_print expects a value.");
+    std::string problem;
+    {
+        loxc::output::record line(loxc::out());
+        if (stringify(args[0], loxc::out(), problem))
+        {
+            loxc::out() << '\n';
+            loxc::out().sync();
+            return std::monostate{};
+        }
+    }
+    throw op::builtin_error(interp, "json_print", problem);
+}
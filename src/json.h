@@ -0,0 +1,58 @@
+// converting lox values to and from JSON.
+#ifndef json_h
+#define json_h
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "val.h"
+
+namespace loxc
+{
+    class output;
+}
+
+namespace op
+{
+    struct interpreter;
+}
+
+/**
+ * json_parse(text) builds lox values from JSON: objects become maps,
+ * arrays lists, and the rest strings, numbers, booleans and nil.
+ * json_stringify(value) goes the other way, compactly. json_print(value)
+ * writes the same text straight into the output buffer, as a line of its
+ * own, without building a string first. Functions, instances and
+ * Float64Arrays have no JSON form, and nor do cycles; numbers that aren't
+ * finite are written as null.
+ */
+namespace json
+{
+
+/**
+ * Parses text in one pass.
+ *
+ * @param error set to what is wrong, and where, if text isn't JSON.
+ * @return the value, or nil with error set.
+ */
+Val parse(std::string_view text, std::string& error);
+
+/**
+ * Appends the JSON for v to out, or to the output buffer, adding nothing
+ * if any of v can't be written.
+ *
+ * @param error set to why, if v can't be written as JSON.
+ * @return false with error set if v can't be written.
+ */
+bool stringify(const Val& v, std::string& out, std::string& error);
+bool stringify(const Val& v, loxc::output& out, std::string& error);
+
+// The builtins. args as lox passed them.
+Val parse_builtin(op::interpreter& interp, std::vector<Val> args);
+Val stringify_builtin(op::interpreter& interp, std::vector<Val> args);
+Val print_builtin(op::interpreter& interp, std::vector<Val> args);
+
+} // namespace json
+
+#endif
@@ -0,0 +1,115 @@
+#include <cmath>
+#include <memory>
+#include <string>
+
+#include "lists.h"
+#include "callable.h"
+#include "object.h"
+#include "op.h"
+
+namespace
+{
+    using list = std::shared_ptr<loxc::list>;
+
+    loxc::list& expect(const op::interpreter& interp, const char* builtin,
+        const std::vector<Val>& args, size_t count, const char* usage)
+    {
+        if (args.size() != count || ! std::holds_alternative<list>(args[0]))
+            throw op::builtin_error(interp, builtin, usage);
+        return *std::get<list>(args[0]);
+    }
+
+    // args' map, checking a string key follows it.
+    loxc::map& expect_map(const op::interpreter& interp, const char* builtin,
+        const std::vector<Val>& args, size_t count, const char* usage)
+    {
+        if (args.size() != count || ! std::holds_alternative<std::shared_ptr<loxc::map>>(args[0])
+            || (count > 1 && ! std::holds_alternative<std::string>(args[1])))
+            throw op::builtin_error(interp, builtin, usage);
+        return *std::get<std::shared_ptr<loxc::map>>(args[0]);
+    }
+
+    size_t index(const op::interpreter& interp, const char* builtin,
+        const loxc::list& l, const Val& i)
+    {
+        const double* d = std::get_if<double>(&i);
+        if ( ! d || ! (*d >= 0 && *d < l.items.size()) || std::floor(*d) != *d )
+            throw op::builtin_error(interp, builtin, "Index out of range.");
+        return static_cast<size_t>(*d);
+    }
+}
+
+Val lists::make(op::interpreter&, std::vector<Val> args)
+{
+    auto l = std::make_shared<loxc::list>();
+    l->items = std::move(args);
+    return l;
+}
+
+Val lists::get(op::interpreter& interp, std::vector<Val> args)
+{
+    loxc::list& l = expect(interp, "list_get", args, 2, "list_get expects a list and an index.");
+    return l.items[index(interp, "list_get", l, args[1])];
+}
+
+Val lists::set(op::interpreter& interp, std::vector<Val> args)
+{
+    loxc::list& l = expect(interp, "list_set", args, 3,
+        "list_set expects a list, an index and a value.");
+    return l.items[index(interp, "list_set", l, args[1])] = std::move(args[2]);
+}
+
+Val lists::push(op::interpreter& interp, std::vector<Val> args)
+{
+    loxc::list& l = expect(interp, "list_push", args, 2, "list_push expects a list and a value.");
+    l.items.push_back(args[1]);
+    return std::move(args[1]);
+}
+
+Val lists::pop(op::interpreter& interp, std::vector<Val> args)
+{
+    loxc::list& l = expect(interp, "list_pop", args, 1, "list_pop expects a list.");
+    if (l.items.empty())
+        throw op::builtin_error(interp, "list_pop", "Can't pop from an empty list.");
+    Val last = std::move(l.items.back());
+    l.items.pop_back();
+    return last;
+}
+
+Val maps::make(op::interpreter& interp, std::vector<Val> args)
+{
+    if ( ! args.empty() )
+        throw op::builtin_error(interp, "Map", "Map expects no arguments.");
+    return std::make_shared<loxc::map>();
+}
+
+Val maps::get(op::interpreter& interp, std::vector<Val> args)
+{
+    loxc::map& m = expect_map(interp, "map_get", args, 2, "map_get expects a map and a key.");
+    const Val* found = m.find(std::get<std::string>(args[1]));
+    return found ? *found : Val();
+}
+
+Val maps::set(op::interpreter& interp, std::vector<Val> args)
+{
+    loxc::map& m = expect_map(interp, "map_set", args, 3,
+        "map_set expects a map, a key and a value.");
+    m.set(std::get<std::string>(std::move(args[1])), args[2]);
+    return std::move(args[2]);
+}
+
+Val maps::has(op::interpreter& interp, std::vector<Val> args)
+{
+    loxc::map& m = expect_map(interp, "map_has", args, 2, "map_has expects a map and a key.");
+    return m.find(std::get<std::string>(args[1])) != nullptr;
+}
+
+Val maps::keys(op::interpreter& interp, std::vector<Val> args)
+{
+    loxc::map& m = expect_map(interp, "map_keys", args, 1, "map_keys expects a map.");
+    auto keys = std::make_shared<loxc::list>();
+    keys->items.reserve(m.entries.size());
+    for (const auto& entry : m.entries)
+        keys->items.push_back(entry.first);
+    return keys;
+}
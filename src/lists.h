@@ -0,0 +1,50 @@
+// lox lists and maps, as builtins over loxc::list and loxc::map.
+#ifndef lists_h
+#define lists_h
+
+#include <vector>
+
+#include "val.h"
+
+namespace op
+{
+    struct interpreter;
+}
+
+/**
+ * List(a, b, ...) makes a list of its arguments, in order. list_get(l, i)
+ * and list_set(l, i, x) read and write an element, list_push(l, x) adds
+ * one at the end and list_pop(l) takes it off again; len(l) counts them.
+ * Lists are shared, not copied, when assigned or passed.
+ */
+namespace lists
+{
+
+// The builtins. args as lox passed them.
+Val make(op::interpreter& interp, std::vector<Val> args);
+Val get(op::interpreter& interp, std::vector<Val> args);
+Val set(op::interpreter& interp, std::vector<Val> args);
+Val push(op::interpreter& interp, std::vector<Val> args);
+Val pop(op::interpreter& interp, std::vector<Val> args);
+
+} // namespace lists
+
+/**
+ * Map() makes an empty map from strings to values. map_get(m, key) is the
+ * value set for key, or nil; map_set(m, key, x) sets it, map_has(m, key)
+ * tells whether it's set, and map_keys(m) lists the keys in the order
+ * they were first set. len(m) counts them.
+ */
+namespace maps
+{
+
+// The builtins. args as lox passed them.
+Val make(op::interpreter& interp, std::vector<Val> args);
+Val get(op::interpreter& interp, std::vector<Val> args);
+Val set(op::interpreter& interp, std::vector<Val> args);
+Val has(op::interpreter& interp, std::vector<Val> args);
+Val keys(op::interpreter& interp, std::vector<Val> args);
+
+} // namespace maps
+
+#endif
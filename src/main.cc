@@ -6,97 +6,351 @@
 #include <sstream>
 #include <variant>
 #include <algorithm>
+#include <vector>
 
 #include <memory>
+#include <optional>
+#include <cstdio>
+#include <cstring>
+
+#include <pthread.h>
 
 #include "op.h"
 #include "scan.h"
 #include "expr.h"
 #include "token.h"
 #include "parse.h"
+#include "resolve.h"
 #include "reporter.h"
-#include "enviroment.h"
+#include "globals.h"
+#include "stats.h"
+#include "output.h"
+#include "session.h"
+#include "image.h"
+#include "parallel.h"
+#include "modules.h"
 
 #include "builtins/time.h"
+#include "builtins/flush.h"
+#include "builtins/spawn.h"
+#include "builtins/async.h"
+#include "builtins/done.h"
+#include "builtins/clock.h"
+#include "builtins/bench.h"
+#include "builtins/float64.h"
+#include "builtins/len.h"
+#include "builtins/list.h"
+#include "builtins/strings.h"
+#include "builtins/lines.h"
+#include "builtins/map.h"
+#include "builtins/serialize.h"
+
+static Globals globals;
+
+// Native stack reserved for each lox call the interpreter allows. A lox
+// call recurses through a handful of visitor frames; this leaves plenty of
+// headroom so that the call stack limit, not the native stack, is usually
+// what a runaway recursion hits. Every call also checks how much native
+// stack is really left (see op::call_stack), so a call nesting deeper
+// than this estimate raises "Stack overflow." instead of crashing.
+static const size_t native_bytes_per_frame = 8 * 1024;
+// Room for the top level code, and for the native stack calls keep in
+// reserve.
+static const size_t native_stack_base = 8 * 1024 * 1024;
+// Threads get at most this much; a deeper --max-stack runs out of native
+// stack first.
+static const size_t native_stack_max = size_t(1) << 30;
 
-static std::shared_ptr<Enviroment> global_env(new Enviroment());
+static size_t native_stack_bytes(size_t depth)
+{
+  if (depth >= (native_stack_max - native_stack_base) / native_bytes_per_frame)
+    return native_stack_max;
+  return native_stack_base + depth * native_bytes_per_frame;
+}
 
-enum return_status
+struct options
 {
-  GOOD,
-  ERROR,
-  EXIT
+  // run one after another, in the one session.
+  std::vector<const char *> scripts;
+  size_t max_stack = op::call_stack::default_max_depth;
+  enum
+  {
+    NO_STATS,
+    STATS_TEXT,
+    STATS_JSON
+  } stats = NO_STATS;
+  bool unbuffered = false;
+  bool lazy_parse = false;
+  // an image to start from, and where to save one after the run.
+  const char *image = nullptr;
+  const char *dump_image = nullptr;
+  vm::mode exec = vm::THREADED;
+  bool numeric = true;
+  bool inlining = true;
+  // workers for spawn; 0 for one per core.
+  size_t threads = 0;
 };
 
-int run_file(const char *c);
-int run_prompt();
-int run(std::string s);
+int run_file(Session &session, const char *c);
+int run_prompt(Session &session);
+int run_on_stack(size_t bytes, const options &opts);
+
+static void usage()
+{
+  std::cout << "usage: loxc [--max-stack depth] [--stats[=json]] [--unbuffered] [--lazy-parse]\n"
+               "            [--image file] [--dump-image file] [--exec=tree|switch|threaded]\n"
+               "            [--no-numeric-tier] [--no-inline] [--threads n] [script...]\n";
+}
 
 int main(int argc, char **argv)
 {
-  global_env->define("lox_time", builtins::time);
+  globals.define("lox_time", builtins::time);
+  globals.define("flush", builtins::flush);
+  globals.define("spawn", builtins::spawn);
+  globals.define("join", builtins::join);
+  globals.define("setTimeout", builtins::set_timeout);
+  globals.define("clearTimeout", builtins::clear_timeout);
+  globals.define("readFile", builtins::read_file);
+  globals.define("writeFile", builtins::write_file);
+  globals.define("done", builtins::done);
+  globals.define("clock_ns", builtins::clock_ns);
+  globals.define("bench", builtins::bench);
+  globals.define("Float64Array", builtins::float64_array);
+  globals.define("array_get", builtins::array_get);
+  globals.define("array_set", builtins::array_set);
+  globals.define("array_add", builtins::array_add);
+  globals.define("array_mul", builtins::array_mul);
+  globals.define("array_scale", builtins::array_scale);
+  globals.define("array_sum", builtins::array_sum);
+  globals.define("array_dot", builtins::array_dot);
+  globals.define("array_min", builtins::array_min);
+  globals.define("array_max", builtins::array_max);
+  globals.define("array_prefix_sum", builtins::array_prefix_sum);
+  globals.define("len", builtins::len);
+  globals.define("List", builtins::list);
+  globals.define("list_get", builtins::list_get);
+  globals.define("list_set", builtins::list_set);
+  globals.define("list_push", builtins::list_push);
+  globals.define("list_pop", builtins::list_pop);
+  globals.define("Map", builtins::map);
+  globals.define("map_get", builtins::map_get);
+  globals.define("map_set", builtins::map_set);
+  globals.define("map_has", builtins::map_has);
+  globals.define("map_keys", builtins::map_keys);
+  globals.define("substr", builtins::substr);
+  globals.define("find", builtins::find);
+  globals.define("split", builtins::split);
+  globals.define("replace", builtins::replace);
+  globals.define("lines", builtins::lines);
+  globals.define("json_parse", builtins::json_parse);
+  globals.define("json_stringify", builtins::json_stringify);
+  globals.define("json_print", builtins::json_print);
 
-  if (argc > 2)
+  options opts;
+  for (int i = 1; i < argc; ++i)
   {
-    std::cout << "usage: jlox [script]\n";
-    return -1;
+    if (std::strcmp(argv[i], "--max-stack") == 0 && i + 1 < argc)
+    {
+      long depth = std::strtol(argv[++i], nullptr, 10);
+      if (depth <= 0)
+      {
+        usage();
+        return -1;
+      }
+      opts.max_stack = static_cast<size_t>(depth);
+    }
+    else if (std::strcmp(argv[i], "--stats") == 0)
+      opts.stats = options::STATS_TEXT;
+    else if (std::strcmp(argv[i], "--stats=json") == 0)
+      opts.stats = options::STATS_JSON;
+    else if (std::strcmp(argv[i], "--unbuffered") == 0)
+      opts.unbuffered = true;
+    else if (std::strcmp(argv[i], "--lazy-parse") == 0)
+      opts.lazy_parse = true;
+    else if (std::strcmp(argv[i], "--image") == 0 && i + 1 < argc)
+      opts.image = argv[++i];
+    else if (std::strcmp(argv[i], "--dump-image") == 0 && i + 1 < argc)
+      opts.dump_image = argv[++i];
+    else if (std::strcmp(argv[i], "--exec=tree") == 0)
+      opts.exec = vm::TREE;
+    else if (std::strcmp(argv[i], "--exec=switch") == 0)
+      opts.exec = vm::SWITCH;
+    else if (std::strcmp(argv[i], "--exec=threaded") == 0)
+      opts.exec = vm::THREADED;
+    else if (std::strcmp(argv[i], "--no-numeric-tier") == 0)
+      opts.numeric = false;
+    else if (std::strcmp(argv[i], "--no-inline") == 0)
+      opts.inlining = false;
+    else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+    {
+      long n = std::strtol(argv[++i], nullptr, 10);
+      if (n <= 0)
+      {
+        usage();
+        return -1;
+      }
+      opts.threads = static_cast<size_t>(n);
+    }
+    else if (argv[i][0] != '-')
+      opts.scripts.push_back(argv[i]);
+    else
+    {
+      usage();
+      return -1;
+    }
   }
-  else if (argc == 2)
-    return run_file(argv[1]);
-  else
-    return run_prompt();
-}
 
-int run_file(const char *c)
-{
-  std::ifstream t(c);
-  std::stringstream buffer;
-  buffer << t.rdbuf();
+  loxc::out().set_buffered(!opts.unbuffered);
 
-  return run(buffer.str());
-}
+  size_t stack_bytes = native_stack_bytes(opts.max_stack);
+  parallel::configure(opts.threads, stack_bytes);
+  modules::configure(globals, opts.lazy_parse);
+  loxc::configure_images(globals);
 
-int run_prompt()
-{
-  int status = 0;
+  int status = run_on_stack(stack_bytes, opts);
+  // Spawned calls nobody joined still finish before anything is flushed.
+  parallel::shutdown();
+  loxc::out().flush();
 
-  while (status != EXIT)
+  if (opts.stats != options::NO_STATS)
   {
-    std::cout << ">> ";
-    std::string in;
-    std::getline(std::cin, in);
-    status = run(in);
+    loxc::stats::report(std::cerr, opts.stats == options::STATS_JSON);
+    if (opts.stats == options::STATS_TEXT)
+      vm::report_profile(std::cerr);
   }
 
   return status;
 }
 
-int run(std::string in)
+/**
+ * Runs the interpreter on a thread whose native stack is sized for the
+ * requested call depth, so that deep lox recursion usually ends at the
+ * call depth limit rather than the native stack.
+ */
+int run_on_stack(size_t bytes, const options &opts)
 {
-  Scanner scanner;
-  auto tokens = scanner.run(in);
+  struct job
+  {
+    const options &opts;
+    size_t bytes;
+    int status;
+  } j{opts, bytes, ERROR};
 
-  if (!tokens.has_value())
-    return ERROR;
+  auto entry = [](void *arg) -> void * {
+    job &j = *static_cast<job *>(arg);
+    op::interpreter interp(globals, j.opts.max_stack);
+    interp.exec = j.opts.exec;
+    interp.numeric = j.opts.numeric;
+    interp.inlining = j.opts.inlining;
+    Session session(interp, j.opts.lazy_parse);
 
-  Parser parser;
-  auto expr = parser.parse(tokens.value());
+    if (j.opts.image && !loxc::load_image(globals, session, j.opts.image))
+    {
+      loxc::stats::merge();
+      return nullptr;
+    }
 
-  if (!expr.has_value())
-    return ERROR;
+    if (j.opts.scripts.size() > 1)
+      j.status = session.run_files(j.opts.scripts, j.opts.threads, j.bytes);
+    else if (j.opts.scripts.size() == 1)
+      j.status = run_file(session, j.opts.scripts[0]);
+    else
+      j.status = run_prompt(session);
+
+    if (j.status == GOOD && j.opts.dump_image && !loxc::dump_image(globals, j.opts.dump_image))
+      j.status = ERROR;
+    loxc::stats::merge();
+    return nullptr;
+  };
 
-  try
+  // Calls check the native stack they have left, so a smaller stack than
+  // asked for only means deep recursion overflows sooner.
+  pthread_t thread;
+  int failed;
+  while (true)
   {
-    std::for_each(expr.value().begin(), expr.value().end(), [](Stmt& s) {
-      // The parent of the top level interpreter is the global variables.
-      Val val = std::visit(op::interpreter(global_env), std::move(s));
-      });
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, bytes);
+    j.bytes = bytes;
+    failed = pthread_create(&thread, &attr, entry, &j);
+    pthread_attr_destroy(&attr);
+    if (!failed || bytes / 2 < native_stack_base)
+      break;
+    bytes /= 2;
   }
-  catch(const op::runtime_error& e)
+  if (failed)
   {
-    Reporter::runtime_error(e);
+    Reporter::error("Couldn't start a thread with " + std::to_string(bytes >> 20) +
+                    " MB of native stack.");
     return ERROR;
   }
+  pthread_join(thread, nullptr);
+  return j.status;
+}
+
+int run_file(Session &session, const char *c)
+{
+  modules::set_script(c);
+  std::optional<std::string> source = Session::read_script(c);
+  if (!source.has_value())
+    return ERROR;
+  return session.run(std::move(source.value()));
+}
+
+/**
+ * Reads input a line at a time, running each once it is complete. An
+ * input that leaves a string, comment or bracket open continues on the
+ * next line; an empty line runs it as it stands. ":time" toggles printing
+ * how long each input took to execute.
+ */
+int run_prompt(Session &session)
+{
+  bool show_time = false;
+  std::string in;
+
+  while (true)
+  {
+    {
+      // Spawned calls may still be printing.
+      loxc::output::record prompt(loxc::out());
+      loxc::out() << (in.empty() ? ">> " : ".. ");
+      loxc::out().flush();
+    }
+
+    std::string line;
+    if (!std::getline(std::cin, line))
+      break;
+
+    if (in.empty() && line == ":time")
+    {
+      show_time = !show_time;
+      loxc::output::record line(loxc::out());
+      loxc::out() << "[time] " << (show_time ? "on" : "off") << '\n';
+      continue;
+    }
+
+    in += line;
+    in += '\n';
+    if (!line.empty() && Session::incomplete(in))
+      continue;
 
+    int status = session.run(std::move(in));
+    in.clear();
+    if (status == EXIT)
+      return GOOD;
+
+    if (show_time && status == GOOD)
+    {
+      char ms[32];
+      std::snprintf(ms, sizeof(ms), "%.3f", session.last_execute_seconds() * 1000);
+      loxc::output::record line(loxc::out());
+      loxc::out() << "[time] " << ms << " ms\n";
+    }
+  }
+
+  // Leave the shell's prompt on a line of its own.
+  loxc::output::record line(loxc::out());
+  loxc::out() << '\n';
   return GOOD;
-}
\ No newline at end of file
+}
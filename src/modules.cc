@@ -0,0 +1,204 @@
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "modules.h"
+#include "callable.h"
+#include "globals.h"
+#include "op.h"
+#include "reporter.h"
+#include "session.h"
+
+namespace
+{
+    struct module
+    {
+        // when the file was last modified, as it was loaded.
+        struct timespec modified;
+        // the functions and classes it defined, in the order it did.
+        std::vector<std::pair<std::string, Val>> exports;
+        // whether it is still running, in which case importing it again
+        // is a cycle.
+        bool loading;
+    };
+
+    std::vector<std::pair<std::string, Val>> prelude;
+    bool lazy = false;
+    // the directory imports from the running script are relative to.
+    std::string root = ".";
+    std::unordered_map<std::string, module> loaded;
+    // Every module's globals, which its functions run against for as
+    // long as they are around, so they are kept for the life of the
+    // process; those of a module since reloaded too. Keyed on the table,
+    // the canonical path of the module it belongs to.
+    std::vector<std::unique_ptr<Globals>> environments;
+    std::unordered_map<const Globals*, std::string> owners;
+    // the canonical paths of the modules running, innermost last, and
+    // the paths they were imported by.
+    std::vector<std::string> running;
+    std::vector<std::string> imported_as;
+    // Set by the import that closes a cycle, for the outermost import to
+    // report.
+    std::optional<std::string> cycle;
+
+    std::string directory(const std::string& path)
+    {
+        size_t slash = path.rfind('/');
+        if (slash == std::string::npos)
+            return ".";
+        return slash == 0 ? "/" : path.substr(0, slash);
+    }
+
+    bool same_time(const struct timespec& a, const struct timespec& b)
+    {
+        return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+    }
+
+    op::runtime_error cant_import(const loxc::lexeme& where, const std::string& path,
+        const std::string& why)
+    {
+        return op::runtime_error(where, "Couldn't import '" + path + "': " + why);
+    }
+
+    // Runs source, the module at canonical, into m.
+    bool load(op::interpreter& importer, const std::string& canonical, const std::string& source,
+        module& m)
+    {
+        Globals& env = *environments.emplace_back(std::make_unique<Globals>());
+        owners[&env] = canonical;
+        for (const auto& [name, value] : prelude)
+            env.define(name, value);
+
+        op::interpreter interp(env, importer.stack.limit());
+        // Everything it defines is the module's, whoever calls it.
+        interp.home = nullptr;
+        interp.exec = importer.exec;
+        interp.superinstructions = importer.superinstructions;
+        interp.numeric = importer.numeric;
+        interp.inlining = importer.inlining;
+        // Timers and I/O it starts call back from the importer's loop.
+        Session session(interp, lazy);
+        // Its errors are held back until it is done, and dropped if it
+        // failed on an import cycle, which is reported once, by the
+        // outermost import.
+        bool ok;
+        std::string errors;
+        {
+            Reporter::capture held;
+            ok = session.run(source, false) == GOOD;
+            errors = std::move(held.text);
+        }
+        if ( ! cycle )
+            Reporter::replay(errors);
+        if ( ! ok )
+            return false;
+
+        // Its variables, and what it imported itself, stay its own.
+        env.for_each([&](const std::string& name, const Val& value) {
+            if (auto f = std::get_if<std::shared_ptr<loxc::callable>>(&value);
+                f && (*f)->env() == &env)
+                m.exports.emplace_back(name, value);
+        });
+        return true;
+    }
+
+    // Whether value was defined by some version of the module at canonical.
+    bool defined_by(const Val& value, const std::string& canonical)
+    {
+        auto f = std::get_if<std::shared_ptr<loxc::callable>>(&value);
+        if ( ! f || ! (*f)->env() )
+            return false;
+        auto owner = owners.find((*f)->env());
+        return owner != owners.end() && owner->second == canonical;
+    }
+}
+
+void modules::configure(const Globals& globals, bool lazy_parse)
+{
+    prelude.clear();
+    globals.for_each([](const std::string& name, const Val& value) {
+        prelude.emplace_back(name, value);
+    });
+    lazy = lazy_parse;
+}
+
+void modules::set_script(const char* path)
+{
+    root = path ? directory(path) : ".";
+}
+
+void modules::import(op::interpreter& interp, const std::string& path, const loxc::lexeme& where)
+{
+    std::string full = path;
+    if (full.empty() || full[0] != '/')
+        full = (running.empty() ? root : directory(running.back())) + "/" + path;
+
+    char resolved[PATH_MAX];
+    struct stat st;
+    if ( ! ::realpath(full.c_str(), resolved) || ::stat(resolved, &st) != 0 )
+        throw cant_import(where, path, std::system_category().message(errno) + ".");
+    std::string canonical = resolved;
+
+    auto found = loaded.find(canonical);
+    if (found != loaded.end() && found->second.loading)
+    {
+        // Only the innermost module running can be doing the import.
+        cycle = "line " + std::to_string(where.line) + " of '" + imported_as.back()
+            + "' imports '" + path + "' again, closing an import cycle.";
+        throw cant_import(where, path, *cycle);
+    }
+    if (found == loaded.end() || ! same_time(found->second.modified, st.st_mtim))
+    {
+        if ( ! S_ISREG(st.st_mode) )
+            throw cant_import(where, path, "it is not a file.");
+        std::ifstream file(canonical);
+        std::stringstream source;
+        if (file)
+            source << file.rdbuf();
+        if ( ! file || file.bad() )
+            throw cant_import(where, path, std::system_category().message(errno) + ".");
+
+        module& m = loaded[canonical];
+        m = module{st.st_mtim, {}, true};
+        running.push_back(canonical);
+        imported_as.push_back(path);
+        bool ok = load(interp, canonical, source.str(), m);
+        running.pop_back();
+        imported_as.pop_back();
+        if ( ! ok )
+        {
+            loaded.erase(canonical);
+            if (cycle && running.empty())
+            {
+                std::string why = std::move(*cycle);
+                cycle.reset();
+                throw cant_import(where, path, why);
+            }
+            throw cant_import(where, path, "it has errors.");
+        }
+        m.loading = false;
+        found = loaded.find(canonical);
+    }
+
+    // Check every name before binding any, so a clash binds nothing.
+    // Importing a module again may rebind what it bound before.
+    const std::vector<std::pair<std::string, Val>>& exports = found->second.exports;
+    for (const auto& [name, value] : exports)
+        if (const Val* existing = interp.globals->lookup(name);
+            existing && ! defined_by(*existing, canonical))
+            throw cant_import(where, path, "it defines '" + name + "', which is already defined.");
+    for (const auto& [name, value] : exports)
+        if (const Val* existing = interp.globals->lookup(name); ! existing || *existing != value)
+            interp.globals->define(name, value);
+}
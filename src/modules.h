@@ -0,0 +1,69 @@
+// importing lox files as modules.
+#ifndef modules_h
+#define modules_h
+
+#include <string>
+
+#include "token.h"
+
+class Globals;
+
+namespace op
+{
+    struct interpreter;
+}
+
+/**
+ * `import "path";` runs the file at path as a module, then defines the
+ * functions and classes the module defined in the importing code's
+ * globals. A relative path is taken from the directory of the file doing
+ * the importing, or the script's for the script itself.
+ *
+ * A module runs in its own interpreter over globals of its own, which
+ * start out holding only the builtins, so it neither sees nor disturbs
+ * its importer's names. Its variables, and what it imported itself, stay
+ * there: its functions keep that table as their env (see loxc::callable)
+ * and look their globals up in it wherever they are called from. Only
+ * functions and classes are exported, never variables, whose values a
+ * binding would copy and so no longer share with the module. A name
+ * the importer has already defined is an error, unless an earlier import
+ * of the same module bound it.
+ *
+ * Each module runs once per process: what it defined is kept, keyed on
+ * the file's canonical path, and a later import of the same file just
+ * binds it again, without reading, scanning, parsing or running anything.
+ * If the file has been modified since, it is loaded afresh.
+ */
+namespace modules
+{
+
+/**
+ * Settles how modules are loaded. Call once the builtins are defined.
+ *
+ * @param prelude the globals every module starts with.
+ * @param lazy whether to defer parsing function bodies, as --lazy-parse.
+ */
+void configure(const Globals& prelude, bool lazy);
+
+/**
+ * Names the script about to run, whose imports are relative to its
+ * directory; nullptr for the REPL, whose are relative to the working
+ * directory.
+ */
+void set_script(const char* path);
+
+/**
+ * Runs the module at path if it isn't loaded already, and defines its
+ * functions and classes in interp's globals. Errors in the module are
+ * reported once it stops, except a failure on an import cycle: that is
+ * reported just once, by the outermost import, naming the import that
+ * closes the cycle.
+ *
+ * @throws op::runtime_error at where if the module can't be read or run
+ * or defines a name interp's globals already hold.
+ */
+void import(op::interpreter& interp, const std::string& path, const loxc::lexeme& where);
+
+} // namespace modules
+
+#endif
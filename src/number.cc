@@ -0,0 +1,25 @@
+#include <charconv>
+#include <system_error>
+
+#include "number.h"
+
+size_t loxc::format_number(double d, char* out)
+{
+    // std::to_chars without a precision gives the shortest round trip
+    // representation (libstdc++ implements it with Ryu). Left to choose,
+    // it writes 100000 as 1e+05, which is shorter but not what a loop
+    // counter should print, so integers a double holds exactly (those
+    // within 2^53) are always written out in full.
+    constexpr double exact_limit = 9007199254740992.0; // 2^53
+    std::chars_format format = std::chars_format::general;
+    if (d >= -exact_limit && d <= exact_limit && d == static_cast<long long>(d))
+        format = std::chars_format::fixed;
+    auto result = std::to_chars(out, out + number_buffer_size, d, format);
+    return result.ptr - out;
+}
+
+bool loxc::parse_number(const char* first, const char* last, double& out)
+{
+    auto result = std::from_chars(first, last, out);
+    return result.ec == std::errc() && result.ptr == last;
+}
@@ -0,0 +1,32 @@
+// converting lox numbers to and from text.
+#ifndef number_h
+#define number_h
+
+#include <cstddef>
+
+namespace loxc
+{
+
+// Enough room for any double format_number writes.
+constexpr size_t number_buffer_size = 32;
+
+/**
+ * Writes the shortest text that reads back as exactly d into out, which
+ * must hold at least number_buffer_size chars. Does not allocate and does
+ * not depend on the locale.
+ *
+ * @return the number of chars written.
+ */
+size_t format_number(double d, char* out);
+
+/**
+ * Parses the number spelled by [first, last) without allocating or
+ * consulting the locale.
+ *
+ * @return true if the whole range was a number.
+ */
+bool parse_number(const char* first, const char* last, double& out);
+
+} // namespace loxc
+
+#endif
@@ -0,0 +1,1005 @@
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "numeric.h"
+#include "op.h"
+#include "callable.h"
+#include "stmt.h"
+#include "output.h"
+#include "stats.h"
+
+namespace
+{
+    using vm::numeric_chunk;
+
+    // Thrown by the compiler at the first thing the register code can't
+    // express.
+    struct ineligible {};
+
+    enum unbox_error
+    {
+        NUMBERS,
+        NUMBERS_OR_STRINGS,
+        NUMBER,
+    };
+
+    const char* unbox_messages[] = {
+        "Operands must be numbers.",
+        "Operands must be numbers or strings.",
+        "Operand must be a number.",
+    };
+
+    // See vm.cc: what a statement in tail position does with its value.
+    enum tail_t
+    {
+        NO_TAIL,
+        RETURN_TAIL,
+        RECORD_TAIL,
+        INLINE_TAIL,
+    };
+
+    // The result box, holding the value of a loop in tail position.
+    const int result_box = 0;
+
+    // A value in a double register, or, if its type isn't known, a box.
+    struct operand
+    {
+        bool boxed;
+        int reg;
+    };
+
+    const Expr& strip_grouping(const Expr& e)
+    {
+        if (auto g = std::get_if<std::shared_ptr<GroupingExpr>>(&e))
+            return strip_grouping((*g)->expression);
+        return e;
+    }
+
+    // Whether evaluating e might assign a local. Calls can't: a function
+    // with register code has no locals a closure could reach.
+    bool writes_local(const Expr& e)
+    {
+        const Expr& s = strip_grouping(e);
+        if (std::holds_alternative<std::shared_ptr<LiteralExpr>>(s) ||
+            std::holds_alternative<std::shared_ptr<VarExpr>>(s))
+            return false;
+        if (auto u = std::get_if<std::shared_ptr<UnaryExpr>>(&s))
+            return writes_local((*u)->right);
+        if (auto b = std::get_if<std::shared_ptr<BinaryExpr>>(&s))
+            return writes_local((*b)->left) || writes_local((*b)->right);
+        if (auto call = std::get_if<std::shared_ptr<CallExpr>>(&s))
+        {
+            if (writes_local((*call)->callee))
+                return true;
+            for (const Expr& arg : (*call)->args)
+                if (writes_local(arg))
+                    return true;
+            return false;
+        }
+        return true;
+    }
+
+    class compiler
+    {
+    public:
+        compiler(numeric_chunk& c, const loxc::function_layout& layout,
+            const vm::inline_table* inlinable)
+        : c(c), inlinable(inlinable), locals(layout.slots)
+        {
+            if (layout.cells || ! layout.captures.empty() ||
+                locals > int(numeric_chunk::max_doubles))
+                throw ineligible();
+            for (const loxc::binding& p : layout.params)
+                c.params.push_back(p.index);
+        }
+
+        void stmt(const Stmt& s, tail_t t)
+        {
+            // Temporaries never live from one statement into the next.
+            next_double = temp_base;
+            next_box = box_base;
+
+            if (std::holds_alternative<std::monostate>(s))
+            {
+                if (t != NO_TAIL)
+                    finish_nil(t);
+                return;
+            }
+            std::visit([this, t](const auto& node) {
+                if constexpr ( ! std::is_same_v<decltype(node), const std::monostate&> )
+                    statement(*node, t);
+            }, s);
+        }
+
+        void finish()
+        {
+            emit(vm::N_RETURN_NIL);
+
+            // Constants were numbered down from the top of the registers.
+            size_t top = locals + max_temps + constants.size();
+            if (top > numeric_chunk::max_doubles)
+                throw ineligible();
+            c.doubles = top;
+            c.first_constant = numeric_chunk::max_doubles - constants.size();
+            c.constants.assign(constants.rbegin(), constants.rend());
+            c.boxes = max_box;
+        }
+
+    private:
+        numeric_chunk& c;
+        const vm::inline_table* inlinable;
+        const int locals;
+        int next_double = 0;
+        int max_temps = 0;
+        int next_box = 0;
+        int max_box = result_box + 1;
+        std::vector<double> constants;
+        // Where the body being compiled keeps its locals and temporaries.
+        // While inlining, these are past the caller's temporaries.
+        int slot_offset = 0;
+        int temp_base = locals;
+        int box_base = result_box + 1;
+        // While inlining: the box the value goes in, and the jumps past
+        // the body.
+        int inline_result = 0;
+        std::vector<size_t>* inline_exits = nullptr;
+
+        void emit(vm::numeric_opcode op, int a = 0, int b = 0, int target = 0,
+            const loxc::lexeme& where = {})
+        {
+            c.code.push_back({op, a, b, target});
+            c.where.push_back(where);
+        }
+
+        // Points the jump at `at` to the next instruction emitted.
+        void land(size_t at)
+        {
+            c.code[at].c = c.code.size();
+        }
+
+        void land(const std::vector<size_t>& jumps)
+        {
+            for (size_t at : jumps)
+                land(at);
+        }
+
+        int double_temp()
+        {
+            return double_temps(1);
+        }
+
+        int double_temps(int n)
+        {
+            int first = next_double;
+            next_double += n;
+            max_temps = std::max(max_temps, next_double - locals);
+            return first;
+        }
+
+        int local(int index)
+        {
+            return index + slot_offset;
+        }
+
+        bool is_local(int reg)
+        {
+            return reg < temp_base && (reg < locals || reg >= slot_offset);
+        }
+
+        static bool is_jump(vm::numeric_opcode op)
+        {
+            return op >= vm::N_JUMP && op <= vm::N_UNBOX_OR_JUMP;
+        }
+
+        int box_temps(int n)
+        {
+            int first = next_box;
+            next_box += n;
+            max_box = std::max(max_box, next_box);
+            return first;
+        }
+
+        int constant(double d)
+        {
+            for (size_t i = 0; i < constants.size(); ++i)
+                if (std::equal_to<double>()(constants[i], d) &&
+                    std::signbit(constants[i]) == std::signbit(d))
+                    return numeric_chunk::max_doubles - 1 - i;
+            constants.push_back(d);
+            return numeric_chunk::max_doubles - constants.size();
+        }
+
+        int global(const loxc::lexeme& name)
+        {
+            for (size_t i = 0; i < c.globals.size(); ++i)
+                if (c.globals[i].name.text == name.text)
+                    return i;
+            c.globals.push_back({name, loxc::binding{loxc::binding::GLOBAL}});
+            return c.globals.size() - 1;
+        }
+
+        // A register holding o as a double, checking it if it is boxed.
+        int number(operand o, unbox_error error, const loxc::lexeme& where)
+        {
+            if ( ! o.boxed )
+                return o.reg;
+            int d = double_temp();
+            emit(vm::N_UNBOX, d, o.reg, error, where);
+            return d;
+        }
+
+        // Copies register from into local. A value just computed into a
+        // temporary is computed straight into the local instead.
+        void store(int local, int from)
+        {
+            if (from == local)
+                return;
+            if (c.code.empty())
+                return emit(vm::N_MOVE, local, from);
+            vm::numeric_instr& last = c.code.back();
+            bool computed = last.op == vm::N_UNBOX ||
+                (last.op >= vm::N_ADD && last.op <= vm::N_NEGATE);
+            if (computed && last.a == from && from >= temp_base && from == next_double - 1)
+            {
+                last.a = local;
+                --next_double;
+                return;
+            }
+            emit(vm::N_MOVE, local, from);
+        }
+
+        void box_into(const Expr& e, int box)
+        {
+            auto var = std::get_if<std::shared_ptr<VarExpr>>(&strip_grouping(e));
+            if (var && (*var)->bind.kind == loxc::binding::GLOBAL)
+                return emit(vm::N_GET_GLOBAL, box, global((*var)->name), 0, (*var)->name);
+
+            operand o = value(e);
+            if ( ! o.boxed )
+                emit(vm::N_BOX, box, o.reg);
+            else if (o.reg != box)
+                emit(vm::N_MOVE_BOX, box, o.reg);
+        }
+
+        void finish_value(operand o, tail_t t)
+        {
+            switch (t)
+            {
+                case NO_TAIL:
+                    return;
+                case RETURN_TAIL:
+                    return emit(o.boxed ? vm::N_RETURN_BOX : vm::N_RETURN, o.reg);
+                case RECORD_TAIL:
+                    return emit(o.boxed ? vm::N_MOVE_BOX : vm::N_BOX, result_box, o.reg);
+                case INLINE_TAIL:
+                    emit(o.boxed ? vm::N_MOVE_BOX : vm::N_BOX, inline_result, o.reg);
+                    return exit_inline();
+            }
+        }
+
+        void finish_nil(tail_t t)
+        {
+            if (t == RETURN_TAIL)
+                emit(vm::N_RETURN_NIL);
+            else if (t == RECORD_TAIL)
+                emit(vm::N_NIL_BOX, result_box);
+            else if (t == INLINE_TAIL)
+            {
+                emit(vm::N_NIL_BOX, inline_result);
+                exit_inline();
+            }
+        }
+
+        void exit_inline()
+        {
+            inline_exits->push_back(c.code.size());
+            emit(vm::N_JUMP);
+        }
+
+        /**
+         * EXPRESSIONS
+         */
+
+        operand value(const Expr& e)
+        {
+            return std::visit([this](const auto& node) -> operand {
+                if constexpr (std::is_same_v<decltype(node), const std::monostate&>)
+                    throw ineligible();
+                else
+                    return value(*node);
+            }, e);
+        }
+
+        operand value(const LiteralExpr& e)
+        {
+            const double* d = std::get_if<double>(&e.value);
+            if ( ! d )
+                throw ineligible();
+            return {false, constant(*d)};
+        }
+
+        operand value(const GroupingExpr& e)
+        {
+            return value(e.expression);
+        }
+
+        operand value(const VarExpr& e)
+        {
+            if (e.bind.kind == loxc::binding::SLOT)
+                return {false, local(e.bind.index)};
+            if (e.bind.kind != loxc::binding::GLOBAL)
+                throw ineligible();
+            int box = box_temps(1);
+            emit(vm::N_GET_GLOBAL, box, global(e.name), 0, e.name);
+            return {true, box};
+        }
+
+        operand value(const RedefExpr& e)
+        {
+            if (e.bind.kind != loxc::binding::SLOT)
+                throw ineligible();
+            operand o = value(e.value);
+            if (o.boxed)
+                throw ineligible();
+            store(local(e.bind.index), o.reg);
+            return {false, local(e.bind.index)};
+        }
+
+        operand value(const UnaryExpr& e)
+        {
+            if (e.op.type != loxc::MINUS)
+                throw ineligible();
+            int right = number(value(e.right), NUMBER, e.op);
+            int d = double_temp();
+            emit(vm::N_NEGATE, d, right, 0, e.op);
+            return {false, d};
+        }
+
+        operand value(const BinaryExpr& e)
+        {
+            vm::numeric_opcode op;
+            switch (e.op.type)
+            {
+                case loxc::PLUS: op = vm::N_ADD; break;
+                case loxc::MINUS: op = vm::N_SUBTRACT; break;
+                case loxc::STAR: op = vm::N_MULTIPLY; break;
+                case loxc::SLASH: op = vm::N_DIVIDE; break;
+                // Booleans only exist as conditions.
+                default: throw ineligible();
+            }
+
+            operand left = value(e.left);
+            // The left operand is read after the right is evaluated, so it
+            // needs its own copy if the right might change it.
+            if ( ! left.boxed && is_local(left.reg) && writes_local(e.right) )
+            {
+                int copy = double_temp();
+                emit(vm::N_MOVE, copy, left.reg);
+                left.reg = copy;
+            }
+            operand right = value(e.right);
+
+            // Two values of unknown type might be strings to join.
+            if (op == vm::N_ADD && left.boxed && right.boxed)
+            {
+                int box = box_temps(1);
+                emit(vm::N_ADD_BOXES, box, left.reg, right.reg, e.op);
+                return {true, box};
+            }
+
+            unbox_error error = op == vm::N_ADD ? NUMBERS_OR_STRINGS : NUMBERS;
+            int a = number(left, error, e.op);
+            int b = number(right, error, e.op);
+            int d = double_temp();
+            emit(op, d, a, b, e.op);
+            return {false, d};
+        }
+
+        operand value(const CallExpr& e)
+        {
+            if (std::optional<operand> inlined = inline_call(e))
+                return *inlined;
+
+            int first = box_temps(1 + e.args.size());
+            box_into(e.callee, first);
+            for (size_t i = 0; i < e.args.size(); ++i)
+                box_into(e.args[i], first + 1 + i);
+            emit(vm::N_CALL, first, e.args.size(), 0, e.closing_paren);
+            return {true, first};
+        }
+
+        template <typename Node>
+        operand value(const Node&)
+        {
+            throw ineligible();
+        }
+
+        /**
+         * Inlines a call as vm.cc does, leaving its value in a box:
+         *
+         *         GUARD_INLINE f -> inline
+         *         the call as written; JUMP done
+         *     inline:
+         *         args, each unknown one UNBOX_OR_JUMP -> call
+         *         MOVE each parameter
+         *         body, each exit boxing its value and jumping to done
+         *     call:
+         *         the call, with the arguments already evaluated
+         *     done:
+         *
+         * @return nothing if the call can't be inlined, having emitted
+         * nothing.
+         */
+        std::optional<operand> inline_call(const CallExpr& e)
+        {
+            auto var = std::get_if<std::shared_ptr<VarExpr>>(&strip_grouping(e.callee));
+            if ( ! inlinable || inline_exits || ! var ||
+                 (*var)->bind.kind != loxc::binding::GLOBAL )
+                return std::nullopt;
+            auto found = inlinable->find((*var)->name.text);
+            if (found == inlinable->end())
+                return std::nullopt;
+            const FuncStmt& f = *found->second;
+            if (f.params.size() != e.args.size() || ! vm::can_inline(f))
+                return std::nullopt;
+
+            // A body that doesn't fit in register code is called instead.
+            const size_t start = c.code.size();
+            const size_t saved_constants = constants.size();
+            const int saved_double = next_double;
+            const int saved_box = next_box;
+            try
+            {
+                return inline_body(e, (*var)->name, found->second);
+            }
+            catch (const ineligible&)
+            {
+                c.code.resize(start);
+                c.where.resize(start);
+                c.inlined.pop_back();
+                constants.resize(saved_constants);
+                next_double = saved_double;
+                next_box = saved_box;
+                slot_offset = 0;
+                temp_base = locals;
+                box_base = result_box + 1;
+                inline_exits = nullptr;
+                return std::nullopt;
+            }
+        }
+
+        operand inline_body(const CallExpr& e, const loxc::lexeme& name,
+            const std::shared_ptr<FuncStmt>& decl)
+        {
+            const FuncStmt& f = *decl;
+            const size_t argc = e.args.size();
+            int g = global(name);
+            c.inlined.push_back(decl);
+            const int first = box_temps(1 + argc);
+            const int free_double = next_double;
+            const int free_box = next_box;
+
+            size_t guard = c.code.size();
+            emit(vm::N_GUARD_INLINE, g, c.inlined.size() - 1, 0, name);
+            std::vector<size_t> exits;
+            call(e, name, g, first);
+            exits.push_back(c.code.size());
+            emit(vm::N_JUMP);
+
+            next_double = free_double;
+            next_box = free_box;
+            land(guard);
+
+            // Evaluate every argument before any parameter is stored, and
+            // keep a local an argument reads from being changed by a later
+            // one.
+            std::vector<operand> args;
+            for (size_t i = 0; i < argc; ++i)
+            {
+                operand o = value(e.args[i]);
+                bool later_writes = false;
+                for (size_t j = i + 1; j < argc; ++j)
+                    later_writes = later_writes || writes_local(e.args[j]);
+                if ( ! o.boxed && is_local(o.reg) && later_writes )
+                {
+                    int copy = double_temp();
+                    emit(vm::N_MOVE, copy, o.reg);
+                    o.reg = copy;
+                }
+                args.push_back(o);
+            }
+            std::vector<size_t> bails;
+            std::vector<int> numbers;
+            for (const operand& o : args)
+            {
+                if ( ! o.boxed )
+                {
+                    numbers.push_back(o.reg);
+                    continue;
+                }
+                numbers.push_back(double_temp());
+                bails.push_back(c.code.size());
+                emit(vm::N_UNBOX_OR_JUMP, numbers.back(), o.reg);
+            }
+
+            int base = double_temps(f.layout.slots);
+            for (size_t i = 0; i < argc; ++i)
+                emit(vm::N_MOVE, base + f.layout.params[i].index, numbers[i]);
+
+            slot_offset = base;
+            temp_base = next_double;
+            box_base = next_box;
+            inline_result = first;
+            inline_exits = &exits;
+            stmt(f.body, INLINE_TAIL);
+            slot_offset = 0;
+            temp_base = locals;
+            box_base = result_box + 1;
+            inline_exits = nullptr;
+
+            if ( ! bails.empty() )
+            {
+                land(bails);
+                emit(vm::N_GET_GLOBAL, first, g, 0, name);
+                for (size_t i = 0; i < argc; ++i)
+                    emit(args[i].boxed ? vm::N_MOVE_BOX : vm::N_BOX, first + 1 + i, args[i].reg);
+                emit(vm::N_CALL, first, argc, 0, e.closing_paren);
+            }
+            else if (exits.back() == c.code.size() - 1)
+            {
+                // The last exit can fall through to done instead.
+                size_t end = c.code.size();
+                c.code.pop_back();
+                c.where.pop_back();
+                exits.pop_back();
+                for (size_t i = guard; i < c.code.size(); ++i)
+                    if (is_jump(c.code[i].op) && size_t(c.code[i].c) == end)
+                        c.code[i].c = c.code.size();
+            }
+            land(exits);
+
+            next_double = free_double;
+            next_box = free_box;
+            return {true, first};
+        }
+
+        // Calls the function in global g as e does, into box first.
+        void call(const CallExpr& e, const loxc::lexeme& name, int g, int first)
+        {
+            emit(vm::N_GET_GLOBAL, first, g, 0, name);
+            for (size_t i = 0; i < e.args.size(); ++i)
+                box_into(e.args[i], first + 1 + i);
+            emit(vm::N_CALL, first, e.args.size(), 0, e.closing_paren);
+        }
+
+        /**
+         * CONDITIONS
+         */
+
+        // Emits code that jumps when e's truth is sense, adding the jumps
+        // to be landed to jumps.
+        void cond(const Expr& e, bool sense, std::vector<size_t>& jumps)
+        {
+            const Expr& s = strip_grouping(e);
+
+            if (auto b = std::get_if<std::shared_ptr<BinaryExpr>>(&s))
+                if (compare(**b, sense, jumps))
+                    return;
+
+            if (auto u = std::get_if<std::shared_ptr<UnaryExpr>>(&s))
+                if ((*u)->op.type == loxc::BANG)
+                    return cond((*u)->right, ! sense, jumps);
+
+            if (auto l = std::get_if<std::shared_ptr<LogicExpr>>(&s))
+            {
+                // `a or b` is true when either is; `a and b` when both are.
+                // The side that settles the answer early jumps out; the
+                // other falls through to test the right.
+                bool settles = (*l)->op.type == loxc::OR;
+                if (settles == sense)
+                {
+                    cond((*l)->left, sense, jumps);
+                    return cond((*l)->right, sense, jumps);
+                }
+                std::vector<size_t> skip;
+                cond((*l)->left, ! sense, skip);
+                cond((*l)->right, sense, jumps);
+                return land(skip);
+            }
+
+            if (auto lit = std::get_if<std::shared_ptr<LiteralExpr>>(&s))
+            {
+                if (is_truthy((*lit)->value) == sense)
+                {
+                    jumps.push_back(c.code.size());
+                    emit(vm::N_JUMP);
+                }
+                return;
+            }
+
+            operand o = value(s);
+            if (o.boxed)
+            {
+                jumps.push_back(c.code.size());
+                emit(sense ? vm::N_JUMP_TRUTHY : vm::N_JUMP_FALSEY, o.reg);
+            }
+            else if (sense)
+            {
+                // Every number is true.
+                jumps.push_back(c.code.size());
+                emit(vm::N_JUMP);
+            }
+        }
+
+        // @return false if e is not a comparison.
+        bool compare(const BinaryExpr& e, bool sense, std::vector<size_t>& jumps)
+        {
+            vm::numeric_opcode when_true, when_false;
+            switch (e.op.type)
+            {
+                case loxc::LESS:
+                    when_true = vm::N_JUMP_LESS; when_false = vm::N_JUMP_NOT_LESS; break;
+                case loxc::LESS_EQUAL:
+                    when_true = vm::N_JUMP_LESS_EQUAL; when_false = vm::N_JUMP_NOT_LESS_EQUAL; break;
+                case loxc::GREATER:
+                    when_true = vm::N_JUMP_GREATER; when_false = vm::N_JUMP_NOT_GREATER; break;
+                case loxc::GREATER_EQUAL:
+                    when_true = vm::N_JUMP_GREATER_EQUAL; when_false = vm::N_JUMP_NOT_GREATER_EQUAL; break;
+                case loxc::EQUAL_EQUAL:
+                    when_true = vm::N_JUMP_EQUAL; when_false = vm::N_JUMP_NOT_EQUAL; break;
+                case loxc::BANG_EQUAL:
+                    when_true = vm::N_JUMP_NOT_EQUAL; when_false = vm::N_JUMP_EQUAL; break;
+                default:
+                    return false;
+            }
+
+            operand left = value(e.left);
+            if ( ! left.boxed && is_local(left.reg) && writes_local(e.right) )
+            {
+                int copy = double_temp();
+                emit(vm::N_MOVE, copy, left.reg);
+                left.reg = copy;
+            }
+            operand right = value(e.right);
+
+            // Anything can be compared for equality, so only numbers known
+            // to be numbers are.
+            bool equality = e.op.type == loxc::EQUAL_EQUAL || e.op.type == loxc::BANG_EQUAL;
+            if (equality && (left.boxed || right.boxed))
+                throw ineligible();
+
+            int a = number(left, NUMBERS, e.op);
+            int b = number(right, NUMBERS, e.op);
+            jumps.push_back(c.code.size());
+            emit(sense ? when_true : when_false, a, b, 0, e.op);
+            return true;
+        }
+
+        /**
+         * STATEMENTS
+         */
+
+        void statement(const ExprStmt& s, tail_t t)
+        {
+            finish_value(value(s.expression), t);
+        }
+
+        void statement(const PrintStmt& s, tail_t t)
+        {
+            operand o = value(s.expression);
+            emit(o.boxed ? vm::N_PRINT_BOX : vm::N_PRINT, o.reg);
+            finish_nil(t);
+        }
+
+        void statement(const VarStmt& s, tail_t t)
+        {
+            if (s.bind.kind != loxc::binding::SLOT)
+                throw ineligible();
+            operand o = value(s.initializer);
+            if (o.boxed)
+                throw ineligible();
+            store(local(s.bind.index), o.reg);
+            finish_value({false, local(s.bind.index)}, t);
+        }
+
+        void statement(const BlockStmt& s, tail_t t)
+        {
+            if (s.stmt_list.empty())
+                return stmt(Stmt(), t);
+            for (size_t i = 0; i + 1 < s.stmt_list.size(); ++i)
+                stmt(s.stmt_list[i], NO_TAIL);
+            stmt(s.stmt_list.back(), t);
+        }
+
+        void statement(const IfStmt& s, tail_t t)
+        {
+            std::vector<size_t> skip_then;
+            cond(s.condition, false, skip_then);
+            stmt(s.t_branch, t);
+
+            if (std::holds_alternative<std::monostate>(s.f_branch) && t == NO_TAIL)
+                return land(skip_then);
+
+            size_t skip_else = c.code.size();
+            emit(vm::N_JUMP);
+            land(skip_then);
+            stmt(s.f_branch, t);
+            land(skip_else);
+        }
+
+        void statement(const WhileStmt& s, tail_t t)
+        {
+            if (t != NO_TAIL)
+                emit(vm::N_NIL_BOX, result_box);
+
+            size_t loop = c.code.size();
+            std::vector<size_t> exits;
+            cond(s.condition, false, exits);
+            stmt(s.body, t == NO_TAIL ? NO_TAIL : RECORD_TAIL);
+            emit(vm::N_JUMP, 0, 0, loop);
+            land(exits);
+
+            if (t == RETURN_TAIL)
+                emit(vm::N_RETURN_BOX, result_box);
+        }
+
+        void statement(const ReturnStmt& s, tail_t)
+        {
+            tail_t t = inline_exits ? INLINE_TAIL : RETURN_TAIL;
+            if (std::holds_alternative<std::monostate>(s.value))
+                return finish_nil(t);
+            finish_value(value(s.value), t);
+        }
+
+        template <typename Node>
+        void statement(const Node&, tail_t)
+        {
+            throw ineligible();
+        }
+    };
+
+    /**
+     * DISPATCH LOOP
+     */
+
+    // As vm.cc's loop, over registers. Doubles are a native array, so
+    // only the boxes need reloading after a call.
+    template <bool threaded>
+    Val execute(op::interpreter& interp, numeric_chunk& c)
+    {
+        double d[numeric_chunk::max_doubles];
+
+        std::vector<Val>& values = interp.values;
+        for (int p : c.params)
+            d[p] = *std::get_if<double>(&values[interp.base + p]);
+        std::copy(c.constants.begin(), c.constants.end(), d + c.first_constant);
+
+        const size_t box_base = values.size();
+        values.resize(box_base + c.boxes);
+        Val* v = values.data() + box_base;
+
+        const vm::numeric_instr* const code = c.code.data();
+        const vm::numeric_instr* ip = code;
+
+#ifdef LOXC_THREADED_DISPATCH
+        [[maybe_unused]] static void* const labels[] = {
+#define LOXC_NUMERIC_OPCODE_LABEL(name) &&L_##name,
+            LOXC_NUMERIC_OPCODES(LOXC_NUMERIC_OPCODE_LABEL)
+#undef LOXC_NUMERIC_OPCODE_LABEL
+        };
+#define CASE(name) case vm::N_##name: L_##name
+#define DISPATCH() do { if constexpr (threaded) goto *labels[ip->op]; else goto dispatch; } while (0)
+#else
+#define CASE(name) case vm::N_##name
+#define DISPATCH() goto dispatch
+#endif
+
+#define NEXT() do { ++ip; DISPATCH(); } while (0)
+#define JUMP_TO(target) do { ip = code + (target); DISPATCH(); } while (0)
+#define JUMP_IF(test) do { if (test) JUMP_TO(ip->c); NEXT(); } while (0)
+#define WHERE() (c.where[ip - code])
+
+        goto dispatch;
+
+    dispatch:
+        switch (ip->op)
+        {
+            CASE(MOVE):
+                d[ip->a] = d[ip->b];
+                NEXT();
+            CASE(ADD):
+                d[ip->a] = d[ip->b] + d[ip->c];
+                NEXT();
+            CASE(SUBTRACT):
+                d[ip->a] = d[ip->b] - d[ip->c];
+                NEXT();
+            CASE(MULTIPLY):
+                d[ip->a] = d[ip->b] * d[ip->c];
+                NEXT();
+            CASE(DIVIDE):
+                d[ip->a] = d[ip->b] / d[ip->c];
+                NEXT();
+            CASE(NEGATE):
+                d[ip->a] = -d[ip->b];
+                NEXT();
+
+            CASE(JUMP):
+                JUMP_TO(ip->c);
+            CASE(JUMP_LESS):
+                JUMP_IF(d[ip->a] < d[ip->b]);
+            CASE(JUMP_NOT_LESS):
+                JUMP_IF( ! (d[ip->a] < d[ip->b]) );
+            CASE(JUMP_LESS_EQUAL):
+                JUMP_IF(d[ip->a] <= d[ip->b]);
+            CASE(JUMP_NOT_LESS_EQUAL):
+                JUMP_IF( ! (d[ip->a] <= d[ip->b]) );
+            CASE(JUMP_GREATER):
+                JUMP_IF(d[ip->a] > d[ip->b]);
+            CASE(JUMP_NOT_GREATER):
+                JUMP_IF( ! (d[ip->a] > d[ip->b]) );
+            CASE(JUMP_GREATER_EQUAL):
+                JUMP_IF(d[ip->a] >= d[ip->b]);
+            CASE(JUMP_NOT_GREATER_EQUAL):
+                JUMP_IF( ! (d[ip->a] >= d[ip->b]) );
+            CASE(JUMP_EQUAL):
+                JUMP_IF(d[ip->a] == d[ip->b]);
+            CASE(JUMP_NOT_EQUAL):
+                JUMP_IF(d[ip->a] != d[ip->b]);
+            CASE(JUMP_TRUTHY):
+                JUMP_IF(is_truthy(v[ip->a]));
+            CASE(JUMP_FALSEY):
+                JUMP_IF( ! is_truthy(v[ip->a]) );
+
+            CASE(GUARD_INLINE):
+            {
+                vm::global_ref& g = c.globals[ip->a];
+                const Val* slot = interp.globals->lookup(g.name.str(), g.bind);
+                auto f = slot ? std::get_if<std::shared_ptr<loxc::callable>>(slot) : nullptr;
+                if (f && (*f)->declaration() == c.inlined[ip->b].get())
+                    JUMP_TO(ip->c);
+                NEXT();
+            }
+            CASE(UNBOX_OR_JUMP):
+            {
+                const double* n = std::get_if<double>(&v[ip->b]);
+                if ( ! n )
+                    JUMP_TO(ip->c);
+                d[ip->a] = *n;
+                NEXT();
+            }
+
+            CASE(GET_GLOBAL):
+            {
+                vm::global_ref& g = c.globals[ip->b];
+                Val* slot = interp.globals->lookup(g.name.str(), g.bind);
+                if ( ! slot )
+                    throw op::runtime_error(g.name, "Undefined variable '" + g.name.str() + "'.");
+                LOXC_COUNT(value_copies, 1);
+                v[ip->a] = *slot;
+                NEXT();
+            }
+            CASE(BOX):
+                v[ip->a] = d[ip->b];
+                NEXT();
+            CASE(UNBOX):
+            {
+                const double* n = std::get_if<double>(&v[ip->b]);
+                if ( ! n )
+                    throw op::runtime_error(WHERE(), unbox_messages[ip->c]);
+                d[ip->a] = *n;
+                NEXT();
+            }
+            CASE(MOVE_BOX):
+                v[ip->a] = v[ip->b];
+                NEXT();
+            CASE(NIL_BOX):
+                v[ip->a] = std::monostate{};
+                NEXT();
+            CASE(ADD_BOXES):
+            {
+                const Val& l = v[ip->b];
+                const Val& r = v[ip->c];
+                if (std::holds_alternative<double>(l) && std::holds_alternative<double>(r))
+                    v[ip->a] = std::get<double>(l) + std::get<double>(r);
+                else if (std::holds_alternative<std::string>(l) &&
+                         std::holds_alternative<std::string>(r))
+                {
+                    std::string joined = std::get<std::string>(l) + std::get<std::string>(r);
+                    LOXC_COUNT(strings, 1);
+                    LOXC_COUNT(string_bytes, joined.size());
+                    v[ip->a] = std::move(joined);
+                }
+                else
+                    throw op::runtime_error(WHERE(), "Operands must be numbers or strings.");
+                NEXT();
+            }
+            CASE(CALL):
+            {
+                Val* callee = v + ip->a;
+                std::vector<Val> args(std::make_move_iterator(callee + 1),
+                    std::make_move_iterator(callee + 1 + ip->b));
+                auto f = std::get_if<std::shared_ptr<loxc::callable>>(callee);
+                if ( ! f )
+                    throw op::runtime_error(WHERE(), "Object is not callable.");
+
+                const loxc::callable& fn = **f;
+                Val result = interp.call_value(fn, std::move(args), WHERE());
+                // The call may have grown the value stack and moved it.
+                v = values.data() + box_base;
+                v[ip->a] = std::move(result);
+                NEXT();
+            }
+
+            CASE(PRINT):
+            {
+                loxc::output::record line(loxc::out());
+                loxc::out() << d[ip->a] << '\n';
+                loxc::out().sync();
+            }
+                NEXT();
+            CASE(PRINT_BOX):
+            {
+                loxc::output::record line(loxc::out());
+                loxc::out() << v[ip->a] << '\n';
+                loxc::out().sync();
+            }
+                NEXT();
+            CASE(RETURN):
+                return d[ip->a];
+            CASE(RETURN_BOX):
+                return std::move(v[ip->a]);
+            CASE(RETURN_NIL):
+                return std::monostate{};
+        }
+
+        // Every chunk ends in a return.
+        return std::monostate{};
+
+#undef CASE
+#undef DISPATCH
+#undef NEXT
+#undef JUMP_TO
+#undef JUMP_IF
+#undef WHERE
+    }
+}
+
+std::shared_ptr<vm::numeric_chunk> vm::compile_numeric(const loxc::function_layout& layout,
+    const Stmt& body, const inline_table* inlinable)
+{
+    auto c = std::make_shared<numeric_chunk>();
+    try
+    {
+        compiler comp(*c, layout, inlinable);
+        comp.stmt(body, RETURN_TAIL);
+        comp.finish();
+    }
+    catch (const ineligible&)
+    {
+        return nullptr;
+    }
+    return c;
+}
+
+bool vm::accepts(const op::interpreter& interp, const numeric_chunk& c)
+{
+    for (int p : c.params)
+        if ( ! std::holds_alternative<double>(interp.values[interp.base + p]) )
+            return false;
+    return true;
+}
+
+Val vm::run_numeric(op::interpreter& interp, numeric_chunk& c, bool threaded)
+{
+#ifdef LOXC_THREADED_DISPATCH
+    if (threaded)
+        return execute<true>(interp, c);
+#endif
+    return execute<false>(interp, c);
+}
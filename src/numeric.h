@@ -0,0 +1,150 @@
+// a register tier for numeric lox functions, with unboxed doubles.
+#ifndef numeric_h
+#define numeric_h
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "vm.h"
+
+/**
+ * Arithmetic in the stack vm still moves Vals around and checks that
+ * both operands hold doubles on every operation. Most numeric functions
+ * never see anything but numbers, so for those a second compiler emits
+ * register code over plain doubles instead.
+ *
+ * A function qualifies when, given that its parameters are numbers, every
+ * local provably stays a number: each is initialized and assigned only
+ * arithmetic over locals and number literals, or over values it has
+ * checked. Entry is guarded: if an argument is not a number the call runs
+ * in the stack vm instead. Inside, number registers are unboxed and their
+ * arithmetic is unchecked.
+ *
+ * The few values whose type isn't known (globals and call results) live
+ * in box registers and are checked when they meet arithmetic, raising the
+ * same errors the tree walker would. Comparisons only appear as branch
+ * conditions, so booleans are never materialized. Anything else (strings,
+ * closures, classes, globals assigned to) keeps the function in the stack
+ * vm.
+ *
+ * Registers:
+ *
+ *     doubles: [ locals | temporaries ... constants ]
+ *     boxes:   [ result | temporaries ]
+ *
+ * Locals keep the slot numbers the resolver gave them. Constants are
+ * loaded into the top registers once per call, so no instruction has an
+ * immediate operand.
+ *
+ * Calls the stack vm would inline (see vm::inline_table) are inlined here
+ * too, the callee's locals taking registers past the caller's temporaries.
+ * An argument of unknown type is checked on the way in; if it is not a
+ * number the call is made as written.
+ */
+namespace vm
+{
+
+// X(name). Operands are double registers unless noted; jumps go to c.
+#define LOXC_NUMERIC_OPCODES(X) \
+    X(MOVE)                /* a = b */ \
+    X(ADD)                 /* a = b + c */ \
+    X(SUBTRACT) \
+    X(MULTIPLY) \
+    X(DIVIDE) \
+    X(NEGATE)              /* a = -b */ \
+    X(JUMP) \
+    X(JUMP_LESS)           /* to c if a < b */ \
+    X(JUMP_NOT_LESS)       /* to c unless a < b */ \
+    X(JUMP_LESS_EQUAL) \
+    X(JUMP_NOT_LESS_EQUAL) \
+    X(JUMP_GREATER) \
+    X(JUMP_NOT_GREATER) \
+    X(JUMP_GREATER_EQUAL) \
+    X(JUMP_NOT_GREATER_EQUAL) \
+    X(JUMP_EQUAL) \
+    X(JUMP_NOT_EQUAL) \
+    X(JUMP_TRUTHY)         /* to c if box a is truthy */ \
+    X(JUMP_FALSEY) \
+    X(GUARD_INLINE)        /* to c if globals[a] is still inlined[b] */ \
+    X(UNBOX_OR_JUMP)       /* a = box b if a number, else to c */ \
+    X(GET_GLOBAL)          /* box a = globals[b] */ \
+    X(BOX)                 /* box a = b */ \
+    X(UNBOX)               /* a = box b, raising error c if not a number */ \
+    X(MOVE_BOX)            /* box a = box b */ \
+    X(NIL_BOX)             /* box a = nil */ \
+    X(ADD_BOXES)           /* box a = box b + box c */ \
+    X(CALL)                /* box a = box a(box a + 1 ... box a + b) */ \
+    X(PRINT) \
+    X(PRINT_BOX) \
+    X(RETURN) \
+    X(RETURN_BOX) \
+    X(RETURN_NIL)
+
+enum numeric_opcode : uint8_t
+{
+#define LOXC_NUMERIC_OPCODE_ENUM(name) N_##name,
+    LOXC_NUMERIC_OPCODES(LOXC_NUMERIC_OPCODE_ENUM)
+#undef LOXC_NUMERIC_OPCODE_ENUM
+    NUMERIC_OPCODE_COUNT
+};
+
+struct numeric_instr
+{
+    numeric_opcode op;
+    int32_t a = 0;
+    int32_t b = 0;
+    int32_t c = 0;
+};
+
+/**
+ * A function body compiled to register code. As in a chunk, `where`
+ * runs parallel to `code`.
+ */
+struct numeric_chunk
+{
+    // Doubles live in a fixed array on the native stack; functions that
+    // need more registers stay in the stack vm.
+    static constexpr size_t max_doubles = 128;
+
+    std::vector<numeric_instr> code;
+    std::vector<loxc::lexeme> where;
+    // the parameters' slots, each of which must hold a number on entry.
+    std::vector<int> params;
+    // loaded into the registers starting at first_constant.
+    std::vector<double> constants;
+    int first_constant = 0;
+    std::vector<global_ref> globals;
+    // as in a chunk, functions whose bodies were inlined.
+    std::vector<std::shared_ptr<FuncStmt>> inlined;
+    // registers in use: locals, temporaries and constants.
+    size_t doubles = 0;
+    size_t boxes = 0;
+};
+
+/**
+ * Compiles body to register code.
+ *
+ * @param inlinable functions to inline calls to, if any.
+ * @return the code, or nullptr if the function doesn't qualify.
+ */
+std::shared_ptr<numeric_chunk> compile_numeric(const loxc::function_layout& layout,
+    const Stmt& body, const inline_table* inlinable = nullptr);
+
+/**
+ * Whether the running frame's arguments let c run: every parameter holds
+ * a number.
+ */
+bool accepts(const op::interpreter& interp, const numeric_chunk& c);
+
+/**
+ * Runs c in the interpreter's current frame, whose slots hold the
+ * arguments.
+ *
+ * @param threaded whether to dispatch with computed gotos.
+ */
+Val run_numeric(op::interpreter& interp, numeric_chunk& c, bool threaded);
+
+} // namespace vm
+
+#endif
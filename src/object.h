@@ -0,0 +1,116 @@
+// lox classes and their instances, lists and maps.
+#ifndef object_h
+#define object_h
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "val.h"
+#include "shape.h"
+
+namespace loxc
+{
+
+/**
+ * A lox class. Methods are copied down from the superclass when the class
+ * is made, so looking one up is a single probe no matter how deep the
+ * hierarchy. Method names are interned.
+ */
+struct klass
+{
+    std::string name;
+    std::shared_ptr<klass> super;
+    // each method takes the instance as its first argument.
+    std::unordered_map<const std::string*, std::shared_ptr<callable>> methods;
+    // instances start out with this shape.
+    shape root;
+    // whether its methods can run on other threads. See callable.
+    bool shareable = true;
+
+    klass(std::string name, std::shared_ptr<klass> super)
+    : name(std::move(name)), super(std::move(super))
+    {
+        if (this->super)
+            methods = this->super->methods;
+    }
+
+    const callable* find_method(const std::string* name) const
+    {
+        auto found = methods.find(name);
+        return found == methods.end() ? nullptr : found->second.get();
+    }
+};
+
+/**
+ * An instance of a lox class: its class, its shape and its fields, laid
+ * out in the order the shape gives.
+ */
+struct instance
+{
+    std::shared_ptr<klass> cls;
+    const shape* layout;
+    std::vector<Val> fields;
+
+    explicit instance(std::shared_ptr<klass> c)
+    : cls(std::move(c)), layout(&cls->root) {}
+};
+
+/**
+ * A lox list: values in order, grown and shrunk at the end.
+ */
+struct list
+{
+    std::vector<Val> items;
+};
+
+/**
+ * A lox map from strings to values. Entries stay in the order their keys
+ * were first set, so a map prints and serializes the same way each run.
+ */
+struct map
+{
+    // Up to this many entries, a key is looked for by comparing it with
+    // each; most maps, like most objects in JSON, never grow past it.
+    static constexpr size_t small = 8;
+
+    std::vector<std::pair<std::string, Val>> entries;
+    // each key's place in entries, once there are more than small.
+    std::unordered_map<std::string, size_t> index;
+
+    const Val* find(const std::string& key) const
+    {
+        if (index.empty())
+        {
+            for (const auto& entry : entries)
+                if (entry.first == key)
+                    return &entry.second;
+            return nullptr;
+        }
+        auto found = index.find(key);
+        return found == index.end() ? nullptr : &entries[found->second].second;
+    }
+
+    void set(std::string key, Val value)
+    {
+        if (const Val* found = find(key))
+        {
+            *const_cast<Val*>(found) = std::move(value);
+            return;
+        }
+        entries.emplace_back(std::move(key), std::move(value));
+        if (entries.size() <= small)
+            return;
+        if (index.empty())
+            for (size_t i = 0; i < entries.size(); ++i)
+                index.emplace(entries[i].first, i);
+        else
+            index.emplace(entries.back().first, entries.size() - 1);
+    }
+};
+
+} // namespace loxc
+
+#endif
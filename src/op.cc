@@ -3,21 +3,364 @@
 #include <memory>
 #include <initializer_list>
 #include <functional>
+#include <mutex>
+
+#include <pthread.h>
 
 #include "expr.h"
 #include "op.h"
 #include "stmt.h"
 #include "callable.h"
+#include "stats.h"
+#include "output.h"
+#include "session.h"
+#include "numeric.h"
+#include "object.h"
+#include "modules.h"
+#include "reporter.h"
+
+/**
+ * CALL STACK
+ */
+
+namespace
+{
+    // The native stack a lox call must find left to go ahead: enough for
+    // the passes that may run before the next call is checked to walk a
+    // tree nested Parser::max_depth deep, a body parsed and compiled on
+    // its first call included.
+    const size_t native_reserve = 4 * 1024 * 1024;
+
+    // The lowest address a lox call may start from on this thread, or
+    // null if the thread's stack can't be found.
+    const char* native_floor()
+    {
+        static thread_local const char* floor = [] {
+            pthread_attr_t attr;
+            void* low = nullptr;
+            size_t size = 0;
+            if (pthread_getattr_np(pthread_self(), &attr) != 0)
+                return static_cast<const char*>(nullptr);
+            pthread_attr_getstack(&attr, &low, &size);
+            pthread_attr_destroy(&attr);
+            if (size <= native_reserve)
+                return static_cast<const char*>(low) + size;
+            return static_cast<const char*>(low) + native_reserve;
+        }();
+        return floor;
+    }
+}
+
+void op::call_stack::push(const loxc::callable* callee, const loxc::lexeme& site)
+{
+    if (frames.size() >= max_depth)
+    {
+        op::runtime_error e(site, "Stack overflow. Maximum call depth is "
+            + std::to_string(max_depth) + ".");
+        e.trace = backtrace();
+        throw e;
+    }
+    // Each call nests native frames as well, however many depends on the
+    // code between calls, so what is left of the native stack is checked
+    // too.
+    if (static_cast<const char*>(__builtin_frame_address(0)) < native_floor())
+    {
+        op::runtime_error e(site, "Stack overflow. Out of native stack at a call depth of "
+            + std::to_string(frames.size()) + ".");
+        e.trace = backtrace();
+        throw e;
+    }
+    frames.push_back({callee, site});
+}
+
+std::string op::call_stack::backtrace() const
+{
+    // Show this many of the innermost frames, then summarize the rest.
+    const size_t shown = 16;
+
+    std::ostringstream out;
+    out << "[backtrace] most recent call first\n";
+
+    size_t count = 0;
+    for (auto it = frames.rbegin(); it != frames.rend(); ++it, ++count)
+    {
+        if (count == shown)
+        {
+            out << "\t... " << frames.size() - shown << " more frames\n";
+            break;
+        }
+        out << "\t" << it->callee->str << " [line] " << it->site.line << "\n";
+    }
+    return out.str();
+}
+
+loxc::lexeme op::builtin_site(const interpreter& interp, const char* builtin)
+{
+    return loxc::lexeme{loxc::ID, interp.stack.line(), loxc::intern(builtin)};
+}
+
+op::runtime_error op::builtin_error(const interpreter& interp, const char* builtin,
+    std::string what)
+{
+    return runtime_error(builtin_site(interp, builtin), std::move(what));
+}
 
 /**
  * INTERPRETER
  */
 
+namespace
+{
+    // Pops the frame pushed for a call, however the call exits.
+    struct frame_guard
+    {
+        op::call_stack& stack;
+        ~frame_guard() { stack.pop(); }
+    };
+
+    // Runs a call against the globals its callee was defined against,
+    // and the caller's again afterwards.
+    struct globals_guard
+    {
+        op::interpreter& interp;
+        Globals* saved;
+
+        globals_guard(op::interpreter& interp, Globals* env)
+        : interp(interp), saved(interp.globals)
+        {
+            if (env)
+                interp.globals = env;
+            else if (interp.home)
+                interp.globals = interp.home;
+        }
+        ~globals_guard() { interp.globals = saved; }
+    };
+
+    // Pushes a frame of slots and cells for the lifetime of a call and
+    // restores the caller's upvalues afterwards. The stacks only ever grow
+    // to the deepest frame seen, so pushing is allocation free in steady
+    // state.
+    struct value_frame
+    {
+        op::interpreter& interp;
+        size_t saved_base;
+        size_t saved_cell_base;
+        const op::interpreter::upvalue_list* saved_upvalues;
+
+        value_frame(op::interpreter& interp, const loxc::function_layout& layout)
+        : interp(interp), saved_base(interp.base),
+          saved_cell_base(interp.cell_base), saved_upvalues(interp.upvalues)
+        {
+            interp.base = interp.values.size();
+            interp.values.resize(interp.base + layout.slots);
+            interp.cell_base = interp.cells.size();
+            interp.cells.resize(interp.cell_base + layout.cells);
+        }
+        ~value_frame()
+        {
+            interp.values.resize(interp.base);
+            interp.base = saved_base;
+            interp.cells.resize(interp.cell_base);
+            interp.cell_base = saved_cell_base;
+            interp.upvalues = saved_upvalues;
+        }
+    };
+
+    // Parses a function body deferred by a lazy parse on the first call.
+    // Spawned calls share the tree, so that call can come from any
+    // thread, or from several at once. Its compile errors are kept with
+    // the body and reported by every call to it, never by one that parses
+    // something else.
+    template <typename Func>
+    void compile_deferred(Func& f, const loxc::lexeme& where)
+    {
+        if ( ! f.deferred )
+            return;
+        loxc::deferred_body& d = *f.deferred;
+        if (d.state.load(std::memory_order_acquire) == loxc::deferred_body::PENDING)
+        {
+            std::lock_guard<std::mutex> lock(d.lock);
+            if (d.state.load(std::memory_order_relaxed) == loxc::deferred_body::PENDING)
+            {
+                Reporter::capture errors;
+                bool ok = Session::compile_body(d, f.params, f.body, f.layout);
+                d.errors = std::move(errors.text);
+                d.state.store(ok ? loxc::deferred_body::PARSED : loxc::deferred_body::FAILED,
+                    std::memory_order_release);
+            }
+        }
+        if (d.state.load(std::memory_order_acquire) == loxc::deferred_body::FAILED)
+        {
+            Reporter::replay(d.errors);
+            throw op::runtime_error(where, "Error compiling function body.");
+        }
+    }
+
+    // Swaps a generator's frame in for one resumption, and out again
+    // however the resumption ends.
+    struct generator_frame
+    {
+        op::interpreter& interp;
+        op::generator& g;
+        size_t saved_base;
+        size_t saved_cell_base;
+        const op::interpreter::upvalue_list* saved_upvalues;
+
+        generator_frame(op::interpreter& interp, op::generator& g)
+        : interp(interp), g(g), saved_base(interp.base),
+          saved_cell_base(interp.cell_base), saved_upvalues(interp.upvalues)
+        {
+            g.running = true;
+            std::swap(interp.values, g.values);
+            std::swap(interp.cells, g.cells);
+            interp.base = 0;
+            interp.cell_base = 0;
+            interp.upvalues = &g.captured;
+        }
+        ~generator_frame()
+        {
+            std::swap(interp.values, g.values);
+            std::swap(interp.cells, g.cells);
+            interp.base = saved_base;
+            interp.cell_base = saved_cell_base;
+            interp.upvalues = saved_upvalues;
+            g.running = false;
+            if ( ! g.at.suspended )
+            {
+                // Finished, by returning or by an error: drop the frame.
+                g.done = true;
+                g.values = {};
+                g.cells = {};
+                g.captured = {};
+                g.code.reset();
+            }
+        }
+    };
+
+}
+
+Val op::interpreter::run(std::vector<Stmt>& program, const loxc::function_layout& layout)
+{
+    value_frame frame(*this, layout);
+    upvalues = nullptr;
+
+    if (exec != vm::TREE)
+    {
+        // Top level code mostly runs once, but it is where a script's
+        // outermost loops live.
+        if (inlining)
+            for (const Stmt& s : program)
+                if (auto f = std::get_if<std::shared_ptr<FuncStmt>>(&s);
+                    f && (*f)->bind.kind == loxc::binding::GLOBAL)
+                    inlinable[(*f)->name.text] = *f;
+        std::shared_ptr<vm::chunk> code = vm::compile(program, superinstructions,
+            inlining ? &inlinable : nullptr, layout.slots);
+        return vm::run(*this, *code);
+    }
+
+    Val last(std::monostate{});
+    for (Stmt& s : program)
+        last = std::visit(*this, s);
+    return last;
+}
+
+Val op::interpreter::call(const loxc::function_layout& layout, const Stmt& body,
+    std::shared_ptr<vm::chunk>& code, const upvalue_list& captured,
+    const loxc::lexeme& where, const loxc::lexeme& site, std::vector<Val> args)
+{
+    if (layout.params.size() != args.size())
+        throw op::runtime_error(site,
+        "Wrong number of arguments to function. "
+        "Expected " + std::to_string(layout.params.size() - layout.receiver) +
+        " got " + std::to_string(args.size() - layout.receiver));
+
+    if (layout.generator)
+        return generate(layout, body, code, captured, where, std::move(args));
+
+    LOXC_COUNT(frames, 1);
+    value_frame frame(*this, layout);
+    upvalues = &captured;
+
+    for (size_t i = 0; i < args.size(); ++i)
+        declare(std::string(), layout.params[i], std::move(args[i]));
+
+    if (exec == vm::TREE)
+        return std::visit(*this, body);
+    std::shared_ptr<vm::chunk>& chunk = worker ? own_chunks[&body] : code;
+    if ( ! chunk )
+    {
+        chunk = vm::compile(body, superinstructions,
+            inlining ? &inlinable : nullptr, layout.slots);
+        if (numeric)
+            chunk->numeric = vm::compile_numeric(layout, body,
+                inlining ? &inlinable : nullptr);
+    }
+    return vm::run(*this, *chunk);
+}
+
+Val op::interpreter::generate(const loxc::function_layout& layout, const Stmt& body,
+    std::shared_ptr<vm::chunk>& code, const upvalue_list& captured,
+    const loxc::lexeme& where, std::vector<Val> args)
+{
+    auto g = std::make_shared<generator>();
+    {
+        // Bind the arguments as a call would, then take the frame.
+        value_frame frame(*this, layout);
+        for (size_t i = 0; i < args.size(); ++i)
+            declare(std::string(), layout.params[i], std::move(args[i]));
+        g->values.assign(std::make_move_iterator(values.begin() + base),
+            std::make_move_iterator(values.end()));
+        g->cells.assign(cells.begin() + cell_base, cells.end());
+    }
+
+    // The body only ever runs in the vm, which can stop at a yield.
+    std::shared_ptr<vm::chunk>& chunk = worker ? own_chunks[&body] : code;
+    if ( ! chunk )
+        chunk = vm::compile(body, superinstructions,
+            inlining ? &inlinable : nullptr, layout.slots);
+    g->code = chunk;
+    g->captured = captured;
+    g->where = where;
+
+    LOXC_COUNT(callables, 1);
+    auto f = std::make_shared<loxc::callable>("<generator " + where.str() + ">",
+    [g](op::interpreter& interp, std::vector<Val> args)-> Val{
+        if ( ! args.empty() )
+            throw op::runtime_error(interp.stack.site(),
+            "Wrong number of arguments to function. "
+            "Expected 0 got " + std::to_string(args.size()));
+        return interp.resume(*g);
+        },
+    loxc::callable::generator{{env()}, g});
+    return f;
+}
+
+Val op::interpreter::resume(generator& g)
+{
+    if (g.done)
+        return std::monostate{};
+    if (g.running)
+        throw op::runtime_error(stack.site(), "Generator is already running.");
+
+    LOXC_COUNT(frames, 1);
+    generator_frame frame(*this, g);
+    return vm::resume(*this, *g.code, g.at);
+}
+
+op::interpreter::upvalue_list op::interpreter::capture(const loxc::function_layout& layout)
+{
+    upvalue_list captured;
+    captured.reserve(layout.captures.size());
+    for (const loxc::capture& c : layout.captures)
+        captured.push_back(c.local ? cells[cell_base + c.index] : (*upvalues)[c.index]);
+    return captured;
+}
+
 Val op::interpreter::operator()(std::shared_ptr<BinaryExpr> e)
 {
     // note that we are evaluating from left to right.
-    Val left = std::visit(op::interpreter(env), e->left);
-    Val right = std::visit(op::interpreter(env), e->right);
+    Val left = std::visit(*this, e->left);
+    Val right = std::visit(*this, e->right);
     
     switch (e->op.type)
     {
@@ -31,7 +374,12 @@ Val op::interpreter::operator()(std::shared_ptr<BinaryExpr> e)
                     return std::get<double>(left) + std::get<double>(right);
             if (std::holds_alternative<std::string>(left) &&
                 std::holds_alternative<std::string>(right))
-                    return std::get<std::string>(left) + std::get<std::string>(right);
+            {
+                std::string joined = std::get<std::string>(left) + std::get<std::string>(right);
+                LOXC_COUNT(strings, 1);
+                LOXC_COUNT(string_bytes, joined.size());
+                return joined;
+            }
             throw op::runtime_error(e->op, "Operands must be numbers or strings.");
         case loxc::SLASH:
             assert_numeric(e->op, left, right);
@@ -67,20 +415,23 @@ Val op::interpreter::operator()(std::shared_ptr<BinaryExpr> e)
 
 Val op::interpreter::operator()(std::shared_ptr<GroupingExpr> e)
 {
-    return std::visit(op::interpreter(env), e->expression);
+    return std::visit(*this, e->expression);
 }
 
 Val op::interpreter::operator()(std::shared_ptr<LiteralExpr> e)
 {
+    LOXC_COUNT(value_copies, 1);
     return e->value;
 }
 
 Val op::interpreter::operator()(std::shared_ptr<UnaryExpr> e)
 {
-    Val right = std::visit(op::interpreter(env), e->right);
+    Val right = std::visit(*this, e->right);
     switch (e->op.type)
     {
         case loxc::MINUS:
+            if ( ! std::holds_alternative<double>(right) )
+                throw op::runtime_error(e->op, "Operand must be a number.");
             return -std::get<double>(right);
         case loxc::BANG:
             return !is_truthy(right);
@@ -89,46 +440,127 @@ Val op::interpreter::operator()(std::shared_ptr<UnaryExpr> e)
     throw op::runtime_error(e->op, "Invalid operator in unary expression.");
 }
 
+Val op::interpreter::lookup(const loxc::lexeme& name, loxc::binding& bind)
+{
+    LOXC_COUNT(value_copies, 1);
+    switch (bind.kind)
+    {
+        case loxc::binding::SLOT:
+            return values[base + bind.index];
+        case loxc::binding::CELL:
+            return *cells[cell_base + bind.index];
+        case loxc::binding::UPVALUE:
+            return *(*upvalues)[bind.index];
+    }
+
+    Val* slot = worker ? globals->lookup(name.str()) : globals->lookup(name.str(), bind);
+    if ( ! slot )
+        throw op::runtime_error(name, "Undefined variable '" + name.str() + "'.");
+    return *slot;
+}
+
+void op::interpreter::assign(const loxc::lexeme& name, loxc::binding& bind, Val value)
+{
+    switch (bind.kind)
+    {
+        case loxc::binding::SLOT:
+            values[base + bind.index] = std::move(value);
+            return;
+        case loxc::binding::CELL:
+            *cells[cell_base + bind.index] = std::move(value);
+            return;
+        case loxc::binding::UPVALUE:
+            *(*upvalues)[bind.index] = std::move(value);
+            return;
+    }
+
+    Val* slot = worker ? globals->lookup(name.str()) : globals->lookup(name.str(), bind);
+    if ( ! slot )
+        throw op::runtime_error(name, "Undefined variable '" + name.str() + "'.");
+    *slot = std::move(value);
+}
+
+void op::interpreter::declare(const std::string& name, const loxc::binding& bind, Val value)
+{
+    switch (bind.kind)
+    {
+        case loxc::binding::SLOT:
+            values[base + bind.index] = std::move(value);
+            return;
+        case loxc::binding::CELL:
+            LOXC_COUNT(cells, 1);
+            cells[cell_base + bind.index] = std::make_shared<Val>(std::move(value));
+            return;
+        default:
+            globals->define(name, std::move(value));
+    }
+}
+
+void op::interpreter::new_cell(const loxc::binding& bind)
+{
+    // A redeclaration assigns into the variable it redeclares, which
+    // closures may already have captured.
+    if (bind.kind == loxc::binding::CELL && ! bind.redeclares)
+    {
+        LOXC_COUNT(cells, 1);
+        cells[cell_base + bind.index] = std::make_shared<Val>();
+    }
+}
+
 Val op::interpreter::operator()(std::shared_ptr<VarExpr> e)
 {
-    return env->get(e->name);
+    return lookup(e->name, e->bind);
 }
 
 Val op::interpreter::operator()(std::shared_ptr<RedefExpr> e)
 {
-    Val value = std::visit(op::interpreter(env), e->value);
-    env->assign(e->name, value);
+    Val value = std::visit(*this, e->value);
+    assign(e->name, e->bind, value);
     return value;
 }
 
 Val op::interpreter::operator()(std::shared_ptr<LogicExpr> e)
 {
-    Val left = std::visit(op::interpreter(env), e->left);
+    Val left = std::visit(*this, e->left);
     if (e->op.type == loxc::OR)
         if (is_truthy(left))
             return left;
     if (e->op.type == loxc::AND)
         if ( ! is_truthy(left) )
             return left;
-    return std::visit(op::interpreter(env), e->right);
+    return std::visit(*this, e->right);
 }
 
 Val op::interpreter::operator()(std::shared_ptr<CallExpr> e)
 {
-    Val callee = std::visit(op::interpreter(env), e->callee);
+    if (auto get = std::get_if<std::shared_ptr<GetExpr>>(&e->callee))
+        return invoke(**get, *e);
+
+    Val callee = std::visit(*this, e->callee);
 
     std::vector<Val> args;
+    args.reserve(e->args.size());
     std::transform(e->args.begin(), e->args.end(), std::back_inserter(args),
-        [this] (Expr in)-> Val { return std::visit(op::interpreter(env), in); } );
+            [this] (Expr in)-> Val { return std::visit(*this, in); } );
 
     if ( ! std::holds_alternative<std::shared_ptr<loxc::callable>>(callee) )
         throw runtime_error(e->closing_paren, "Object is not callable.");
 
-    auto f = std::get<std::shared_ptr<loxc::callable>>(callee);
+    return call_value(*std::get<std::shared_ptr<loxc::callable>>(callee),
+        std::move(args), e->closing_paren);
+}
+
+Val op::interpreter::call_value(const loxc::callable& f, std::vector<Val> args,
+    const loxc::lexeme& where)
+{
+    LOXC_COUNT(calls, 1);
+    stack.push(&f, where);
+    frame_guard guard{stack};
+    globals_guard env(*this, f.env());
 
     try
     {
-        return f->func(args);
+        return f.func(*this, std::move(args));
     } catch (const op::return_stmt& r)
     {
         return r.v;
@@ -137,67 +569,47 @@ Val op::interpreter::operator()(std::shared_ptr<CallExpr> e)
 
 Val op::interpreter::operator()(std::shared_ptr<FunExpr> e)
 {
-    auto closure = env;
-
+    LOXC_COUNT(callables, 1);
     auto f = std::make_shared<loxc::callable>("<anonymous function>", 
-    [closure, e](std::vector<Val> args)-> Val{
-        if (e->params.size() != args.size())
-            throw op::runtime_error(e->closing_paren, 
-            "Wrong number of arguments to function. "
-            "Expected " + std::to_string(e->params.size()) +  
-            " got " + std::to_string(args.size()));
-
-        auto my_env = std::make_shared<Enviroment>();
-        my_env->parent = closure;
-
-        auto params_it = e->params.begin();
-        auto args_it = args.begin();
-        auto end = e->params.end();
-
-        while (params_it < end)
-        {
-            my_env->define(params_it->lexme, *args_it);
-            std::advance(params_it, 1);
-            std::advance(args_it, 1);
-        }
-
-        return std::visit(op::interpreter(my_env), e->body);
-        });
+    [e, captured = capture(e->layout)](op::interpreter& interp, std::vector<Val> args)-> Val{
+        compile_deferred(*e, e->closing_paren);
+        return interp.call(e->layout, e->body, e->code, captured, e->closing_paren,
+            interp.stack.site(), std::move(args));
+        },
+    loxc::callable::lox_function{{env()}, e->span, nullptr, e->layout.captures.empty()});
 
     return f;
 }
 
 Val op::interpreter::operator()(std::shared_ptr<PrintStmt> s)
 {
-    Val value = std::visit(interpreter(env), s->expression);
-    std::cout << value << "\n";
+    Val value = std::visit(*this, s->expression);
+    loxc::output::record line(loxc::out());
+    loxc::out() << value << '\n';
+    loxc::out().sync();
     return std::monostate{};
 }
 
 Val op::interpreter::operator()(std::shared_ptr<FuncStmt> s)
 {
-    auto closure = env;
-
-    auto f = std::make_shared<loxc::callable>(s->name.lexme, 
-    [s, closure](std::vector<Val> args)-> Val{
-        auto my_env = std::make_shared<Enviroment>();
-        my_env->parent = closure;
-
-        auto params_it = s->params.begin();
-        auto args_it = args.begin();
-        auto end = s->params.end();
-
-        while (params_it < end)
-        {
-            my_env->define(params_it->lexme, *args_it);
-            std::advance(params_it, 1);
-            std::advance(args_it, 1);
-        }
-
-        return std::visit(op::interpreter(my_env), s->body);
-        });
-
-    env->define(s->name.lexme, f);
+    LOXC_COUNT(callables, 1);
+
+    // The cell goes first so a recursive function can capture itself. A
+    // function its block declared ahead already has one, see new_cell.
+    new_cell(s->bind);
+
+    auto f = std::make_shared<loxc::callable>(s->name.str(), 
+    [s, captured = capture(s->layout)](op::interpreter& interp, std::vector<Val> args)-> Val{
+        compile_deferred(*s, s->name);
+        return interp.call(s->layout, s->body, s->code, captured, s->name,
+            interp.stack.site(), std::move(args));
+        },
+    loxc::callable::lox_function{{env()}, s->span, s.get(), s->layout.captures.empty()});
+
+    if (s->bind.kind == loxc::binding::CELL)
+        *cells[cell_base + s->bind.index] = f;
+    else
+        declare(s->name.str(), s->bind, f);
     return f;
 }
 
@@ -205,47 +617,77 @@ Val op::interpreter::operator()(std::shared_ptr<ReturnStmt>  s)
 {
     Val value(std::monostate{});
     if ( ! std::holds_alternative<std::monostate>(s->value) )
-        value = std::visit(op::interpreter(std::move(env)), s->value);
+        value = std::visit(*this, s->value);
     throw op::return_stmt(value);
 }
 
+Val op::interpreter::operator()(std::shared_ptr<YieldStmt> s)
+{
+    // Generator bodies run in the vm, so this is top level code.
+    throw op::runtime_error(s->keyword, "Can only yield inside a function.");
+}
+
+Val op::interpreter::operator()(std::shared_ptr<ImportStmt> s)
+{
+    modules::import(*this, s->path, s->keyword);
+    return std::monostate{};
+}
+
 Val op::interpreter::operator()(std::shared_ptr<ExprStmt> s)
 {
-    return std::visit(interpreter(env), s->expression);
+    return std::visit(*this, s->expression);
 }
 
 Val op::interpreter::operator()(std::shared_ptr<VarStmt> s)
 {
+    if (s->bind.kind == loxc::binding::CELL)
+    {
+        // As with functions, a closure in the initializer may capture the
+        // variable being declared.
+        // Hold on to the cell itself: evaluating the initializer may grow
+        // the cell stack.
+        new_cell(s->bind);
+        loxc::cell c = cells[cell_base + s->bind.index];
+        *c = std::visit(*this, s->initializer);
+        return *c;
+    }
+
     Val value = std::monostate{};
     if ( ! std::holds_alternative<std::monostate>(s->initializer) )
-        value = std::visit(interpreter(env), s->initializer);
+        value = std::visit(*this, s->initializer);
     // Throw runtime error here if we want to require variables to have
     // initializers?
 
-    env->define(s->name.lexme, value);
+    declare(s->name.str(), s->bind, value);
 
     return value;
 }
 
 Val op::interpreter::operator()(std::shared_ptr<BlockStmt> s)
 {
-    auto block_env = std::make_shared<Enviroment>();
-    block_env->parent = env;
-    
     Val last(std::monostate{});
 
+    // A block's locals already have their slots and cells in the frame.
+    // Only the functions it declares ahead need boxes up front, to be
+    // captured by the functions declared before them.
+    for (int cell : s->hoisted_cells)
+    {
+        LOXC_COUNT(cells, 1);
+        cells[cell_base + cell] = std::make_shared<Val>();
+    }
+
     for (Stmt& stmt : s->stmt_list)
-        last = std::visit(interpreter(block_env), stmt);
+        last = std::visit(*this, stmt);
 
     return last;
 }
 
 Val op::interpreter::operator()(std::shared_ptr<IfStmt> s)
 {
-    if ( is_truthy(std::visit(interpreter(env), s->condition)) )
-        return std::visit(interpreter(env), s->t_branch);
+    if ( is_truthy(std::visit(*this, s->condition)) )
+        return std::visit(*this, s->t_branch);
     else if ( ! std::holds_alternative<std::monostate>(s->f_branch) )
-        return std::visit(interpreter(env), s->f_branch);
+        return std::visit(*this, s->f_branch);
 
     return std::monostate{};
 }
@@ -254,9 +696,9 @@ Val op::interpreter::operator()(std::shared_ptr<WhileStmt> s)
 {
     Val ret(std::monostate{});
 
-    while ( is_truthy(std::visit(interpreter(env), s->condition)) )
+    while ( is_truthy(std::visit(*this, s->condition)) )
         {
-            ret = std::visit(interpreter(env), s->body);
+            ret = std::visit(*this, s->body);
         }
 
     return ret;
@@ -267,3 +709,237 @@ Val op::interpreter::operator()(std::monostate m)
     return m;
 }
 
+
+/**
+ * OBJECTS
+ */
+
+namespace
+{
+    const std::string* this_name()
+    {
+        static const std::string* name = loxc::intern("this");
+        return name;
+    }
+
+    const std::string* init_name()
+    {
+        static const std::string* name = loxc::intern("init");
+        return name;
+    }
+
+    // A method read off an instance rather than called on it.
+    std::shared_ptr<loxc::callable> bind_method(std::shared_ptr<loxc::instance> self,
+        const loxc::callable* method)
+    {
+        LOXC_COUNT(callables, 1);
+        // The instance keeps its class, and so the method, alive.
+        auto f = std::make_shared<loxc::callable>(method->str,
+        [self = std::move(self), method](op::interpreter& interp, std::vector<Val> args)-> Val{
+            args.insert(args.begin(), self);
+            return method->func(interp, std::move(args));
+            },
+        loxc::callable::bound_method{{method->env()}});
+        return f;
+    }
+}
+
+loxc::property_cache::entry op::interpreter::find_property(const loxc::instance& self,
+    const loxc::lexeme& name, loxc::property_cache& cache)
+{
+    const loxc::property_cache::entry* hit = worker ? nullptr : cache.find(self.layout);
+    if (hit)
+    {
+        LOXC_COUNT(cache_hits, 1);
+        return *hit;
+    }
+
+    LOXC_COUNT(cache_misses, 1);
+    // Fields shadow methods.
+    loxc::property_cache::entry found{self.layout->id(), self.layout->find(name.text), nullptr, nullptr};
+    if (found.slot < 0)
+    {
+        found.method = self.cls->find_method(name.text);
+        if ( ! found.method )
+            throw runtime_error(name, "Undefined property '" + name.str() + "'.");
+    }
+    if ( ! worker )
+        cache.add(found);
+    return found;
+}
+
+Val op::interpreter::operator()(std::shared_ptr<GetExpr> e)
+{
+    Val object = std::visit(*this, e->object);
+    auto self = std::get_if<std::shared_ptr<loxc::instance>>(&object);
+    if ( ! self )
+        throw runtime_error(e->name, "Only instances have properties.");
+
+    loxc::property_cache::entry found = find_property(**self, e->name, e->cache);
+    if (found.slot >= 0)
+    {
+        LOXC_COUNT(value_copies, 1);
+        return (*self)->fields[found.slot];
+    }
+    return bind_method(*self, found.method);
+}
+
+Val op::interpreter::operator()(std::shared_ptr<SetExpr> e)
+{
+    Val object = std::visit(*this, e->object);
+    auto self = std::get_if<std::shared_ptr<loxc::instance>>(&object);
+    if ( ! self )
+        throw runtime_error(e->name, "Only instances have fields.");
+
+    Val value = std::visit(*this, e->value);
+    loxc::instance& target = **self;
+
+    const loxc::property_cache::entry* found = worker ? nullptr : e->cache.find(target.layout);
+    loxc::property_cache::entry miss;
+    if (found)
+        LOXC_COUNT(cache_hits, 1);
+    else
+    {
+        LOXC_COUNT(cache_misses, 1);
+        miss = {target.layout->id(), target.layout->find(e->name.text), nullptr, nullptr};
+        if (miss.slot < 0)
+        {
+            // A new field: the instance moves to the next shape.
+            miss.slot = target.layout->size();
+            miss.to = target.layout->add(e->name.text);
+        }
+        if ( ! worker )
+            e->cache.add(miss);
+        found = &miss;
+    }
+
+    if (found->to)
+    {
+        target.fields.push_back(value);
+        target.layout = found->to;
+    }
+    else
+        target.fields[found->slot] = value;
+    return value;
+}
+
+Val op::interpreter::operator()(std::shared_ptr<SuperExpr> e)
+{
+    Val super = lookup(e->keyword, e->super_bind);
+    Val self = lookup({loxc::THIS, e->keyword.line, this_name()}, e->this_bind);
+
+    // The resolver only binds `super` inside a subclass, where it is
+    // always a class.
+    auto cls = std::get<std::shared_ptr<loxc::callable>>(super)->as<loxc::callable::lox_class>()->cls;
+    const loxc::callable* method = cls->find_method(e->method.text);
+    if ( ! method )
+        throw runtime_error(e->method, "Undefined property '" + e->method.str() + "'.");
+
+    return bind_method(std::get<std::shared_ptr<loxc::instance>>(self), method);
+}
+
+Val op::interpreter::invoke(GetExpr& get, CallExpr& call)
+{
+    Val object = std::visit(*this, get.object);
+    auto self = std::get_if<std::shared_ptr<loxc::instance>>(&object);
+    if ( ! self )
+        throw runtime_error(get.name, "Only instances have properties.");
+
+    loxc::property_cache::entry found = find_property(**self, get.name, get.cache);
+
+    std::vector<Val> args;
+    args.reserve(call.args.size() + 1);
+
+    if (found.slot >= 0)
+    {
+        // A field holding something callable: an ordinary call.
+        Val callee = (*self)->fields[found.slot];
+        for (Expr& arg : call.args)
+            args.push_back(std::visit(*this, arg));
+        if ( ! std::holds_alternative<std::shared_ptr<loxc::callable>>(callee) )
+            throw runtime_error(call.closing_paren, "Object is not callable.");
+        return call_value(*std::get<std::shared_ptr<loxc::callable>>(callee),
+            std::move(args), call.closing_paren);
+    }
+
+    // The instance goes in as `this`, so no bound method is made.
+    args.push_back(std::move(object));
+    for (Expr& arg : call.args)
+        args.push_back(std::visit(*this, arg));
+    return call_value(*found.method, std::move(args), call.closing_paren);
+}
+
+Val op::interpreter::operator()(std::shared_ptr<ClassStmt> s)
+{
+    // The cell goes first so methods can refer to their own class.
+    new_cell(s->bind);
+
+    std::shared_ptr<loxc::klass> super;
+    if ( ! std::holds_alternative<std::monostate>(s->superclass) )
+    {
+        Val value = std::visit(*this, s->superclass);
+        auto f = std::get_if<std::shared_ptr<loxc::callable>>(&value);
+        auto c = f ? (*f)->as<loxc::callable::lox_class>() : nullptr;
+        if ( ! c )
+            throw runtime_error(s->name, "Superclass must be a class.");
+        super = c->cls;
+        declare("super", s->super_bind, std::move(value));
+    }
+
+    auto cls = std::make_shared<loxc::klass>(s->name.str(), std::move(super));
+    if (cls->super)
+        cls->shareable = cls->super->shareable;
+    for (const std::shared_ptr<FuncStmt>& m : s->methods)
+    {
+        // Capturing `super` is harmless, as nothing can assign it.
+        for (const loxc::capture& c : m->layout.captures)
+            if ( ! (c.local && s->super_bind.kind == loxc::binding::CELL &&
+                    c.index == s->super_bind.index) )
+                cls->shareable = false;
+
+        LOXC_COUNT(callables, 1);
+        bool initializer = m->name.text == init_name();
+        auto f = std::make_shared<loxc::callable>(s->name.str() + "." + m->name.str(),
+        [m, initializer, captured = capture(m->layout)](op::interpreter& interp, std::vector<Val> args)-> Val{
+            if ( ! initializer )
+                return interp.call(m->layout, m->body, m->code, captured, m->name,
+                    interp.stack.site(), std::move(args));
+
+            // init always hands back the instance.
+            Val self = args[0];
+            try
+            {
+                interp.call(m->layout, m->body, m->code, captured, m->name,
+                    interp.stack.site(), std::move(args));
+            } catch (const op::return_stmt&) {}
+            return self;
+            },
+        loxc::callable::method{{env()}});
+        cls->methods[m->name.text] = std::move(f);
+    }
+
+    LOXC_COUNT(callables, 1);
+    // Calling the class makes an instance and runs init on it.
+    auto f = std::make_shared<loxc::callable>(s->name.str(),
+    [cls](op::interpreter& interp, std::vector<Val> args)-> Val{
+        LOXC_COUNT(instances, 1);
+        auto self = std::make_shared<loxc::instance>(cls);
+        if (const loxc::callable* init = cls->find_method(init_name()))
+        {
+            args.insert(args.begin(), self);
+            init->func(interp, std::move(args));
+        }
+        else if ( ! args.empty() )
+            throw op::runtime_error(interp.stack.site(),
+            "Wrong number of arguments to function. "
+            "Expected 0 got " + std::to_string(args.size()));
+        return self;
+        },
+    loxc::callable::lox_class{{env()}, cls});
+
+    if (s->bind.kind == loxc::binding::CELL)
+        *cells[cell_base + s->bind.index] = f;
+    else
+        declare(s->name.str(), s->bind, f);
+    return f;
+}
@@ -4,16 +4,34 @@
 
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <initializer_list>
 
 #include "expr.h"
 #include "val.h"
 #include "stmt.h"
-#include "enviroment.h"
+#include "token.h"
+#include "binding.h"
+#include "globals.h"
+#include "call_stack.h"
+#include "vm.h"
 
 namespace op
 {
 
+struct runtime_error : public std::runtime_error
+{
+    using std::runtime_error::runtime_error;
+    loxc::lexeme where;
+    // The lox backtrace at the point of the error. Empty unless the
+    // error chose to record one.
+    std::string trace;
+    runtime_error(loxc::lexeme w, const char* what)
+        : std::runtime_error(what), where(std::move(w)) {}
+    runtime_error(loxc::lexeme w, std::string what)
+        : std::runtime_error(what.c_str()), where(std::move(w)) {}
+};
+
 struct return_stmt : public std::runtime_error
 {
     using std::runtime_error::runtime_error;
@@ -23,14 +41,111 @@ struct return_stmt : public std::runtime_error
     v(std::move(v)) {}
 };
 
+/**
+ * A call to a generator function, a function whose body yields. Its frame
+ * lives here rather than on the interpreter's value stack so that it
+ * survives from one resumption to the next; each resumption swaps it in
+ * as the running frame and runs the body's code from where it stopped.
+ */
+struct generator
+{
+    std::shared_ptr<vm::chunk> code;
+    std::vector<loxc::cell> captured;
+    std::vector<Val> values;
+    std::vector<loxc::cell> cells;
+    vm::resume_point at;
+    // the function's name, which errors resuming it are reported at.
+    loxc::lexeme where;
+    bool running = false;
+    bool done = false;
+};
+
+/**
+ * The interpreter is long lived: one instance executes a whole program,
+ * visiting nodes with itself. It owns the call stack and the value stack.
+ *
+ * Each call gets a contiguous frame on `values` (starting at `base`) for
+ * its locals that no closure captures, and a frame on `cells` (starting
+ * at `cell_base`) for the cells of those that are. `upvalues` are the
+ * cells the running closure captured. See resolve.h for how names are
+ * assigned to each.
+ */
 struct interpreter
 {
-    std::shared_ptr<Enviroment> env;
+    using upvalue_list = std::vector<loxc::cell>;
+
+    // The table global names are looked up in. That is home, the one the
+    // interpreter was made with, except while a function a module defined
+    // runs, when it is the module's. See modules.h.
+    Globals* globals;
+    Globals* home;
+    call_stack stack;
+
+    std::vector<Val> values;
+    size_t base = 0;
+    std::vector<loxc::cell> cells;
+    size_t cell_base = 0;
+    const upvalue_list* upvalues = nullptr;
+
+    // How function bodies and programs run, whether the vm compiles
+    // them with superinstructions, and whether numeric functions also get
+    // register code. See vm.h and numeric.h.
+    vm::mode exec = vm::THREADED;
+    bool superinstructions = true;
+    bool numeric = true;
+    // Whether the vm inlines calls to small top level functions, and the
+    // functions the programs run so far declared. See vm::inline_table.
+    bool inlining = true;
+    vm::inline_table inlinable;
+    // Whether this runs a spawned call on a worker thread, sharing the
+    // syntax tree with other threads. A worker leaves the tree's caches
+    // alone and keeps the chunks it compiles here. See parallel.h.
+    bool worker = false;
+    std::unordered_map<const Stmt*, std::shared_ptr<vm::chunk>> own_chunks;
 
-    interpreter(std::shared_ptr<Enviroment> parent_in)
-    : env(parent_in)
+    interpreter(Globals& globals_in,
+        size_t max_stack = call_stack::default_max_depth)
+    : globals(&globals_in), home(&globals_in), stack(max_stack)
     {}
 
+    /**
+     * Runs a resolved program at the top level.
+     *
+     * @param layout the frame the resolver asked for.
+     */
+    Val run(std::vector<Stmt>& program, const loxc::function_layout& layout);
+
+    /**
+     * Calls a lox function: runs body in a fresh frame with the arguments
+     * bound to the parameters and `captured` as the closure's upvalues.
+     * Unless walking the tree, body is compiled into code on the first
+     * call. `where` names the function and `site` is the call, which a
+     * wrong number of arguments is reported at.
+     */
+    Val call(const loxc::function_layout& layout, const Stmt& body,
+        std::shared_ptr<vm::chunk>& code, const upvalue_list& captured,
+        const loxc::lexeme& where, const loxc::lexeme& site, std::vector<Val> args);
+
+    // The globals a function defined now runs against, for its env: null
+    // for home, whichever interpreter calls it.
+    Globals* env() const { return globals == home ? nullptr : globals; }
+
+    // The cells a new closure with this layout captures from the
+    // running frame.
+    upvalue_list capture(const loxc::function_layout& layout);
+
+    /**
+     * Runs g until it next yields, returning what it yielded. Once its
+     * body returns, g is done: that call returns what the body did, and
+     * later ones nil.
+     */
+    Val resume(generator& g);
+    // A call to a generator function: binds the arguments in a frame of
+    // the generator's own and hands back the generator.
+    Val generate(const loxc::function_layout& layout, const Stmt& body,
+        std::shared_ptr<vm::chunk>& code, const upvalue_list& captured,
+        const loxc::lexeme& where, std::vector<Val> args);
+
     // Expressions
     Val operator()(std::shared_ptr<BinaryExpr> e);
     Val operator()(std::shared_ptr<GroupingExpr> e);
@@ -39,6 +154,9 @@ struct interpreter
     Val operator()(std::shared_ptr<VarExpr> e);
     Val operator()(std::shared_ptr<RedefExpr> e);
     Val operator()(std::shared_ptr<LogicExpr> e);
+    Val operator()(std::shared_ptr<GetExpr> e);
+    Val operator()(std::shared_ptr<SetExpr> e);
+    Val operator()(std::shared_ptr<SuperExpr> e);
     Val operator()(std::shared_ptr<CallExpr> e);
     Val operator()(std::shared_ptr<FunExpr> e);
 
@@ -54,11 +172,31 @@ struct interpreter
     Val operator()(std::shared_ptr<WhileStmt> s);
     Val operator()(std::shared_ptr<FuncStmt> s);
     Val operator()(std::shared_ptr<ReturnStmt> s);
+    Val operator()(std::shared_ptr<YieldStmt> s);
+    Val operator()(std::shared_ptr<ImportStmt> s);
+    Val operator()(std::shared_ptr<ClassStmt> s);
 
     // std::monostate is roughly equal to null.
     Val operator()(std::monostate);
         
-    inline void assert_numeric(loxc::token op, const Val& v1, const Val& v2)
+    // Calls f on the call stack, catching what it returns.
+    Val call_value(const loxc::callable& f, std::vector<Val> args,
+        const loxc::lexeme& where);
+    // A method call site: calls the method without binding it first.
+    Val invoke(GetExpr& get, CallExpr& call);
+    // What name means on an instance, looked up through the site's cache.
+    loxc::property_cache::entry find_property(const loxc::instance& self,
+        const loxc::lexeme& name, loxc::property_cache& cache);
+
+    // Reads and writes of a resolved name.
+    Val lookup(const loxc::lexeme& name, loxc::binding& bind);
+    void assign(const loxc::lexeme& name, loxc::binding& bind, Val value);
+    void declare(const std::string& name, const loxc::binding& bind, Val value);
+    // Gives a captured variable a fresh cell, so that closures made
+    // before this declaration ran keep their own copy.
+    void new_cell(const loxc::binding& bind);
+
+    inline void assert_numeric(loxc::lexeme op, const Val& v1, const Val& v2)
     {
         if (!std::holds_alternative<double>(v1) || 
             !std::holds_alternative<double>(v2))
@@ -66,6 +204,15 @@ struct interpreter
     }
 };
 
+/**
+ * Where a builtin's errors are reported: its name, at the line of the
+ * call to it.
+ */
+loxc::lexeme builtin_site(const interpreter& interp, const char* builtin);
+
+// An error raised by the builtin named builtin. See builtin_site.
+runtime_error builtin_error(const interpreter& interp, const char* builtin, std::string what);
+
 } // namespace op
 
 #undef DECLARE_EXPR_VISITOR
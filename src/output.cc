@@ -0,0 +1,82 @@
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "output.h"
+#include "number.h"
+
+namespace
+{
+    // Writes all of data, retrying short and interrupted writes. Errors
+    // such as a closed pipe drop the output; there is no one to tell.
+    void write_all(int fd, const char* data, size_t size)
+    {
+        while (size)
+        {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return;
+            }
+            data += n;
+            size -= n;
+        }
+    }
+}
+
+void loxc::output::write(const char* data, size_t size)
+{
+    if (size <= capacity - used)
+    {
+        std::memcpy(buf + used, data, size);
+        used += size;
+        return;
+    }
+
+    flush();
+    // Too big to be worth copying, send it straight out.
+    if (size >= capacity)
+        write_all(fd, data, size);
+    else
+    {
+        std::memcpy(buf, data, size);
+        used = size;
+    }
+}
+
+void loxc::output::flush()
+{
+    write_all(fd, buf, used);
+    used = 0;
+}
+
+loxc::output& loxc::output::operator<<(double d)
+{
+    char tmp[number_buffer_size];
+    write(tmp, format_number(d, tmp));
+    return *this;
+}
+
+loxc::output& loxc::output::operator<<(size_t n)
+{
+    char tmp[24];
+    write(tmp, std::to_chars(tmp, tmp + sizeof(tmp), n).ptr - tmp);
+    return *this;
+}
+
+loxc::output& loxc::output::operator<<(int n)
+{
+    char tmp[16];
+    write(tmp, std::to_chars(tmp, tmp + sizeof(tmp), n).ptr - tmp);
+    return *this;
+}
+
+loxc::output& loxc::out()
+{
+    static output stdout_writer(STDOUT_FILENO);
+    return stdout_writer;
+}
@@ -0,0 +1,108 @@
+// buffered writer that everything loxc prints goes through.
+#ifndef output_h
+#define output_h
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace loxc
+{
+
+/**
+ * Collects output in a large user space buffer and hands it to write(2)
+ * in big chunks, skipping iostreams entirely. Output is flushed when the
+ * buffer fills and at explicit points: on exit, before the REPL prompt
+ * waits for input, after a runtime error and from lox via flush().
+ *
+ * When unbuffered, every record (a printed line or an error) is written
+ * out as soon as it is complete.
+ *
+ * Once shared between threads, each record is written holding a lock (see
+ * record), so lines from different threads never interleave.
+ */
+class output
+{
+public:
+    static constexpr size_t capacity = 1 << 16;
+
+    explicit output(int fd) : fd(fd) {}
+    ~output() { flush(); }
+
+    output(const output&) = delete;
+    output& operator=(const output&) = delete;
+
+    void write(const char* data, size_t size);
+    void flush();
+
+    // Marks the end of a record, flushing it if output is unbuffered.
+    void sync()
+    {
+        if ( ! buffered )
+            flush();
+    }
+
+    void set_buffered(bool b) { buffered = b; }
+
+    // From now on records lock. Call before a second thread can print.
+    void share() { shared = true; }
+
+    /**
+     * Holds the writer for the length of a record, if shared.
+     */
+    class record
+    {
+    public:
+        explicit record(output& o) : o(o)
+        {
+            if (o.shared)
+                o.lock.lock();
+        }
+        ~record()
+        {
+            if (o.shared)
+                o.lock.unlock();
+        }
+
+        record(const record&) = delete;
+        record& operator=(const record&) = delete;
+
+    private:
+        output& o;
+    };
+
+    output& operator<<(std::string_view s)
+    {
+        write(s.data(), s.size());
+        return *this;
+    }
+    // Spelled out so strings never convert to a Val instead.
+    output& operator<<(const char* s) { return *this << std::string_view(s); }
+    output& operator<<(const std::string& s) { return *this << std::string_view(s); }
+    output& operator<<(char c)
+    {
+        if (used == capacity)
+            flush();
+        buf[used++] = c;
+        return *this;
+    }
+    output& operator<<(double d);
+    output& operator<<(size_t n);
+    output& operator<<(int n);
+
+private:
+    int fd;
+    bool buffered = true;
+    bool shared = false;
+    std::mutex lock;
+    size_t used = 0;
+    char buf[capacity];
+};
+
+// The writer for standard out.
+output& out();
+
+} // namespace loxc
+
+#endif
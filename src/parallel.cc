@@ -0,0 +1,514 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+
+#include <pthread.h>
+
+#include "parallel.h"
+#include "array.h"
+#include "callable.h"
+#include "globals.h"
+#include "object.h"
+#include "op.h"
+#include "output.h"
+#include "stats.h"
+
+namespace parallel
+{
+
+/**
+ * A spawned call: what to run, the world it runs in, and once done, what
+ * came of it.
+ */
+struct task
+{
+    std::shared_ptr<loxc::callable> f;
+    std::vector<Val> args;
+    std::unique_ptr<Globals> globals;
+
+    // the spawning interpreter's settings.
+    vm::mode exec;
+    bool superinstructions;
+    bool numeric;
+    size_t max_stack;
+
+    // Copies of the modules' globals its functions run against, made as
+    // they are reached, and for each copy, the table it was taken from,
+    // which functions coming back run against again.
+    std::vector<std::unique_ptr<Globals>> envs;
+    std::unordered_map<const Globals*, Globals*> origins;
+
+    std::atomic<bool> done{false};
+    Val result;
+    std::optional<op::runtime_error> error;
+};
+
+} // namespace parallel
+
+namespace
+{
+    using job = std::shared_ptr<parallel::task>;
+
+    const char* closure_message = "Functions that capture variables can't cross threads.";
+    const char* generator_message = "Generators can't be spawned or cross threads.";
+
+    // Why f can't cross threads, given it isn't shareable.
+    const char* unshareable(const loxc::callable& f)
+    {
+        return f.as<loxc::callable::generator>() ? generator_message : closure_message;
+    }
+
+    /**
+     * Deep copies values for another thread. Instances are copied field by
+     * field, lists and maps item by item and arrays whole, once each
+     * however often they are reached, so shared structure and cycles
+     * survive the trip.
+     *
+     * Functions a module defined are rebound to the table in `tables`
+     * that stands for their module's globals. Copying for a spawn, the
+     * table is a copy the task owns, made the first time the module is
+     * reached; copying a result back, it is the table the copy was taken
+     * from.
+     */
+    class copier
+    {
+    public:
+        copier(const op::interpreter& interp, const char* builtin)
+        : interp(interp), builtin(builtin) {}
+
+        // When set, where copies of module globals go.
+        parallel::task* owner = nullptr;
+        std::unordered_map<const Globals*, Globals*> tables;
+
+        Val operator()(const Val& v)
+        {
+            if (auto f = std::get_if<std::shared_ptr<loxc::callable>>(&v))
+            {
+                if ( ! (*f)->shareable() )
+                    throw op::builtin_error(interp, builtin, unshareable(**f));
+                return rebind(*f);
+            }
+            if (auto i = std::get_if<std::shared_ptr<loxc::instance>>(&v))
+                return copy(*i);
+            if (auto a = std::get_if<std::shared_ptr<loxc::float64_array>>(&v))
+                return copy(*a);
+            if (auto l = std::get_if<std::shared_ptr<loxc::list>>(&v))
+                return copy(*l);
+            if (auto m = std::get_if<std::shared_ptr<loxc::map>>(&v))
+                return copy(*m);
+            return v;
+        }
+
+        /**
+         * A copy of the global name's value. A closure can't be copied,
+         * but an unrelated function it sits next to shouldn't stop the
+         * call, so it becomes a stub that raises the error when called.
+         */
+        Val global(const std::string& name, const Val& v)
+        {
+            auto f = std::get_if<std::shared_ptr<loxc::callable>>(&v);
+            if ( ! f || (*f)->shareable() )
+                return (*this)(v);
+
+            return std::make_shared<loxc::callable>((*f)->str,
+            [name = loxc::intern(name), why = unshareable(**f)](op::interpreter& interp, std::vector<Val>)-> Val{
+                throw op::runtime_error(loxc::lexeme{loxc::ID, interp.stack.line(), name}, why);
+                });
+        }
+
+    private:
+        std::shared_ptr<loxc::callable> rebind(const std::shared_ptr<loxc::callable>& f)
+        {
+            if ( ! f->env() )
+                return f;
+            Globals* to = env(f->env());
+            if ( ! to || to == f->env() )
+                return f;
+            std::shared_ptr<loxc::callable>& made = functions[f.get()];
+            if ( ! made )
+            {
+                made = std::make_shared<loxc::callable>(*f);
+                made->rebind(to);
+            }
+            return made;
+        }
+
+        Globals* env(Globals* from)
+        {
+            auto found = tables.find(from);
+            if (found != tables.end())
+                return found->second;
+            if ( ! owner )
+                return nullptr;
+            Globals* to = owner->envs.emplace_back(std::make_unique<Globals>()).get();
+            tables[from] = to;
+            owner->origins[to] = from;
+            from->for_each([&](const std::string& name, const Val& v) {
+                to->define(name, global(name, v));
+            });
+            return to;
+        }
+
+        std::shared_ptr<loxc::instance> copy(const std::shared_ptr<loxc::instance>& from)
+        {
+            std::shared_ptr<loxc::instance>& to = copies[from.get()];
+            if (to)
+                return to;
+            if ( ! from->cls->shareable )
+                throw op::builtin_error(interp, builtin, closure_message);
+
+            to = std::make_shared<loxc::instance>(from->cls);
+            to->layout = from->layout;
+            // The reference into the table goes stale as it grows.
+            std::shared_ptr<loxc::instance> made = to;
+            made->fields.reserve(from->fields.size());
+            for (const Val& field : from->fields)
+                made->fields.push_back((*this)(field));
+            return made;
+        }
+
+        std::shared_ptr<loxc::list> copy(const std::shared_ptr<loxc::list>& from)
+        {
+            std::shared_ptr<loxc::list>& to = lists[from.get()];
+            if (to)
+                return to;
+            to = std::make_shared<loxc::list>();
+            std::shared_ptr<loxc::list> made = to;
+            made->items.reserve(from->items.size());
+            for (const Val& item : from->items)
+                made->items.push_back((*this)(item));
+            return made;
+        }
+
+        std::shared_ptr<loxc::map> copy(const std::shared_ptr<loxc::map>& from)
+        {
+            std::shared_ptr<loxc::map>& to = maps[from.get()];
+            if (to)
+                return to;
+            to = std::make_shared<loxc::map>();
+            std::shared_ptr<loxc::map> made = to;
+            made->index = from->index;
+            made->entries.reserve(from->entries.size());
+            for (const auto& [key, value] : from->entries)
+                made->entries.emplace_back(key, (*this)(value));
+            return made;
+        }
+
+        std::shared_ptr<loxc::float64_array> copy(const std::shared_ptr<loxc::float64_array>& from)
+        {
+            std::shared_ptr<loxc::float64_array>& to = arrays[from.get()];
+            if ( ! to )
+            {
+                to = std::make_shared<loxc::float64_array>(from->size());
+                std::copy(from->data(), from->data() + from->size(), to->data());
+            }
+            return to;
+        }
+
+        const op::interpreter& interp;
+        const char* builtin;
+        std::unordered_map<const loxc::float64_array*, std::shared_ptr<loxc::float64_array>> arrays;
+        std::unordered_map<const loxc::list*, std::shared_ptr<loxc::list>> lists;
+        std::unordered_map<const loxc::map*, std::shared_ptr<loxc::map>> maps;
+        std::unordered_map<const loxc::instance*, std::shared_ptr<loxc::instance>> copies;
+        std::unordered_map<const loxc::callable*, std::shared_ptr<loxc::callable>> functions;
+    };
+
+    void run(parallel::task& t);
+
+    /**
+     * Worker threads with a deque of jobs each, plus the shared queue for
+     * jobs spawned from outside. Deques are guarded by a mutex of their
+     * own; a job is many thousands of instructions of lox, next to which
+     * an uncontended lock is noise.
+     */
+    class pool
+    {
+    public:
+        pool(size_t threads, size_t stack_bytes)
+        {
+            for (size_t i = 0; i < threads; ++i)
+            {
+                queues.push_back(std::make_unique<queue>());
+                workers.push_back(std::make_unique<worker>(worker{this, i, {}}));
+            }
+            queues.push_back(std::make_unique<queue>());
+
+            // Workers only ever read the tables above, so they are filled
+            // in before the first starts.
+            pthread_attr_t attr;
+            pthread_attr_init(&attr);
+            pthread_attr_setstacksize(&attr, stack_bytes);
+            while (running < threads &&
+                pthread_create(&workers[running]->thread, &attr, entry, workers[running].get()) == 0)
+                ++running;
+            pthread_attr_destroy(&attr);
+        }
+
+        ~pool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(sleep);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (size_t i = 0; i < running; ++i)
+                pthread_join(workers[i]->thread, nullptr);
+        }
+
+        // Whether there are threads to run jobs on at all.
+        bool started() const { return running > 0; }
+
+        void submit(job j)
+        {
+            queue& q = self && self->owner == this ? *queues[self->index] : *queues.back();
+            {
+                std::lock_guard<std::mutex> lock(q.lock);
+                q.jobs.push_back(std::move(j));
+            }
+            ++queued;
+            {
+                std::lock_guard<std::mutex> lock(sleep);
+            }
+            wake.notify_one();
+        }
+
+        // Runs other jobs until t is done.
+        void wait(const parallel::task& t)
+        {
+            while ( ! t.done.load(std::memory_order_acquire) )
+            {
+                if (job j = take())
+                {
+                    run(*j);
+                    finished();
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(sleep);
+                wake.wait(lock, [&]{
+                    return t.done.load(std::memory_order_acquire) || queued > 0;
+                });
+            }
+        }
+
+    private:
+        struct queue
+        {
+            std::mutex lock;
+            std::deque<job> jobs;
+        };
+
+        struct worker
+        {
+            pool* owner;
+            size_t index;
+            pthread_t thread;
+        };
+
+        static void* entry(void* arg)
+        {
+            self = static_cast<worker*>(arg);
+            self->owner->work();
+            loxc::stats::merge();
+            return nullptr;
+        }
+
+        void work()
+        {
+            for (;;)
+            {
+                if (job j = take())
+                {
+                    run(*j);
+                    finished();
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(sleep);
+                wake.wait(lock, [&]{ return stopping || queued > 0; });
+                if (stopping)
+                    return;
+            }
+        }
+
+        /**
+         * The next job for this thread: the newest of its own, else the
+         * oldest spawned from outside, else the oldest of another worker's.
+         */
+        job take()
+        {
+            size_t n = workers.size();
+            size_t mine = self && self->owner == this ? self->index : n;
+
+            if (mine < n)
+                if (job j = pop(*queues[mine], false))
+                    return j;
+            if (job j = pop(*queues.back(), true))
+                return j;
+            for (size_t k = 1; k <= n; ++k)
+            {
+                size_t victim = (mine + k) % n;
+                if (victim != mine)
+                    if (job j = pop(*queues[victim], true))
+                        return j;
+            }
+            return nullptr;
+        }
+
+        job pop(queue& q, bool front)
+        {
+            std::lock_guard<std::mutex> lock(q.lock);
+            if (q.jobs.empty())
+                return nullptr;
+            job j;
+            if (front)
+            {
+                j = std::move(q.jobs.front());
+                q.jobs.pop_front();
+            }
+            else
+            {
+                j = std::move(q.jobs.back());
+                q.jobs.pop_back();
+            }
+            --queued;
+            return j;
+        }
+
+        // Wakes whoever waits on the job just run.
+        void finished()
+        {
+            {
+                std::lock_guard<std::mutex> lock(sleep);
+            }
+            wake.notify_all();
+        }
+
+        static thread_local worker* self;
+
+        // one per worker, then the shared queue.
+        std::vector<std::unique_ptr<queue>> queues;
+        std::vector<std::unique_ptr<worker>> workers;
+        size_t running = 0;
+        std::atomic<size_t> queued{0};
+        std::mutex sleep;
+        std::condition_variable wake;
+        bool stopping = false;
+    };
+
+    thread_local pool::worker* pool::self = nullptr;
+
+    void run(parallel::task& t)
+    {
+        op::interpreter interp(*t.globals, t.max_stack);
+        interp.exec = t.exec;
+        interp.superinstructions = t.superinstructions;
+        interp.numeric = t.numeric;
+        interp.inlining = false;
+        interp.worker = true;
+
+        try
+        {
+            t.result = interp.call_value(*t.f, std::move(t.args),
+                loxc::lexeme{loxc::ID, 0, loxc::intern("spawn")});
+        } catch (const op::runtime_error& e)
+        {
+            t.error = e;
+        } catch (const std::exception& e)
+        {
+            t.error = op::runtime_error(loxc::lexeme{loxc::ID, 0, loxc::intern("spawn")},
+                e.what());
+        }
+        t.f.reset();
+        t.globals.reset();
+        t.done.store(true, std::memory_order_release);
+    }
+
+    size_t threads = 0;
+    size_t stack_bytes = 0;
+    std::once_flag started;
+    std::unique_ptr<pool> workers;
+
+    pool& the_pool()
+    {
+        std::call_once(started, []{
+            loxc::out().share();
+            size_t n = threads ? threads : std::thread::hardware_concurrency();
+            workers = std::make_unique<pool>(n ? n : 1, stack_bytes);
+        });
+        return *workers;
+    }
+}
+
+void parallel::configure(size_t n, size_t bytes)
+{
+    threads = n;
+    stack_bytes = bytes;
+}
+
+void parallel::shutdown()
+{
+    workers.reset();
+}
+
+Val parallel::spawn(op::interpreter& interp, std::vector<Val> args)
+{
+    if (args.empty() || ! std::holds_alternative<std::shared_ptr<loxc::callable>>(args[0]))
+        throw op::builtin_error(interp, "spawn", "Can only spawn a function.");
+
+    auto t = std::make_shared<task>();
+    t->globals = std::make_unique<Globals>();
+    copier copy(interp, "spawn");
+    copy.owner = t.get();
+    // Spawned while a module loads, its globals are the ones copied.
+    Globals* home = interp.home ? interp.home : interp.globals;
+    if ( ! interp.home )
+    {
+        copy.tables[home] = t->globals.get();
+        t->origins[t->globals.get()] = home;
+    }
+
+    t->f = std::get<std::shared_ptr<loxc::callable>>(copy(args[0]));
+    for (size_t i = 1; i < args.size(); ++i)
+        t->args.push_back(copy(args[i]));
+    home->for_each([&](const std::string& name, const Val& v) {
+        t->globals->define(name, copy.global(name, v));
+    });
+    t->exec = interp.exec;
+    t->superinstructions = interp.superinstructions;
+    t->numeric = interp.numeric;
+    t->max_stack = interp.stack.limit();
+
+    pool& p = the_pool();
+    if (p.started())
+        p.submit(t);
+    else
+        run(*t);
+
+    // Calling the future joins it too.
+    auto future = std::make_shared<loxc::callable>("<future>",
+    [t](op::interpreter& interp, std::vector<Val>)-> Val{
+        the_pool().wait(*t);
+        if (t->error)
+            throw *t->error;
+        copier copy(interp, "join");
+        copy.tables.insert(t->origins.begin(), t->origins.end());
+        return copy(t->result);
+        },
+    loxc::callable::future{t});
+    return future;
+}
+
+Val parallel::join(op::interpreter& interp, std::vector<Val> args)
+{
+    auto f = args.size() == 1 ? std::get_if<std::shared_ptr<loxc::callable>>(&args[0]) : nullptr;
+    if ( ! f || ! (*f)->as<loxc::callable::future>() )
+        throw op::builtin_error(interp, "join", "Can only join a future.");
+    return (*f)->func(interp, {});
+}
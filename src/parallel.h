@@ -0,0 +1,61 @@
+// running lox functions in parallel on a work stealing thread pool.
+#ifndef parallel_h
+#define parallel_h
+
+#include <cstddef>
+#include <vector>
+
+#include "val.h"
+
+namespace op
+{
+    struct interpreter;
+}
+
+/**
+ * spawn(f, args...) queues a call to f on a pool of worker threads and
+ * hands back a future; join(future) waits for the call and returns its
+ * value, or raises its error. A thread waiting in join runs other queued
+ * calls meanwhile, so recursive divide and conquer never starves the pool.
+ *
+ * Each worker keeps a deque of calls: it pushes and pops its own at the
+ * back and, when it runs dry, steals from the front of the others', where
+ * the oldest, and so usually largest, pieces of work are. Calls spawned
+ * from outside the pool go on a shared queue that workers take from.
+ *
+ * Threads share nothing mutable. A call runs in an interpreter of its own
+ * over a copy of the globals taken when it was spawned, and of those of
+ * any module whose functions it reaches; its arguments and its result
+ * are deep copied on the way across. Functions are shared, as
+ * the code they run never changes, except closures over variables, whose
+ * cells can't be copied: passing one is an error, and one in the globals
+ * raises that error when the call tries to use it.
+ *
+ * Syntax trees are shared too, so a call leaves alone everything cached
+ * in them: it compiles chunks of its own and skips the inline caches at
+ * property sites and in the tree walker's global reads.
+ */
+namespace parallel
+{
+
+/**
+ * Sizes the pool, which starts on the first spawn.
+ *
+ * @param threads workers to run; 0 for one per core.
+ * @param stack_bytes native stack for each worker.
+ */
+void configure(size_t threads, size_t stack_bytes);
+
+/**
+ * Waits for every spawned call, joined or not, to finish, then stops the
+ * pool.
+ */
+void shutdown();
+
+// The builtins. args as lox passed them.
+Val spawn(op::interpreter& interp, std::vector<Val> args);
+Val join(op::interpreter& interp, std::vector<Val> args);
+
+} // namespace parallel
+
+#endif
@@ -9,13 +9,50 @@
 #include "expr.h"
 #include "reporter.h"
 #include "stmt.h"
+#include "stats.h"
+
+// Every node the parser builds goes through here so it can be counted.
+// While only checking syntax it builds nothing: the null node it returns
+// still says what kind of node the rule parsed, which is all the rules
+// above it look at then.
+template <typename T, typename... Args>
+std::shared_ptr<T> Parser::make_node(Args&&... args)
+{
+    if ( ! building )
+        return nullptr;
+    LOXC_COUNT(nodes, 1);
+    return std::make_shared<T>(std::forward<Args>(args)...);
+}
+
+namespace
+{
+    // Sets a flag for its lifetime, then restores what it was.
+    struct scoped_flag
+    {
+        bool& flag;
+        bool saved;
+        scoped_flag(bool& flag, bool value) : flag(flag), saved(flag) { flag = value; }
+        ~scoped_flag() { flag = saved; }
+    };
+
+    // Counts the blocks and function bodies, or the statements and
+    // expressions, the parser is inside of.
+    struct nested
+    {
+        int& depth;
+        explicit nested(int& depth) : depth(depth) { ++depth; }
+        ~nested() { --depth; }
+    };
+}
 
-std::optional<std::vector<Stmt>> Parser::parse(std::vector<loxc::token> in)
+std::optional<std::vector<Stmt>> Parser::parse(loxc::token_list in)
 {
     had_error = false;
 
-    tokens = std::move(in);
-    current = tokens.begin();
+    input = std::make_shared<const loxc::token_list>(std::move(in));
+    current = input->tokens.cbegin();
+    nesting = 0;
+    depth = 0;
     std::vector<Stmt> stmt_list;
 
     while ( ! isAtEnd() )
@@ -30,6 +67,8 @@ Stmt Parser::declaration()
     {
         if (match(loxc::VAR))
             return variableDeclaration();
+        if (match(loxc::CLASS))
+            return classDeclaration();
 
         return statement();
     }
@@ -43,19 +82,46 @@ Stmt Parser::declaration()
 
 Stmt Parser::variableDeclaration()
 {
-    loxc::token name = consume(loxc::ID, "Expected a variable name.");
+    loxc::lexeme name = lexeme(consume(loxc::ID, "Expected a variable name."));
 
     Expr init = std::monostate{};
     if (match(loxc::EQUAL))
         init = expression();
 
     consume(loxc::SEMICOLON, "Expected a semicolon after variable declaration");
-    return std::make_shared<VarStmt>(std::move(name), std::move(init));
+    return make_node<VarStmt>(std::move(name), std::move(init));
+}
+
+Stmt Parser::classDeclaration()
+{
+    loxc::lexeme name = lexeme(consume(loxc::ID, "Expected a class name."));
+
+    Expr superclass = std::monostate{};
+    if (match(loxc::LESS))
+        superclass = make_node<VarExpr>(lexeme(consume(loxc::ID, "Expected a superclass name.")));
+
+    consume(loxc::LEFT_BRACE, "Expected '{' before class body.");
+
+    // Methods are resolved with the class around them, so are never
+    // deferred.
+    nested n(nesting);
+    std::vector<std::shared_ptr<FuncStmt>> methods;
+    while ( ! (check(loxc::RIGHT_BRACE) || isAtEnd()) )
+        methods.push_back(std::get<std::shared_ptr<FuncStmt>>(funcStatement()));
+
+    consume(loxc::RIGHT_BRACE, "Expected '}' after class body.");
+    return make_node<ClassStmt>(std::move(name), std::move(superclass), std::move(methods));
 }
 
 Stmt Parser::statement()
 {
+    nested d(depth);
+    if (depth > max_depth)
+        throw error(peek(), "Statements nest too deeply.");
+
     if (match(loxc::RETURN)) return returnStatement();
+    if (match(loxc::YIELD)) return yieldStatement();
+    if (match(loxc::IMPORT)) return importStatement();
     if (match(loxc::FUN)) return funcStatement();
     if (match(loxc::PRINT)) return printStatement();
     if (match(loxc::LEFT_BRACE)) return blockStatement();
@@ -70,46 +136,81 @@ Stmt Parser::printStatement()
 {
     Expr value = expression();
     consume(loxc::SEMICOLON, "Expected ; after print statment.");
-    return std::make_shared<PrintStmt>(std::move(value));
+    return make_node<PrintStmt>(std::move(value));
 }
 
 Stmt Parser::funcStatement()
 {
-    loxc::token name = consume(loxc::ID, "Expected a function name.");
-    consume(loxc::LEFT_PAREN, "Expected opening '(' after function definition.");
+    loxc::lexeme name = lexeme(consume(loxc::ID, "Expected a function name."));
+    const loxc::token& open = consume(loxc::LEFT_PAREN, "Expected opening '(' after function definition.");
 
-    std::vector<loxc::token> params;
+    std::vector<loxc::lexeme> params;
     if ( ! check(loxc::RIGHT_PAREN) )
         do {
-            params.push_back(consume(loxc::ID, "Expected a parameter name."));
+            params.push_back(lexeme(consume(loxc::ID, "Expected a parameter name.")));
         } while(match(loxc::COMMA));
 
     consume(loxc::RIGHT_PAREN, "Expected closing ')' after function parameters.");
 
-    Stmt body = statement();
-    return std::make_shared<FuncStmt>(std::move(name), std::move(params), std::move(body));
+    auto deferred = defer_body();
+    Stmt body;
+    if ( ! deferred )
+    {
+        nested n(nesting);
+        body = statement();
+    }
+    auto func = make_node<FuncStmt>(std::move(name), std::move(params), std::move(body));
+    if (func)
+    {
+        func->span = loxc::span(*input, open, previous());
+        func->deferred = std::move(deferred);
+    }
+    return func;
 }
 
 Stmt Parser::returnStatement()
 {
-    loxc::token keyword = previous();
+    loxc::lexeme keyword = lexeme(previous());
     Expr val;
     // only read an expression if there is one.
     if (! check(loxc::SEMICOLON) )
         val = expression();
     consume(loxc::SEMICOLON, "Expexted ';' after return statement.");
-    return std::make_shared<ReturnStmt>(std::move(keyword), std::move(val));
+    return make_node<ReturnStmt>(std::move(keyword), std::move(val));
+}
+
+Stmt Parser::yieldStatement()
+{
+    loxc::lexeme keyword = lexeme(previous());
+    Expr val;
+    if (! check(loxc::SEMICOLON) )
+        val = expression();
+    consume(loxc::SEMICOLON, "Expected ';' after yield statement.");
+    return make_node<YieldStmt>(std::move(keyword), std::move(val));
+}
+
+Stmt Parser::importStatement()
+{
+    const loxc::token& keyword = previous();
+    // Modules define globals, which only top level code should do.
+    if (nesting > 0)
+        throw error(keyword, "Can only import at the top level.");
+    const loxc::token& path = consume(loxc::STRING, "Expected a path after 'import'.");
+    consume(loxc::SEMICOLON, "Expected ';' after import statement.");
+    return make_node<ImportStmt>(lexeme(keyword),
+        std::get<std::string>(input->literals[path.literal]));
 }
 
 Stmt Parser::blockStatement()
 {
+    nested n(nesting);
     std::vector<Stmt> stmt_list;
 
     while ( ! (check(loxc::RIGHT_BRACE) || isAtEnd()) )
         stmt_list.push_back(declaration());
     
     consume(loxc::RIGHT_BRACE, "Expected a closing bracket.");
-    return std::make_shared<BlockStmt>(std::move(stmt_list));
+    return make_node<BlockStmt>(std::move(stmt_list));
 }
 
 Stmt Parser::ifStatement()
@@ -123,7 +224,7 @@ Stmt Parser::ifStatement()
     if (match(loxc::ELSE))
         otherwise = statement();
 
-    return std::make_shared<IfStmt>(conditional, std::move(then), std::move(otherwise));
+    return make_node<IfStmt>(conditional, std::move(then), std::move(otherwise));
 }
 
 Stmt Parser::whileStatement()
@@ -134,13 +235,15 @@ Stmt Parser::whileStatement()
 
     Stmt body = statement();
 
-    return std::make_shared<WhileStmt>(condition, body);
+    return make_node<WhileStmt>(condition, body);
 
 }
 
 // for (initializer ; condition ; increment) body
 Stmt Parser::forStatement()
 {
+    // The loop variable is scoped to the loop.
+    nested n(nesting);
     consume(loxc::LEFT_PAREN, "Expected '(' after for.");
 
     Stmt initializer;
@@ -169,18 +272,18 @@ Stmt Parser::forStatement()
     // A for loop is just sugar for a while loop. Here we build the
     // while loop syntax tree.
     if ( ! std::holds_alternative<std::monostate>(increment) )
-        body = std::make_shared<BlockStmt>(
-            std::vector<Stmt>({body, std::make_shared<ExprStmt>(increment)})
+        body = make_node<BlockStmt>(
+            std::vector<Stmt>({body, make_node<ExprStmt>(increment)})
             );
     
     // A null condition is always true
     if ( std::holds_alternative<std::monostate>(condition) )
-        condition = std::make_shared<LiteralExpr>(true);
+        condition = make_node<LiteralExpr>(true);
 
-    body = std::make_shared<WhileStmt>(condition, body);
+    body = make_node<WhileStmt>(condition, body);
 
     if ( ! std::holds_alternative<std::monostate>(initializer) )
-        body = std::make_shared<BlockStmt>(
+        body = make_node<BlockStmt>(
             std::vector<Stmt>({initializer, body})
             );
 
@@ -192,7 +295,7 @@ Stmt Parser::expressionStatement()
 {
     Expr expr = expression();
     consume(loxc::SEMICOLON, "Expected ; after expression statment.");
-    return std::make_shared<ExprStmt>(std::move(expr));
+    return make_node<ExprStmt>(std::move(expr));
 }
 
 Expr Parser::expression()
@@ -202,18 +305,31 @@ Expr Parser::expression()
 
 Expr Parser::assignment()
     {
+    nested d(depth);
+    if (depth > max_depth)
+        throw error(peek(), "Expressions nest too deeply.");
+
     // or -> and -> equality
     Expr expr = anonymous_function();
 
     if(match(loxc::EQUAL))
         {
-        loxc::token equals = previous();
+        const loxc::token& equals = previous();
         Expr val = assignment();
 
-        if (std::holds_alternative<std::shared_ptr<VarExpr>>(expr))
+        // Only checking syntax, the target's kind is all there is, and
+        // all that matters.
+        if (auto var = std::get_if<std::shared_ptr<VarExpr>>(&expr))
             {
-            loxc::token name = std::get<std::shared_ptr<VarExpr>>(expr)->name;
-            return std::make_shared<RedefExpr>(name, val);
+            if ( ! building )
+                return std::shared_ptr<RedefExpr>();
+            return make_node<RedefExpr>((*var)->name, val);
+            }
+        if (auto get = std::get_if<std::shared_ptr<GetExpr>>(&expr))
+            {
+            if ( ! building )
+                return std::shared_ptr<SetExpr>();
+            return make_node<SetExpr>((*get)->object, (*get)->name, val);
             }
         error(equals, "Invalid assignment.");
         }
@@ -225,17 +341,29 @@ Expr Parser::anonymous_function()
 {
     if (match(loxc::ANON))
     {
-        consume(loxc::LEFT_PAREN, "Expected opening '(' after function definition.");
+        const loxc::token& open = consume(loxc::LEFT_PAREN, "Expected opening '(' after function definition.");
 
-        std::vector<loxc::token> params;
+        std::vector<loxc::lexeme> params;
         if ( ! check(loxc::RIGHT_PAREN) )
             do {
-                params.push_back(consume(loxc::ID, "Expected a parameter name."));
+                params.push_back(lexeme(consume(loxc::ID, "Expected a parameter name.")));
             } while(match(loxc::COMMA));
-        auto closing_paren = consume(loxc::RIGHT_PAREN, "Expected closing ')' after function parameters.");
+        loxc::lexeme closing_paren = lexeme(consume(loxc::RIGHT_PAREN, "Expected closing ')' after function parameters."));
 
-        Stmt body = statement();
-        return std::make_shared<FunExpr>(std::move(params), std::move(body), std::move(closing_paren));
+        auto deferred = defer_body();
+        Stmt body;
+        if ( ! deferred )
+        {
+            nested n(nesting);
+            body = statement();
+        }
+        auto func = make_node<FunExpr>(std::move(params), std::move(body), std::move(closing_paren));
+        if (func)
+        {
+            func->span = loxc::span(*input, open, previous());
+            func->deferred = std::move(deferred);
+        }
+        return func;
     }
     return logical_or();
 }
@@ -246,9 +374,9 @@ Expr Parser::logical_or()
 
     while (match(loxc::OR))
     {
-        loxc::token op = previous();
+        loxc::lexeme op = lexeme(previous());
         Expr right = logical_and();
-        left = std::make_shared<LogicExpr>
+        left = make_node<LogicExpr>
             (std::move(left), std::move(op), std::move(right));
     }
 
@@ -261,9 +389,9 @@ Expr Parser::logical_and()
 
     while (match(loxc::AND))
     {
-        loxc::token op = previous();
+        loxc::lexeme op = lexeme(previous());
         Expr right = equality();
-        left = std::make_shared<LogicExpr>
+        left = make_node<LogicExpr>
             (std::move(left), std::move(op), std::move(right));
     }
 
@@ -276,9 +404,9 @@ Expr Parser::logical_and()
         Expr expr = next ();                                            \
         while (match matches )                                          \
         {                                                               \
-            loxc::token op = previous();                                \
+            loxc::lexeme op = lexeme(previous());                                \
             Expr right = next ();                                       \
-            expr = std::make_shared<BinaryExpr>                         \
+            expr = make_node<BinaryExpr>                         \
                 (std::move(expr), std::move(op), std::move(right));     \
         }                                                               \
         return expr;                                                    \
@@ -295,9 +423,13 @@ Expr Parser::unary()
 {
     while (match(loxc::BANG, loxc::MINUS))
     {
-        loxc::token op = previous();
+        nested d(depth);
+        if (depth > max_depth)
+            throw error(previous(), "Expressions nest too deeply.");
+
+        loxc::lexeme op = lexeme(previous());
         Expr right = unary();
-        return std::make_shared<UnaryExpr>(op, right);
+        return make_node<UnaryExpr>(op, right);
     }
     return call();
 }
@@ -310,6 +442,11 @@ Expr Parser::call()
     {
         if ( match (loxc::LEFT_PAREN) )
             who = finishCall(std::move(who));
+        else if ( match (loxc::DOT) )
+        {
+            loxc::lexeme name = lexeme(consume(loxc::ID, "Expected a property name after '.'."));
+            who = make_node<GetExpr>(std::move(who), std::move(name));
+        }
         else
             break;
     }
@@ -328,54 +465,109 @@ Expr Parser::finishCall(Expr callee)
     if (args.size() >= 255)
         error(peek(), "Functions can have a maximum of 255 arguments.");
 
-    loxc::token paren = consume(loxc::RIGHT_PAREN, "Expected ')' after function call.");
+    loxc::lexeme paren = lexeme(consume(loxc::RIGHT_PAREN, "Expected ')' after function call."));
 
-    return std::make_shared<CallExpr>(callee, paren, args);
+    return make_node<CallExpr>(callee, paren, args);
 }
 
 Expr Parser::primary()
 {
     if (match(loxc::FALSE))
-        return std::make_shared<LiteralExpr>(false);
+        return make_node<LiteralExpr>(false);
     if (match(loxc::TRUE))
-        return std::make_shared<LiteralExpr>(true);
+        return make_node<LiteralExpr>(true);
     if (match(loxc::NIL))
-        return std::make_shared<LiteralExpr>(std::monostate{});
+        return make_node<LiteralExpr>(std::monostate{});
 
     if (match(loxc::NUMBER, loxc::STRING))
     {
-        auto tok = previous();
-        if ( ! tok.data.has_value() )
+        const loxc::token& tok = previous();
+        if ( tok.literal == loxc::token::no_literal )
             throw error(tok, "Expected value with token");
-        return std::make_shared<LiteralExpr>(tok.data.value());
+        return make_node<LiteralExpr>(input->literals[tok.literal]);
     }
 
     if (match(loxc::LEFT_PAREN))
     {
         Expr expr = expression();
         consume(loxc::RIGHT_PAREN, "Expected ')' after expression.");
-        return std::make_shared<GroupingExpr>(expr);
+        return make_node<GroupingExpr>(expr);
     }
 
     if (match(loxc::ID))
-        return std::make_shared<VarExpr>(previous());
+        return make_node<VarExpr>(lexeme(previous()));
+
+    // `this` is an implicit parameter of every method, so it is read like
+    // any other variable.
+    if (match(loxc::THIS))
+        return make_node<VarExpr>(lexeme(previous()));
+
+    if (match(loxc::SUPER))
+    {
+        loxc::lexeme keyword = lexeme(previous());
+        consume(loxc::DOT, "Expected '.' after 'super'.");
+        loxc::lexeme method = lexeme(consume(loxc::ID, "Expected a superclass method name."));
+        return make_node<SuperExpr>(std::move(keyword), std::move(method));
+    }
 
     throw error(peek(), "Expected an expression.");
 }
 
-loxc::token Parser::consume(loxc::token_type in, std::string error_message)
+const loxc::token& Parser::consume(loxc::token_type in, const char* error_message)
 {
     if (check(in))
         return advance();
     throw Parser::error(peek(), error_message);
 }
 
-Parser::parse_error Parser::error(loxc::token bad, std::string what)
+Parser::parse_error Parser::error(const loxc::token& bad, const char* what)
 {
-    Reporter::error(bad, what);
+    Reporter::error(lexeme(bad), what);
     return parse_error(what);
 }
 
+std::optional<Stmt> Parser::parse_body(const loxc::deferred_body& body)
+{
+    had_error = false;
+
+    input = body.tokens;
+    current = input->tokens.cbegin() + body.first;
+    nesting = 0;
+    depth = 0;
+
+    try
+    {
+        consume(loxc::LEFT_BRACE, "Expected '{' before function body.");
+        Stmt block = blockStatement();
+        if ( ! had_error )
+            return block;
+    }
+    catch (const parse_error& e) {}
+
+    return std::nullopt;
+}
+
+std::shared_ptr<loxc::deferred_body> Parser::defer_body()
+{
+    if ( ! lazy || nesting > 0 || ! check(loxc::LEFT_BRACE) )
+        return nullptr;
+
+    // The body is parsed through all the same, so its syntax errors are
+    // reported now, as they would be without deferring it; only no tree
+    // is built.
+    size_t first = current - input->tokens.cbegin();
+    {
+        scoped_flag skim(building, false);
+        nested n(nesting);
+        advance();
+        blockStatement();
+    }
+
+    LOXC_COUNT(bodies_deferred, 1);
+    return std::make_shared<loxc::deferred_body>(input, first);
+}
+
+
 void Parser::synchronize()
 {
     advance();
@@ -396,6 +588,7 @@ void Parser::synchronize()
         case loxc::WHILE:
         case loxc::PRINT:
         case loxc::RETURN:
+        case loxc::IMPORT:
             return;
         default:
             advance();
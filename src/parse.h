@@ -3,6 +3,7 @@
 #ifndef parse_h
 #define parse_h
 
+#include <memory>
 #include <vector>
 #include <string>
 #include <optional>
@@ -16,7 +17,25 @@ class Parser
 {
 public:
     Parser() = default;
-    std::optional<std::vector<Stmt>> parse(std::vector<loxc::token> in);
+    std::optional<std::vector<Stmt>> parse(loxc::token_list in);
+
+    /**
+     * Parses a body that was deferred by a lazy parse.
+     *
+     * @return the body's block statement, or std::nullopt after reporting
+     * a syntax error.
+     */
+    std::optional<Stmt> parse_body(const loxc::deferred_body& body);
+
+    /**
+     * When lazy, the bodies of functions declared outside of any block or
+     * function are only checked for syntax errors, and their trees are
+     * built the first time the function is called (see
+     * loxc::deferred_body). Such
+     * functions can only refer to globals, so nothing about the code around
+     * them is needed to resolve them later.
+     */
+    void set_lazy(bool l) { lazy = l; }
 
     // --------------
     // Error handling:
@@ -26,13 +45,24 @@ public:
         using std::runtime_error::runtime_error;
     };
 
+    /**
+     * How deeply statements and expressions may nest. The passes over the
+     * tree recurse once per level on the native stack, so a bound here is
+     * what lets a lox call know how much native stack it needs (see
+     * op::call_stack).
+     */
+    static constexpr int max_depth = 1000;
+
 private:
     Stmt declaration();
     Stmt variableDeclaration();
+    Stmt classDeclaration();
     Stmt statement();
     Stmt printStatement();
     Stmt funcStatement();
     Stmt returnStatement();
+    Stmt yieldStatement();
+    Stmt importStatement();
     Stmt blockStatement();
     Stmt ifStatement();
     Stmt whileStatement();
@@ -76,23 +106,45 @@ private:
     bool match(std::initializer_list<loxc::token_type> in);
     bool check(loxc::token_type in) { return isAtEnd() ? false : peek().type == in; }
 
-    loxc::token peek() const { return *current; };
-    loxc::token previous() const { return *(current - 1); };
-    loxc::token advance() 
+    const loxc::token& peek() const { return *current; };
+    const loxc::token& previous() const { return *(current - 1); };
+    const loxc::token& advance() 
     {
         if ( ! isAtEnd() ) ++current;
         return previous();
     };
     bool isAtEnd() { return peek().type == loxc::END; };
 
-    loxc::token consume(loxc::token_type in, std::string error_message);
-    static parse_error error(loxc::token bad, std::string what);
+    // What the syntax tree keeps of a token.
+    loxc::lexeme lexeme(const loxc::token& tok) const
+    {
+        return {tok.type, static_cast<int>(tok.line), loxc::intern(input->text(tok))};
+    }
+
+    const loxc::token& consume(loxc::token_type in, const char* error_message);
+    parse_error error(const loxc::token& bad, const char* what);
     void synchronize();
 
+    // Checks the syntax of a function body, starting at its '{', without
+    // building it, and returns where it starts if the body can be
+    // deferred. Otherwise parses nothing.
+    std::shared_ptr<loxc::deferred_body> defer_body();
+
+    template <typename T, typename... Args>
+    std::shared_ptr<T> make_node(Args&&... args);
+
     bool had_error;
+    bool lazy = false;
+    // false while only checking the syntax of a body that is deferred.
+    bool building = true;
+    // blocks and function bodies the parser is inside of.
+    int nesting = 0;
+    // statements and expressions the parser is inside of. Every pass over
+    // the tree recurses as deep, so this is bounded, see max_depth.
+    int depth = 0;
 
-    std::vector<loxc::token> tokens;
-    std::vector<loxc::token>::iterator current;
+    std::shared_ptr<const loxc::token_list> input;
+    std::vector<loxc::token>::const_iterator current;
 };
 
 #endif
\ No newline at end of file
@@ -8,43 +8,102 @@
 
 #include "token.h"
 #include "op.h"
+#include "output.h"
 
+/**
+ * Errors go through the same buffered writer as lox's own output so the two
+ * stay in order.
+ */
 class Reporter
 {
 public:
   static void runtime_error(const op::runtime_error& e)
   {
-    std::cout << "[" << e.where << "] " << e.what() << " [line] " << e.where.line << "\n";
+    if (captured)
+    {
+      *captured += "['" + e.where.str() + "'] " + e.what() + " [line] "
+        + std::to_string(e.where.line) + '\n' + e.trace;
+      return;
+    }
+    loxc::output::record entry(loxc::out());
+    loxc::out() << "['" << e.where.str() << "'] " << e.what() << " [line] " << e.where.line << '\n';
+    if ( ! e.trace.empty() )
+      loxc::out() << e.trace;
+    loxc::out().flush();
   }
 
   static void error(std::string what)
   {
-    std::cout << "[Error] " << what << std::endl;
+    write("[Error] " + what + '\n');
   }
   static void error(std::string what, size_t line)
   {
-    std::cout << "[Error] " << what << " [line] " << line << "\n";
+    write("[Error] " + what + " [line] " + std::to_string(line) + '\n');
   }
   static void error(std::string what, std::string where, size_t line)
   {
-    std::cout << "[Error] " << what << " '" << where << "' [line] " << line << "\n";
+    write("[Error] " + what + " '" + where + "' [line] " + std::to_string(line) + '\n');
   }
-    static void error(std::string what, char where, size_t line)
+  static void error(std::string what, char where, size_t line)
   {
-    std::cout << "[Error] " << what << " '" << where << "' [line] " << line << "\n";
+    error(what, std::string(1, where), line);
   }
-  static void error(loxc::token tok, std::string what)
+  static void error(const loxc::lexeme& tok, std::string what)
   {
     if (tok.type == loxc::END)
       Reporter::error("at EOF, line " + std::to_string(tok.line) + ":  " + what);
     else
-      Reporter::error(what, tok.lexme, tok.line);
+      Reporter::error(what, tok.str(), tok.line);
   }
 
+  // Notes about the run rather than the program go to stderr, as the
+  // --stats report does, so they never end up in piped output.
   static void info(std::string what)
   {
-    std::cout << "[INFO] " << what << "\n";
+    std::cerr << "[INFO] " << what << '\n';
   }
+
+  /**
+   * While one is alive, errors reported on its thread, runtime errors
+   * too, are kept in text instead of written out. Files scanned and parsed on other threads
+   * report through one, so their errors come out when the file would
+   * have been run, after the output of the files before it.
+   */
+  class capture
+  {
+  public:
+    capture() : outer(captured) { captured = &text; }
+    ~capture() { captured = outer; }
+    capture(const capture&) = delete;
+    capture& operator=(const capture&) = delete;
+
+    std::string text;
+
+  private:
+    std::string* outer;
+  };
+
+  // Writes out errors a capture kept.
+  static void replay(const std::string& text)
+  {
+    if ( ! text.empty() )
+      write(text);
+  }
+
+private:
+  static void write(const std::string& line)
+  {
+    if (captured)
+    {
+      *captured += line;
+      return;
+    }
+    loxc::output::record entry(loxc::out());
+    loxc::out() << line;
+    loxc::out().sync();
+  }
+
+  static inline thread_local std::string* captured = nullptr;
 };
 
 #endif
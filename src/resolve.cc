@@ -0,0 +1,422 @@
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "resolve.h"
+#include "reporter.h"
+
+std::optional<loxc::function_layout> Resolver::run(std::vector<Stmt>& stmts)
+{
+    had_error = false;
+    finding_captures = true;
+    pass(stmts);
+    finding_captures = false;
+    pass(stmts);
+
+    if (had_error)
+        return std::nullopt;
+    return top_level;
+}
+
+bool Resolver::resolve_body(const std::vector<loxc::lexeme>& params, Stmt& body,
+    loxc::function_layout& layout)
+{
+    // Only functions declared outside of any scope are deferred, so the
+    // top level is all that encloses them.
+    had_error = false;
+    for (bool captures : {true, false})
+    {
+        finding_captures = captures;
+        top_level = loxc::function_layout{};
+        frames.clear();
+        frames.push_back({&top_level, 0, 0, {}});
+        resolve_function(params, body, layout);
+    }
+    finding_captures = false;
+    return ! had_error;
+}
+
+void Resolver::resolve_method(FuncStmt& method)
+{
+    std::vector<loxc::lexeme> params;
+    params.reserve(method.params.size() + 1);
+    params.push_back({loxc::THIS, method.name.line, loxc::intern("this")});
+    params.insert(params.end(), method.params.begin(), method.params.end());
+
+    static const std::string* init = loxc::intern("init");
+    resolve_function(params, method.body, method.layout,
+        method.name.text == init ? INITIALIZER : METHOD);
+    method.layout.receiver = true;
+}
+
+void Resolver::pass(std::vector<Stmt>& stmts)
+{
+    top_level = loxc::function_layout{};
+    frames.clear();
+    frames.push_back({&top_level, 0, 0, {}});
+
+    for (Stmt& s : stmts)
+        std::visit(*this, s);
+}
+
+void Resolver::error(const loxc::lexeme& where, const char* what)
+{
+    if (finding_captures)
+        return;
+    Reporter::error(where, what);
+    had_error = true;
+}
+
+void Resolver::begin_scope()
+{
+    function_frame& frame = frames.back();
+    frame.scopes.push_back({{}, frame.next_slot, frame.next_cell});
+}
+
+void Resolver::end_scope()
+{
+    // Slots and cells of a finished scope are free for its siblings.
+    function_frame& frame = frames.back();
+    frame.next_slot = frame.scopes.back().first_slot;
+    frame.next_cell = frame.scopes.back().first_cell;
+    frame.scopes.pop_back();
+}
+
+void Resolver::declare(const loxc::lexeme& name, loxc::binding& bind)
+{
+    function_frame& frame = frames.back();
+
+    // Outside of any block or function everything is global.
+    if (frame.scopes.empty() && frames.size() == 1)
+    {
+        bind.kind = loxc::binding::GLOBAL;
+        return;
+    }
+
+    scope& current = frame.scopes.back();
+
+    // Redeclaring a name in the same scope reuses the existing variable,
+    // so it stays readable in the new initializer.
+    auto found = current.names.find(name.text);
+    if (found != current.names.end())
+    {
+        const loxc::binding& first = *found->second.decl;
+        bind.kind = first.kind;
+        bind.index = first.index;
+        bind.redeclares = true;
+        return;
+    }
+
+    bind.redeclares = false;
+    if (finding_captures)
+        bind.captured = false;
+    else if (bind.captured)
+    {
+        bind.kind = loxc::binding::CELL;
+        bind.index = frame.next_cell++;
+        frame.layout->cells = std::max<size_t>(frame.layout->cells, frame.next_cell);
+    }
+    else
+    {
+        bind.kind = loxc::binding::SLOT;
+        bind.index = frame.next_slot++;
+        frame.layout->slots = std::max<size_t>(frame.layout->slots, frame.next_slot);
+    }
+
+    current.names.emplace(name.text, variable{false, &bind});
+}
+
+void Resolver::define(const loxc::lexeme& name)
+{
+    function_frame& frame = frames.back();
+    if ( ! frame.scopes.empty() )
+        frame.scopes.back().names[name.text].ready = true;
+}
+
+void Resolver::resolve_name(const loxc::lexeme& name, loxc::binding& bind)
+{
+    const int current = frames.size() - 1;
+
+    for (int function = current; function >= 0; --function)
+    {
+        auto& scopes = frames[function].scopes;
+        for (auto it = scopes.rbegin(); it != scopes.rend(); ++it)
+        {
+            auto found = it->names.find(name.text);
+            if (found == it->names.end())
+                continue;
+
+            // A variable read in its own initializer is not defined yet
+            // when that initializer runs, so the read sees the enclosing
+            // variable of the same name. Only nested functions, which run
+            // later, see the new variable.
+            if ( ! found->second.ready && function == current )
+                continue;
+
+            loxc::binding& decl = *found->second.decl;
+
+            if (function == current)
+            {
+                bind.kind = decl.kind;
+                bind.index = decl.index;
+            }
+            else if (finding_captures)
+                decl.captured = true;
+            else
+            {
+                bind.kind = loxc::binding::UPVALUE;
+                bind.index = resolve_capture(current, function, decl.index);
+            }
+            return;
+        }
+    }
+    bind.kind = loxc::binding::GLOBAL;
+}
+
+/**
+ * Threads a cell declared in frame `declared_in` through the captures of
+ * every function between there and `function`.
+ *
+ * @return the index of the cell in `function`'s captures.
+ */
+int Resolver::resolve_capture(int function, int declared_in, int cell)
+{
+    loxc::capture c;
+    if (function == declared_in + 1)
+        c = {true, cell};
+    else
+        c = {false, resolve_capture(function - 1, declared_in, cell)};
+
+    auto& captures = frames[function].layout->captures;
+    for (size_t i = 0; i < captures.size(); ++i)
+        if (captures[i].local == c.local && captures[i].index == c.index)
+            return i;
+
+    captures.push_back(c);
+    return captures.size() - 1;
+}
+
+void Resolver::resolve_function(const std::vector<loxc::lexeme>& params, Stmt& body,
+    loxc::function_layout& layout, function_kind kind)
+{
+    function_kind enclosing = current_function;
+    current_function = kind;
+
+    // The params vector survives the first pass so the captured flags it
+    // collects are there for the second.
+    std::vector<loxc::binding> param_binds = std::move(layout.params);
+    param_binds.resize(params.size());
+    layout = loxc::function_layout{};
+    layout.params = std::move(param_binds);
+
+    frames.push_back({&layout, 0, 0, {}});
+
+    begin_scope();
+    for (size_t i = 0; i < params.size(); ++i)
+    {
+        declare(params[i], layout.params[i]);
+        define(params[i]);
+    }
+    std::visit(*this, body);
+    end_scope();
+
+    frames.pop_back();
+    current_function = enclosing;
+}
+
+/**
+ * EXPRESSIONS
+ */
+
+void Resolver::operator()(std::shared_ptr<BinaryExpr> e)
+{
+    std::visit(*this, e->left);
+    std::visit(*this, e->right);
+}
+
+void Resolver::operator()(std::shared_ptr<GroupingExpr> e)
+{
+    std::visit(*this, e->expression);
+}
+
+void Resolver::operator()(std::shared_ptr<LiteralExpr> e) {}
+
+void Resolver::operator()(std::shared_ptr<UnaryExpr> e)
+{
+    std::visit(*this, e->right);
+}
+
+void Resolver::operator()(std::shared_ptr<VarExpr> e)
+{
+    if (e->name.type == loxc::THIS && current_class == NO_CLASS)
+        error(e->name, "Can't use 'this' outside of a class.");
+    resolve_name(e->name, e->bind);
+}
+
+void Resolver::operator()(std::shared_ptr<RedefExpr> e)
+{
+    std::visit(*this, e->value);
+    resolve_name(e->name, e->bind);
+}
+
+void Resolver::operator()(std::shared_ptr<LogicExpr> e)
+{
+    std::visit(*this, e->left);
+    std::visit(*this, e->right);
+}
+
+void Resolver::operator()(std::shared_ptr<GetExpr> e)
+{
+    std::visit(*this, e->object);
+}
+
+void Resolver::operator()(std::shared_ptr<SetExpr> e)
+{
+    std::visit(*this, e->value);
+    std::visit(*this, e->object);
+}
+
+void Resolver::operator()(std::shared_ptr<SuperExpr> e)
+{
+    if (current_class == NO_CLASS)
+        error(e->keyword, "Can't use 'super' outside of a class.");
+    else if (current_class == CLASS)
+        error(e->keyword, "Can't use 'super' in a class with no superclass.");
+    resolve_name(e->keyword, e->super_bind);
+    resolve_name({loxc::THIS, e->keyword.line, loxc::intern("this")}, e->this_bind);
+}
+
+void Resolver::operator()(std::shared_ptr<CallExpr> e)
+{
+    std::visit(*this, e->callee);
+    for (Expr& arg : e->args)
+        std::visit(*this, arg);
+}
+
+void Resolver::operator()(std::shared_ptr<FunExpr> e)
+{
+    if ( ! e->deferred )
+        resolve_function(e->params, e->body, e->layout);
+}
+
+/**
+ * STATEMENTS
+ */
+
+void Resolver::operator()(std::shared_ptr<PrintStmt> s)
+{
+    std::visit(*this, s->expression);
+}
+
+void Resolver::operator()(std::shared_ptr<ExprStmt> s)
+{
+    std::visit(*this, s->expression);
+}
+
+void Resolver::operator()(std::shared_ptr<VarStmt> s)
+{
+    declare(s->name, s->bind);
+    std::visit(*this, s->initializer);
+    define(s->name);
+}
+
+void Resolver::operator()(std::shared_ptr<BlockStmt> s)
+{
+    begin_scope();
+
+    // The block's functions are declared before any of their bodies is
+    // resolved, so a function can call one declared after it. They are
+    // only defined at their declaration: code of the block itself still
+    // can't use them any earlier.
+    s->hoisted_cells.clear();
+    for (Stmt& stmt : s->stmt_list)
+        if (auto f = std::get_if<std::shared_ptr<FuncStmt>>(&stmt))
+        {
+            declare((*f)->name, (*f)->bind);
+            if ((*f)->bind.kind == loxc::binding::CELL && ! (*f)->bind.redeclares)
+                s->hoisted_cells.push_back((*f)->bind.index);
+        }
+
+    for (Stmt& stmt : s->stmt_list)
+        std::visit(*this, stmt);
+    end_scope();
+}
+
+void Resolver::operator()(std::shared_ptr<IfStmt> s)
+{
+    std::visit(*this, s->condition);
+    std::visit(*this, s->t_branch);
+    std::visit(*this, s->f_branch);
+}
+
+void Resolver::operator()(std::shared_ptr<WhileStmt> s)
+{
+    std::visit(*this, s->condition);
+    std::visit(*this, s->body);
+}
+
+void Resolver::operator()(std::shared_ptr<FuncStmt> s)
+{
+    // Declared and defined up front so the function can call itself.
+    declare(s->name, s->bind);
+    define(s->name);
+    // A deferred body is resolved when it is parsed, see resolve_body.
+    if ( ! s->deferred )
+        resolve_function(s->params, s->body, s->layout);
+}
+
+void Resolver::operator()(std::shared_ptr<ReturnStmt> s)
+{
+    // init always hands back the instance, so can only return early.
+    if (current_function == INITIALIZER && ! std::holds_alternative<std::monostate>(s->value))
+        error(s->keyword, "Can't return a value from an initializer.");
+    std::visit(*this, s->value);
+}
+
+void Resolver::operator()(std::shared_ptr<YieldStmt> s)
+{
+    // At the top level this marks nothing that is ever called; yielding
+    // there is a runtime error.
+    frames.back().layout->generator = true;
+    std::visit(*this, s->value);
+}
+
+void Resolver::operator()(std::shared_ptr<ImportStmt>)
+{
+    // What it defines is only known once the module has run; uses of
+    // those names resolve as globals, looked up when they run.
+}
+
+void Resolver::operator()(std::shared_ptr<ClassStmt> s)
+{
+    declare(s->name, s->bind);
+    define(s->name);
+
+    class_kind enclosing = current_class;
+    current_class = CLASS;
+
+    bool inherits = ! std::holds_alternative<std::monostate>(s->superclass);
+    if (inherits)
+    {
+        current_class = SUBCLASS;
+        const loxc::lexeme& parent = std::get<std::shared_ptr<VarExpr>>(s->superclass)->name;
+        if (parent.text == s->name.text)
+            error(parent, "A class can't inherit from itself.");
+
+        std::visit(*this, s->superclass);
+        // `super` is a variable in a scope around the methods, which
+        // capture it like any other local.
+        begin_scope();
+        loxc::lexeme super{loxc::SUPER, s->name.line, loxc::intern("super")};
+        declare(super, s->super_bind);
+        define(super);
+    }
+
+    for (auto& method : s->methods)
+        resolve_method(*method);
+
+    if (inherits)
+        end_scope();
+    current_class = enclosing;
+}
@@ -0,0 +1,141 @@
+// static pass that binds every variable reference to its declaration.
+#ifndef resolve_h
+#define resolve_h
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "expr.h"
+#include "stmt.h"
+
+/**
+ * The resolver walks the tree before it is executed and fills in the
+ * loxc::binding annotation on variable declarations and references, and
+ * the loxc::function_layout of every function.
+ *
+ * It makes two passes. The first is an escape analysis: it marks every
+ * local that a nested function refers to as captured. The second binds
+ * names. Locals that are not captured get a plain slot in their call's
+ * frame, captured ones get a cell there so closures can share them, and
+ * references from nested functions go through the closure's captures.
+ * Anything not found in a local scope is a global. A function whose
+ * locals are never captured therefore never touches the heap for them.
+ *
+ * It also reports the errors that can be found without running the code:
+ * returning a value from an initializer, `this` or `super` outside of a
+ * class, `super` in a class without a superclass, and a class inheriting
+ * from itself.
+ */
+class Resolver
+{
+public:
+    Resolver() = default;
+
+    /**
+     * Resolves a program.
+     *
+     * @return the frame layout of the top level code, or nothing if
+     * there were errors.
+     */
+    std::optional<loxc::function_layout> run(std::vector<Stmt>& stmts);
+
+    /**
+     * Resolves the body of a function whose parse was deferred (see
+     * Parser::set_lazy), filling in its layout.
+     *
+     * @return false if there were errors.
+     */
+    bool resolve_body(const std::vector<loxc::lexeme>& params, Stmt& body,
+        loxc::function_layout& layout);
+
+    // Expressions
+    void operator()(std::shared_ptr<BinaryExpr> e);
+    void operator()(std::shared_ptr<GroupingExpr> e);
+    void operator()(std::shared_ptr<LiteralExpr> e);
+    void operator()(std::shared_ptr<UnaryExpr> e);
+    void operator()(std::shared_ptr<VarExpr> e);
+    void operator()(std::shared_ptr<RedefExpr> e);
+    void operator()(std::shared_ptr<LogicExpr> e);
+    void operator()(std::shared_ptr<GetExpr> e);
+    void operator()(std::shared_ptr<SetExpr> e);
+    void operator()(std::shared_ptr<SuperExpr> e);
+    void operator()(std::shared_ptr<CallExpr> e);
+    void operator()(std::shared_ptr<FunExpr> e);
+
+    // Statements
+    void operator()(std::shared_ptr<PrintStmt> s);
+    void operator()(std::shared_ptr<ExprStmt> s);
+    void operator()(std::shared_ptr<VarStmt> s);
+    void operator()(std::shared_ptr<BlockStmt> s);
+    void operator()(std::shared_ptr<IfStmt> s);
+    void operator()(std::shared_ptr<WhileStmt> s);
+    void operator()(std::shared_ptr<FuncStmt> s);
+    void operator()(std::shared_ptr<ReturnStmt> s);
+    void operator()(std::shared_ptr<YieldStmt> s);
+    void operator()(std::shared_ptr<ImportStmt> s);
+    void operator()(std::shared_ptr<ClassStmt> s);
+
+    void operator()(std::monostate) {}
+
+private:
+    struct variable
+    {
+        // whether its initializer has finished resolving.
+        bool ready;
+        // the binding of its declaration, which records whether it is
+        // captured.
+        loxc::binding* decl;
+    };
+
+    struct scope
+    {
+        // keyed on the interned name, so lookups never compare text.
+        std::unordered_map<const std::string*, variable> names;
+        // the frame's next free slot and cell when the scope was entered.
+        int first_slot;
+        int first_cell;
+    };
+
+    enum function_kind { NO_FUNCTION, FUNCTION, METHOD, INITIALIZER };
+    enum class_kind { NO_CLASS, CLASS, SUBCLASS };
+
+    struct function_frame
+    {
+        loxc::function_layout* layout;
+        int next_slot;
+        int next_cell;
+        // the scopes of this function, innermost last.
+        std::vector<scope> scopes;
+    };
+
+    void begin_scope();
+    void end_scope();
+
+    void declare(const loxc::lexeme& name, loxc::binding& bind);
+    void define(const loxc::lexeme& name);
+    void resolve_name(const loxc::lexeme& name, loxc::binding& bind);
+    int resolve_capture(int function, int declared_in, int cell);
+    void resolve_function(const std::vector<loxc::lexeme>& params, Stmt& body,
+        loxc::function_layout& layout, function_kind kind = FUNCTION);
+    // A method is a function with `this` as an implicit first parameter.
+    void resolve_method(FuncStmt& method);
+
+    void pass(std::vector<Stmt>& stmts);
+    // Errors are only reported by the second pass, so each is seen once.
+    void error(const loxc::lexeme& where, const char* what);
+
+    // Index 0 is the top level, then one per function being resolved.
+    std::vector<function_frame> frames;
+    loxc::function_layout top_level;
+    // true during the first pass, which only looks for captures.
+    bool finding_captures = false;
+    // What encloses the code being resolved, for the static errors.
+    function_kind current_function = NO_FUNCTION;
+    class_kind current_class = NO_CLASS;
+    bool had_error = false;
+};
+
+#endif
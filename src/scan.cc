@@ -10,14 +10,24 @@
 #include "scan.h"
 #include "reporter.h"
 #include "val.h"
+#include "stats.h"
+#include "number.h"
 
-std::optional<std::vector<loxc::token>> Scanner::run(std::string src)
+std::optional<loxc::token_list> Scanner::run(std::string src)
 {
-  tokens.clear();
+  out = loxc::token_list{};
   had_error = false;
+  if (src.size() > loxc::token::max_source)
+  {
+    Reporter::error("Source is too long: it can be at most " +
+                    std::to_string(loxc::token::max_source) + " bytes.");
+    return std::nullopt;
+  }
   source = std::move(src);
   current = start = source.begin();
   stop = source.end();
+  // Most tokens are a few characters long; this saves regrowing the list.
+  out.tokens.reserve(source.size() / 4 + 1);
 
   line = 1;
 
@@ -113,20 +123,37 @@ std::optional<std::vector<loxc::token>> Scanner::run(std::string src)
 
   add_tok(loxc::END);
 
+  // Lines only grow, so the last token's is the largest.
+  if (line > loxc::token::max_line)
+  {
+    Reporter::error("Source has too many lines: it can have at most " +
+                    std::to_string(loxc::token::max_line) + ".");
+    had_error = true;
+  }
+
+  // Tokens hold offsets, not pointers, so moving the text is safe.
+  out.source = std::make_shared<const std::string>(std::move(source));
+
   if (!had_error)
-    return tokens;
+    return std::move(out);
 
   return std::nullopt;
 }
 
 void Scanner::add_tok(loxc::token_type t)
 {
-  add_tok(t, std::monostate{});
+  LOXC_COUNT(tokens, 1);
+  out.tokens.push_back({static_cast<uint32_t>(start - source.begin()),
+                        static_cast<uint32_t>(current - start),
+                        static_cast<uint32_t>(line), t,
+                        loxc::token::no_literal});
 }
 
 void Scanner::add_tok(loxc::token_type t, Val data)
 {
-  tokens.emplace_back(t, data, std::string(start, current), line);
+  add_tok(t);
+  out.tokens.back().literal = out.literals.size();
+  out.literals.push_back(std::move(data));
 }
 
 bool Scanner::next_is(char what)
@@ -171,7 +198,14 @@ void Scanner::read_number()
   while (is_digit(peek()))
     ++current;
 
-  add_tok(loxc::NUMBER, stod(std::string(start, current)));
+  const char *first = source.data() + (start - source.begin());
+  double value = 0;
+  if (!loxc::parse_number(first, first + (current - start), value))
+  {
+    Reporter::error("Number literal out of range.", line);
+    had_error = true;
+  }
+  add_tok(loxc::NUMBER, value);
 }
 
 void Scanner::read_id()
@@ -179,7 +213,7 @@ void Scanner::read_id()
   while (is_alpha_numeric(peek()))
     ++current;
 
-  std::string id(start, current);
+  std::string_view id(&*start, current - start);
 
   auto search = loxc::keywords_map.find(id);
 
@@ -19,10 +19,10 @@ public:
    * Turns an input string into a list of tokens.
    * 
    * @param src the string to be parsed.
-   * @return a vector of tokens on success, std::nullopt on
-   * an error.
+   * @return the tokens, with the source and literals they refer to, on
+   * success, std::nullopt on an error.
    */
-  std::optional<std::vector<loxc::token>> run(std::string src);
+  std::optional<loxc::token_list> run(std::string src);
 
 private:
   bool have_next() const { return current < stop; }
@@ -43,9 +43,9 @@ private:
   bool is_alpha(char c);
   bool is_alpha_numeric(char c);
 
-  std::vector<loxc::token> tokens;
-
+  loxc::token_list out;
   std::string source;
+
   std::string::iterator start, current, stop;
   size_t line;
   bool had_error;
@@ -0,0 +1,264 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "session.h"
+#include "events.h"
+#include "modules.h"
+#include "reporter.h"
+#include "stats.h"
+
+int Session::run(std::string source, bool wait_for_events)
+{
+  std::optional<compiled> code = compile(std::move(source), scanner, parser, resolver);
+  if (!code.has_value())
+    return ERROR;
+  return execute(code.value(), wait_for_events);
+}
+
+std::optional<Session::compiled> Session::compile(std::string source, Scanner &scanner,
+                                                  Parser &parser, Resolver &resolver)
+{
+  std::optional<loxc::token_list> tokens;
+  {
+    loxc::stats::timer t(loxc::stats::SCAN);
+    tokens = scanner.run(std::move(source));
+  }
+
+  if (!tokens.has_value())
+    return std::nullopt;
+
+  std::optional<std::vector<Stmt>> expr;
+  {
+    loxc::stats::timer t(loxc::stats::PARSE);
+    expr = parser.parse(std::move(tokens.value()));
+  }
+
+  if (!expr.has_value())
+    return std::nullopt;
+
+  compiled code{std::move(expr.value()), {}};
+  std::optional<loxc::function_layout> layout;
+  {
+    loxc::stats::timer t(loxc::stats::RESOLVE);
+    layout = resolver.run(code.program);
+  }
+
+  if (!layout.has_value())
+    return std::nullopt;
+
+  code.layout = std::move(layout.value());
+  return code;
+}
+
+int Session::execute(compiled &code, bool wait_for_events)
+{
+  auto start = std::chrono::steady_clock::now();
+  int status = GOOD;
+  try
+  {
+    loxc::stats::timer t(loxc::stats::EXECUTE);
+    interp.run(code.program, code.layout);
+    // Then whatever it left waiting on timers and I/O.
+    if (wait_for_events)
+      events::run(interp);
+  }
+  catch (const op::runtime_error &e)
+  {
+    Reporter::runtime_error(e);
+    status = ERROR;
+  }
+  std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+  execute_seconds = took.count();
+
+  return status;
+}
+
+// Files being compiled ahead of running them, for the threads doing it.
+struct Session::front_end
+{
+  struct unit
+  {
+    std::optional<compiled> code;
+    // the errors reported compiling it, to be written out in turn.
+    std::string errors;
+    bool ready = false;
+  };
+
+  const std::vector<const char *> &paths;
+  bool lazy;
+  std::vector<unit> units;
+  std::atomic<size_t> next{0};
+  std::mutex lock;
+  std::condition_variable done;
+
+  // Compiles files, taking the earliest not yet started, until none are left.
+  void work()
+  {
+    for (size_t i; (i = next++) < units.size();)
+    {
+      Reporter::capture errors;
+      std::optional<compiled> code;
+      if (std::optional<std::string> source = read_script(paths[i]))
+      {
+        Scanner scanner;
+        Parser parser;
+        parser.set_lazy(lazy);
+        Resolver resolver;
+        code = compile(std::move(source.value()), scanner, parser, resolver);
+      }
+
+      std::lock_guard<std::mutex> guard(lock);
+      units[i].code = std::move(code);
+      units[i].errors = std::move(errors.text);
+      units[i].ready = true;
+      done.notify_all();
+    }
+  }
+
+  static void *entry(void *arg)
+  {
+    static_cast<front_end *>(arg)->work();
+    loxc::stats::merge();
+    return nullptr;
+  }
+
+  unit &wait(size_t i)
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [&] { return units[i].ready; });
+    return units[i];
+  }
+};
+
+int Session::run_files(const std::vector<const char *> &paths, size_t threads, size_t stack_bytes)
+{
+  front_end files{paths, lazy, std::vector<front_end::unit>(paths.size())};
+
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min(threads, paths.size());
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, stack_bytes);
+  std::vector<pthread_t> running(threads);
+  size_t started = 0;
+  while (started < threads &&
+         pthread_create(&running[started], &attr, front_end::entry, &files) == 0)
+    ++started;
+  pthread_attr_destroy(&attr);
+  // Couldn't get any threads, so compile everything here first.
+  if (started == 0)
+    files.work();
+
+  int status = GOOD;
+  for (size_t i = 0; i < paths.size() && status == GOOD; ++i)
+  {
+    front_end::unit &unit = files.wait(i);
+    Reporter::replay(unit.errors);
+    modules::set_script(paths[i]);
+    status = unit.code.has_value() ? execute(unit.code.value(), true) : ERROR;
+    unit.code.reset();
+  }
+
+  // The rest are abandoned; stop handing them out.
+  files.next = paths.size();
+  for (size_t t = 0; t < started; ++t)
+    pthread_join(running[t], nullptr);
+  return status;
+}
+
+std::optional<std::string> Session::read_script(const char *path)
+{
+  // A directory opens, and reads as empty.
+  struct stat st;
+  bool directory = ::stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+  std::ifstream file(path);
+  std::stringstream source;
+  if (!directory && file.is_open())
+    source << file.rdbuf();
+  if (directory || !file.is_open() || file.bad())
+  {
+    Reporter::error("Could not read script '" + std::string(path) + "'");
+    return std::nullopt;
+  }
+  return source.str();
+}
+
+bool Session::compile_body(const loxc::deferred_body &deferred,
+                           const std::vector<loxc::lexeme> &params,
+                           Stmt &body, loxc::function_layout &layout)
+{
+  LOXC_COUNT(bodies_parsed, 1);
+
+  std::optional<Stmt> parsed;
+  {
+    loxc::stats::timer t(loxc::stats::PARSE);
+    Parser parser;
+    parsed = parser.parse_body(deferred);
+  }
+  if (!parsed.has_value())
+    return false;
+
+  body = std::move(parsed.value());
+  loxc::stats::timer t(loxc::stats::RESOLVE);
+  Resolver resolver;
+  return resolver.resolve_body(params, body, layout);
+}
+
+bool Session::incomplete(std::string_view source)
+{
+  int depth = 0;
+  for (size_t i = 0; i < source.size(); ++i)
+  {
+    char c = source[i];
+    char next = i + 1 < source.size() ? source[i + 1] : '\0';
+
+    if (c == '"')
+    {
+      i = source.find('"', i + 1);
+      if (i == std::string_view::npos)
+        return true;
+    }
+    else if (c == '/' && next == '/')
+    {
+      i = source.find('\n', i);
+      if (i == std::string_view::npos)
+        break;
+    }
+    else if (c == '/' && next == '*')
+    {
+      // Block comments nest, as they do in the scanner.
+      int comments = 1;
+      for (i += 2; comments && i < source.size(); ++i)
+      {
+        if (source.compare(i, 2, "/*") == 0)
+          ++comments, ++i;
+        else if (source.compare(i, 2, "*/") == 0)
+          --comments, ++i;
+      }
+      if (comments)
+        return true;
+      --i;
+    }
+    else if (c == '(' || c == '{')
+      ++depth;
+    else if (c == ')' || c == '}')
+      --depth;
+  }
+  // Too many closing brackets is an error for the parser to report, not
+  // a reason to wait.
+  return depth > 0;
+}
@@ -0,0 +1,117 @@
+// a compilation session: scans, parses, resolves and runs source against
+// one interpreter, keeping its state between inputs.
+#ifndef session_h
+#define session_h
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "op.h"
+#include "scan.h"
+#include "parse.h"
+#include "resolve.h"
+
+enum return_status
+{
+  GOOD,
+  ERROR,
+  EXIT
+};
+
+/**
+ * Everything later input needs from earlier input lives past a single
+ * run: names stay interned, globals keep their slots (and the references
+ * that cached them stay valid until a global is redefined), and the
+ * functions defined so far keep their resolved syntax trees. A new input
+ * is scanned and compiled on its own and never re-reads what came before,
+ * so a REPL stays as fast after loading a large script as it is at start.
+ */
+class Session
+{
+public:
+  explicit Session(op::interpreter &interp, bool lazy = false)
+      : interp(interp), lazy(lazy)
+  {
+    parser.set_lazy(lazy);
+  }
+
+  /**
+   * Compiles and runs one input, then, unless told not to, the callbacks
+   * of the timers and I/O it started.
+   *
+   * @return GOOD, or ERROR after reporting a scan, parse or runtime error.
+   */
+  int run(std::string source, bool wait_for_events = true);
+
+  /**
+   * Runs files one after another, each as run would, stopping at the first
+   * that fails. Meanwhile up to threads threads (0 for one per core), with
+   * stack_bytes of native stack each, read, scan, parse and resolve the
+   * files in order, so that by the time one file has run the next is
+   * usually ready. A file's syntax errors, or that it couldn't be read,
+   * are reported when its turn comes, after the output of the files
+   * before it.
+   *
+   * @return GOOD, or the status of the file that failed.
+   */
+  int run_files(const std::vector<const char *> &paths, size_t threads, size_t stack_bytes);
+
+  // Seconds the last input spent executing.
+  double last_execute_seconds() const { return execute_seconds; }
+
+  /**
+   * @return whether source stops partway through a construct: inside a
+   * string, a block comment, or an unclosed '(' or '{'. The REPL keeps
+   * reading lines until the input is complete.
+   */
+  static bool incomplete(std::string_view source);
+
+  /**
+   * Parses and resolves a function body deferred by a lazy parse, filling
+   * in body and layout.
+   *
+   * @return false after reporting a syntax error in the body.
+   */
+  static bool compile_body(const loxc::deferred_body &deferred,
+                           const std::vector<loxc::lexeme> &params,
+                           Stmt &body, loxc::function_layout &layout);
+
+  /**
+   * Reads the script at path.
+   *
+   * @return std::nullopt after reporting that it couldn't be read.
+   */
+  static std::optional<std::string> read_script(const char *path);
+
+private:
+  // An input scanned, parsed and resolved, ready to run.
+  struct compiled
+  {
+    std::vector<Stmt> program;
+    loxc::function_layout layout;
+  };
+
+  /**
+   * The front end. Touches nothing of the session's but the three
+   * passes given, so files can go through it on any thread.
+   *
+   * @return std::nullopt after reporting a scan or parse error.
+   */
+  static std::optional<compiled> compile(std::string source, Scanner &scanner,
+                                         Parser &parser, Resolver &resolver);
+  int execute(compiled &code, bool wait_for_events);
+
+  // What run_files shares with its threads.
+  struct front_end;
+
+  op::interpreter &interp;
+  bool lazy;
+  Scanner scanner;
+  Parser parser;
+  Resolver resolver;
+  double execute_seconds = 0;
+};
+
+#endif
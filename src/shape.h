@@ -0,0 +1,137 @@
+// hidden classes for lox instances, and the inline caches keyed on them.
+#ifndef shape_h
+#define shape_h
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace loxc
+{
+
+struct callable;
+
+/**
+ * The layout of an instance's fields: which name lives in which slot of
+ * its flat field array. Instances that gained the same fields in the same
+ * order share a shape, found by following the transition for each field
+ * from their class's root shape.
+ *
+ * Every class has its own root, so a shape also pins down the class, and
+ * with it the methods an instance of that shape responds to. Shapes never
+ * change once made; adding a field moves an instance to another shape.
+ *
+ * A shape goes when its class does, and a later one may take its address,
+ * so caches know shapes by an id no other shape in the process gets.
+ */
+class shape
+{
+public:
+    shape() : ident(next_id()) {}
+    shape(const shape&) = delete;
+    shape& operator=(const shape&) = delete;
+
+    /**
+     * @return the slot of the interned name, or -1 if instances of this
+     * shape don't have that field.
+     */
+    int find(const std::string* name) const
+    {
+        for (size_t i = 0; i < names.size(); ++i)
+            if (names[i] == name)
+                return i;
+        return -1;
+    }
+
+    /**
+     * @return the shape of an instance of this shape once it gains the
+     * field name, which goes in the next slot.
+     */
+    const shape* add(const std::string* name) const
+    {
+        // Threads share classes, and with them shapes.
+        static std::mutex lock;
+        std::lock_guard<std::mutex> guard(lock);
+        std::unique_ptr<shape>& next = transitions[name];
+        if ( ! next )
+        {
+            next.reset(new shape());
+            next->names = names;
+            next->names.push_back(name);
+        }
+        return next.get();
+    }
+
+    size_t size() const { return names.size(); }
+    uint64_t id() const { return ident; }
+
+private:
+    static uint64_t next_id()
+    {
+        static std::atomic<uint64_t> counter{1};
+        return counter++;
+    }
+
+    uint64_t ident;
+    // field names in slot order. Classes rarely have more than a handful
+    // of fields, and comparing interned pointers is cheap, so a scan beats
+    // a hash table here.
+    std::vector<const std::string*> names;
+    mutable std::unordered_map<const std::string*, std::unique_ptr<shape>> transitions;
+};
+
+/**
+ * The inline cache of a property access or method call site. Each entry
+ * remembers, for one shape seen at the site, what the name resolved to:
+ * a field slot or a method. A set that adds a field also remembers the
+ * shape the instance moves to. An entry only hits for an instance whose
+ * shape has its id, whose class then keeps the method and the next shape
+ * alive.
+ *
+ * A site that has seen one shape is monomorphic and hits on its first
+ * entry; up to `ways` shapes it is polymorphic. Past that it is marked
+ * megamorphic and stops caching, since every access would churn it.
+ */
+struct property_cache
+{
+    static constexpr int ways = 4;
+
+    struct entry
+    {
+        // the id of the shape it is for.
+        uint64_t from;
+        // the field's slot, or -1 for a method.
+        int slot;
+        const callable* method;
+        // for a set that adds a field, the instance's new shape.
+        const shape* to;
+    };
+
+    entry entries[ways];
+    int used = 0;
+    bool megamorphic = false;
+
+    const entry* find(const shape* s) const
+    {
+        for (int i = 0; i < used; ++i)
+            if (entries[i].from == s->id())
+                return &entries[i];
+        return nullptr;
+    }
+
+    void add(const entry& e)
+    {
+        if (used == ways)
+            megamorphic = true;
+        else if ( ! megamorphic )
+            entries[used++] = e;
+    }
+};
+
+} // namespace loxc
+
+#endif
@@ -0,0 +1,34 @@
+// spans of source text that outlive the parse that found them.
+#ifndef source_h
+#define source_h
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace loxc
+{
+
+/**
+ * A piece of a source file. The span shares ownership of the whole file,
+ * so it stays valid for as long as something holds on to it.
+ */
+struct source_span
+{
+    std::shared_ptr<const std::string> source;
+    uint32_t offset = 0;
+    uint32_t length = 0;
+
+    bool empty() const { return ! source; }
+
+    std::string_view text() const
+    {
+        return source ? std::string_view(*source).substr(offset, length)
+                      : std::string_view();
+    }
+};
+
+} // namespace loxc
+
+#endif
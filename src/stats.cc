@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <utility>
+
+#include "stats.h"
+
+thread_local loxc::stats::counters_t loxc::stats::counters;
+thread_local double loxc::stats::phase_seconds[loxc::stats::PHASE_COUNT];
+
+namespace
+{
+    const char* phase_names[loxc::stats::PHASE_COUNT] =
+        {"scan", "parse", "resolve", "execute"};
+
+    using counter = std::pair<const char*, uint64_t loxc::stats::counters_t::*>;
+
+    const counter counter_names[] = {
+        {"tokens", &loxc::stats::counters_t::tokens},
+        {"nodes", &loxc::stats::counters_t::nodes},
+        {"bodies_deferred", &loxc::stats::counters_t::bodies_deferred},
+        {"bodies_parsed", &loxc::stats::counters_t::bodies_parsed},
+        {"callables", &loxc::stats::counters_t::callables},
+        {"calls", &loxc::stats::counters_t::calls},
+        {"instances", &loxc::stats::counters_t::instances},
+        {"cache_hits", &loxc::stats::counters_t::cache_hits},
+        {"cache_misses", &loxc::stats::counters_t::cache_misses},
+        {"frames", &loxc::stats::counters_t::frames},
+        {"cells", &loxc::stats::counters_t::cells},
+        {"strings", &loxc::stats::counters_t::strings},
+        {"string_bytes", &loxc::stats::counters_t::string_bytes},
+        {"value_copies", &loxc::stats::counters_t::value_copies},
+    };
+
+#ifdef LOXC_STATS
+    const bool have_counters = true;
+#else
+    const bool have_counters = false;
+#endif
+
+    std::mutex merge_lock;
+    loxc::stats::counters_t merged;
+    double merged_seconds[loxc::stats::PHASE_COUNT];
+}
+
+void loxc::stats::merge()
+{
+    std::lock_guard<std::mutex> lock(merge_lock);
+    for (const counter& c : counter_names)
+    {
+        merged.*c.second += counters.*c.second;
+        counters.*c.second = 0;
+    }
+    for (int p = 0; p < PHASE_COUNT; ++p)
+    {
+        merged_seconds[p] += phase_seconds[p];
+        phase_seconds[p] = 0;
+    }
+}
+
+void loxc::stats::report(std::ostream& o, bool json)
+{
+    merge();
+    const counters_t& counters = merged;
+
+    double total = 0;
+    for (double s : merged_seconds)
+        total += s;
+
+    if (json)
+    {
+        o << "{\"phases_ms\": {";
+        for (int p = 0; p < PHASE_COUNT; ++p)
+            o << (p ? ", " : "") << "\"" << phase_names[p] << "\": "
+              << merged_seconds[p] * 1000;
+        o << ", \"total\": " << total * 1000 << "}";
+
+        if (have_counters)
+        {
+            o << ", \"counters\": {";
+            bool first = true;
+            for (const counter& c : counter_names)
+            {
+                o << (first ? "" : ", ") << "\"" << c.first << "\": "
+                  << counters.*c.second;
+                first = false;
+            }
+            o << "}";
+        }
+        o << "}\n";
+        return;
+    }
+
+    o << "[stats] phase          ms\n";
+    for (int p = 0; p < PHASE_COUNT; ++p)
+        o << "[stats]   " << std::left << std::setw(10) << phase_names[p]
+          << std::right << std::setw(10) << std::fixed << std::setprecision(3)
+          << merged_seconds[p] * 1000 << "\n";
+    o << "[stats]   " << std::left << std::setw(10) << "total"
+      << std::right << std::setw(10) << total * 1000 << "\n";
+
+    if ( ! have_counters )
+    {
+        o << "[stats] counters were compiled out (LOXC_STATS=OFF)\n";
+        return;
+    }
+
+    // Wide enough that the longest name still leaves a gap.
+    size_t width = 0;
+    for (const counter& c : counter_names)
+        width = std::max(width, std::strlen(c.first) + 2);
+
+    o << "[stats] counter\n";
+    for (const counter& c : counter_names)
+        o << "[stats]   " << std::left << std::setw(width) << c.first
+          << std::right << std::setw(14) << counters.*c.second << "\n";
+}
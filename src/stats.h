@@ -0,0 +1,105 @@
+// counters and timers for finding out what a script costs.
+#ifndef stats_h
+#define stats_h
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+/**
+ * Hot paths bump counters with LOXC_COUNT. Builds configured without
+ * LOXC_STATS compile every LOXC_COUNT away, leaving only the per-phase
+ * timers, which are taken once per phase rather than per operation.
+ */
+#ifdef LOXC_STATS
+#define LOXC_COUNT(name, n) (loxc::stats::counters.name += (n))
+#else
+#define LOXC_COUNT(name, n) ((void)0)
+#endif
+
+namespace loxc
+{
+namespace stats
+{
+
+enum phase
+{
+    SCAN,
+    PARSE,
+    RESOLVE,
+    EXECUTE,
+    PHASE_COUNT,
+};
+
+struct counters_t
+{
+    uint64_t tokens = 0;       // tokens scanned
+    uint64_t nodes = 0;        // AST nodes parsed
+    uint64_t bodies_deferred = 0; // function bodies skipped by a lazy parse
+    uint64_t bodies_parsed = 0;   // deferred bodies parsed when first called
+    uint64_t callables = 0;    // functions created
+    uint64_t calls = 0;        // calls made, lox or native
+    uint64_t instances = 0;    // class instances made
+    uint64_t cache_hits = 0;   // property accesses answered by an inline cache
+    uint64_t cache_misses = 0; // property accesses that had to look the name up
+    uint64_t frames = 0;       // lox frames pushed onto the value stack
+    uint64_t cells = 0;        // heap cells made for captured variables
+    uint64_t strings = 0;      // strings made by concatenation
+    uint64_t string_bytes = 0; // bytes in those strings
+    uint64_t value_copies = 0; // values copied out of variables and literals
+};
+
+// This thread's counts. Threads other than the first add theirs to the
+// process's with merge before they exit.
+extern thread_local counters_t counters;
+void merge();
+
+// Seconds this thread has spent in each phase, merged like counters.
+extern thread_local double phase_seconds[PHASE_COUNT];
+
+/**
+ * Adds the time between its construction and destruction to a phase. A
+ * timer started while another runs on the thread, such as the scan of a
+ * module the running script imports, takes its time out of the other's,
+ * so no moment is counted toward two phases.
+ */
+class timer
+{
+public:
+    explicit timer(phase p)
+    : p(p), outer(running), start(std::chrono::steady_clock::now())
+    {
+        running = this;
+    }
+    ~timer()
+    {
+        std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+        phase_seconds[p] += took.count() - nested;
+        if (outer)
+            outer->nested += took.count();
+        running = outer;
+    }
+
+    timer(const timer&) = delete;
+    timer& operator=(const timer&) = delete;
+
+private:
+    phase p;
+    timer* outer;
+    // seconds spent in timers started while this one ran.
+    double nested = 0;
+    std::chrono::steady_clock::time_point start;
+
+    static inline thread_local timer* running = nullptr;
+};
+
+/**
+ * Writes the phase timings and counters, as a table or as a JSON object.
+ * The counters are those merged so far plus the calling thread's.
+ */
+void report(std::ostream& o, bool json);
+
+} // namespace stats
+} // namespace loxc
+
+#endif
@@ -25,7 +25,10 @@ using Stmt = std::variant<
 	std::shared_ptr<struct IfStmt>,
 	std::shared_ptr<struct WhileStmt>,
 	std::shared_ptr<struct FuncStmt>,
-	std::shared_ptr<struct ReturnStmt> >;
+	std::shared_ptr<struct ReturnStmt>,
+	std::shared_ptr<struct YieldStmt>,
+	std::shared_ptr<struct ImportStmt>,
+	std::shared_ptr<struct ClassStmt> >;
 
 struct PrintStmt
 {
@@ -45,11 +48,14 @@ struct ExprStmt
 
 struct VarStmt
 {
-	loxc::token name;
+	loxc::lexeme name;
 	Expr initializer;
 
-	VarStmt (loxc::token name_in, Expr initializer_in)
+	VarStmt (loxc::lexeme name_in, Expr initializer_in)
 		: name(std::move(name_in)), initializer(std::move(initializer_in)) {}
+
+	// annotations
+	loxc::binding bind{};
 };
 
 struct BlockStmt
@@ -58,6 +64,9 @@ struct BlockStmt
 
 	BlockStmt (std::vector<Stmt> stmt_list_in)
 		: stmt_list(std::move(stmt_list_in)) {}
+
+	// annotations
+	std::vector<int> hoisted_cells{};
 };
 
 struct IfStmt
@@ -81,21 +90,60 @@ struct WhileStmt
 
 struct FuncStmt
 {
-	loxc::token name;
-	std::vector<loxc::token> params;
+	loxc::lexeme name;
+	std::vector<loxc::lexeme> params;
 	Stmt body;
 
-	FuncStmt (loxc::token name_in, std::vector<loxc::token> params_in, Stmt body_in)
+	FuncStmt (loxc::lexeme name_in, std::vector<loxc::lexeme> params_in, Stmt body_in)
 		: name(std::move(name_in)), params(std::move(params_in)), body(std::move(body_in)) {}
+
+	// annotations
+	loxc::binding bind{};
+	loxc::function_layout layout{};
+	loxc::source_span span{};
+	std::shared_ptr<loxc::deferred_body> deferred{};
+	std::shared_ptr<vm::chunk> code{};
 };
 
 struct ReturnStmt
 {
-	loxc::token keyword;
+	loxc::lexeme keyword;
+	Expr value;
+
+	ReturnStmt (loxc::lexeme keyword_in, Expr value_in)
+		: keyword(std::move(keyword_in)), value(std::move(value_in)) {}
+};
+
+struct YieldStmt
+{
+	loxc::lexeme keyword;
 	Expr value;
 
-	ReturnStmt (loxc::token keyword_in, Expr value_in)
+	YieldStmt (loxc::lexeme keyword_in, Expr value_in)
 		: keyword(std::move(keyword_in)), value(std::move(value_in)) {}
 };
 
+struct ImportStmt
+{
+	loxc::lexeme keyword;
+	std::string path;
+
+	ImportStmt (loxc::lexeme keyword_in, std::string path_in)
+		: keyword(std::move(keyword_in)), path(std::move(path_in)) {}
+};
+
+struct ClassStmt
+{
+	loxc::lexeme name;
+	Expr superclass;
+	std::vector<std::shared_ptr<FuncStmt>> methods;
+
+	ClassStmt (loxc::lexeme name_in, Expr superclass_in, std::vector<std::shared_ptr<FuncStmt>> methods_in)
+		: name(std::move(name_in)), superclass(std::move(superclass_in)), methods(std::move(methods_in)) {}
+
+	// annotations
+	loxc::binding bind{};
+	loxc::binding super_bind{};
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,220 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "text.h"
+#include "callable.h"
+#include "object.h"
+#include "op.h"
+#include "stats.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && ! defined(LOXC_NO_SIMD)
+#define LOXC_AVX2_SEARCH
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    size_t search_scalar(std::string_view haystack, std::string_view needle, size_t from)
+    {
+        return haystack.find(needle, from);
+    }
+
+#ifdef LOXC_AVX2_SEARCH
+
+    __attribute__((target("avx2")))
+    size_t search_avx2(std::string_view haystack, std::string_view needle, size_t from)
+    {
+        size_t k = needle.size();
+        size_t n = haystack.size();
+        // A single byte is memchr's job already.
+        if (k < 2 || from > n || n - from < k)
+            return haystack.find(needle, from);
+
+        const char* h = haystack.data();
+        const char* p = needle.data();
+        const __m256i first = _mm256_set1_epi8(p[0]);
+        const __m256i last = _mm256_set1_epi8(p[k - 1]);
+
+        size_t i = from;
+        for (; i + k - 1 + 32 <= n; i += 32)
+        {
+            __m256i starts = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + i));
+            __m256i ends = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + i + k - 1));
+            uint32_t candidates = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(
+                _mm256_cmpeq_epi8(starts, first), _mm256_cmpeq_epi8(ends, last))));
+            while (candidates)
+            {
+                size_t at = i + __builtin_ctz(candidates);
+                if (std::memcmp(h + at + 1, p + 1, k - 2) == 0)
+                    return at;
+                candidates &= candidates - 1;
+            }
+        }
+        return haystack.find(needle, i);
+    }
+
+#endif
+
+    using search_fn = size_t (*)(std::string_view, std::string_view, size_t);
+
+    // Picked once, on first use, by what the CPU running us supports.
+    search_fn searcher()
+    {
+        static const search_fn chosen = []{
+#ifdef LOXC_AVX2_SEARCH
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2"))
+                return search_avx2;
+#endif
+            return search_scalar;
+        }();
+        return chosen;
+    }
+
+    bool is_string(const std::vector<Val>& args, size_t i)
+    {
+        return i < args.size() && std::holds_alternative<std::string>(args[i]);
+    }
+
+    /**
+     * args[i] as a position in s, which may be one past its end, or
+     * otherwise if args has no i.
+     */
+    size_t position(const op::interpreter& interp, const char* builtin,
+        const std::vector<Val>& args, size_t i, const std::string& s, size_t otherwise)
+    {
+        if (i >= args.size())
+            return otherwise;
+        const double* d = std::get_if<double>(&args[i]);
+        if ( ! d || ! (*d >= 0 && *d <= s.size()) || std::floor(*d) != *d )
+            throw op::builtin_error(interp, builtin, "Index out of range.");
+        return static_cast<size_t>(*d);
+    }
+
+    Val made(std::string s)
+    {
+        LOXC_COUNT(strings, 1);
+        LOXC_COUNT(string_bytes, s.size());
+        return s;
+    }
+}
+
+size_t text::search(std::string_view haystack, std::string_view needle, size_t from)
+{
+    return searcher()(haystack, needle, from);
+}
+
+Val text::substr(op::interpreter& interp, std::vector<Val> args)
+{
+    if (args.size() < 2 || args.size() > 3 || ! is_string(args, 0))
+        throw op::builtin_error(interp, "substr", "substr expects a string, a start and maybe a length.");
+    const std::string& s = std::get<std::string>(args[0]);
+    size_t start = position(interp, "substr", args, 1, s, 0);
+    size_t length = s.size() - start;
+    if (args.size() == 3)
+    {
+        const double* d = std::get_if<double>(&args[2]);
+        if ( ! d || ! (*d >= 0) || std::floor(*d) != *d )
+            throw op::builtin_error(interp, "substr", "substr expects a length of 0 or more.");
+        if (*d < length)
+            length = static_cast<size_t>(*d);
+    }
+    return made(s.substr(start, length));
+}
+
+Val text::find(op::interpreter& interp, std::vector<Val> args)
+{
+    if (args.size() < 2 || args.size() > 3 || ! is_string(args, 0) || ! is_string(args, 1))
+        throw op::builtin_error(interp, "find", "find expects two strings and maybe a start.");
+    const std::string& s = std::get<std::string>(args[0]);
+    size_t from = position(interp, "find", args, 2, s, 0);
+    size_t at = text::search(s, std::get<std::string>(args[1]), from);
+    return at == std::string::npos ? -1.0 : static_cast<double>(at);
+}
+
+Val text::split(op::interpreter& interp, std::vector<Val> args)
+{
+    if (args.size() != 2 || ! is_string(args, 0) || ! is_string(args, 1))
+        throw op::builtin_error(interp, "split", "split expects a string and a separator.");
+    std::string_view s = std::get<std::string>(args[0]);
+    std::string_view separator = std::get<std::string>(args[1]);
+
+    auto pieces = std::make_shared<loxc::list>();
+    if (separator.empty())
+    {
+        pieces->items.reserve(s.size());
+        for (char c : s)
+            pieces->items.push_back(made(std::string(1, c)));
+        return pieces;
+    }
+
+    size_t start = 0;
+    for (size_t at; (at = text::search(s, separator, start)) != std::string_view::npos;
+        start = at + separator.size())
+        pieces->items.push_back(made(std::string(s.substr(start, at - start))));
+    pieces->items.push_back(made(std::string(s.substr(start))));
+    return pieces;
+}
+
+Val text::join(op::interpreter& interp, std::vector<Val> args)
+{
+    const char* usage = "join expects a list of strings and a separator.";
+    if (args.size() != 2 || ! std::holds_alternative<std::shared_ptr<loxc::list>>(args[0])
+        || ! is_string(args, 1))
+        throw op::builtin_error(interp, "join", usage);
+    const std::vector<Val>& items = std::get<std::shared_ptr<loxc::list>>(args[0])->items;
+    const std::string& separator = std::get<std::string>(args[1]);
+
+    // Sized first, so the result is allocated once.
+    size_t size = items.empty() ? 0 : separator.size() * (items.size() - 1);
+    for (const Val& item : items)
+    {
+        const std::string* s = std::get_if<std::string>(&item);
+        if ( ! s )
+            throw op::builtin_error(interp, "join", usage);
+        size += s->size();
+    }
+
+    std::string joined;
+    joined.reserve(size);
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        if (i)
+            joined += separator;
+        joined += std::get<std::string>(items[i]);
+    }
+    return made(std::move(joined));
+}
+
+Val text::replace(op::interpreter& interp, std::vector<Val> args)
+{
+    if (args.size() != 3 || ! is_string(args, 0) || ! is_string(args, 1) || ! is_string(args, 2))
+        throw op::builtin_error(interp, "replace", "replace expects three strings.");
+    std::string_view s = std::get<std::string>(args[0]);
+    std::string_view old = std::get<std::string>(args[1]);
+    std::string_view with = std::get<std::string>(args[2]);
+    if (old.empty())
+        throw op::builtin_error(interp, "replace", "Can't replace an empty string.");
+
+    std::vector<size_t> found;
+    for (size_t at = text::search(s, old); at != std::string_view::npos;
+        at = text::search(s, old, at + old.size()))
+        found.push_back(at);
+    if (found.empty())
+        return std::move(args[0]);
+
+    std::string replaced;
+    replaced.reserve(s.size() - found.size() * old.size() + found.size() * with.size());
+    size_t start = 0;
+    for (size_t at : found)
+    {
+        replaced.append(s.substr(start, at - start));
+        replaced.append(with);
+        start = at + old.size();
+    }
+    replaced.append(s.substr(start));
+    return made(std::move(replaced));
+}
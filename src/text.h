@@ -0,0 +1,45 @@
+// string builtins, and the substring search under them.
+#ifndef text_h
+#define text_h
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+#include "val.h"
+
+namespace op
+{
+    struct interpreter;
+}
+
+/**
+ * substr(s, start, length) copies out part of s, to its end if length is
+ * left off; find(s, needle, from) is where needle first occurs at or after
+ * from (0 if left off), or -1. split(s, separator) makes a list of the
+ * pieces between separators, or of single characters if the separator is
+ * empty, and join(list, separator) glues a list of strings back together.
+ * replace(s, old, new) replaces every occurrence of old. Indexes count
+ * bytes.
+ */
+namespace text
+{
+
+/**
+ * The index of the first needle in haystack at or after from, or npos.
+ * With AVX2 it tests 32 places at once against the needle's first and
+ * last bytes, comparing the rest only where both match, which skips runs
+ * of a common first byte that trip up a memchr based search.
+ */
+size_t search(std::string_view haystack, std::string_view needle, size_t from = 0);
+
+// The builtins. args as lox passed them.
+Val substr(op::interpreter& interp, std::vector<Val> args);
+Val find(op::interpreter& interp, std::vector<Val> args);
+Val split(op::interpreter& interp, std::vector<Val> args);
+Val join(op::interpreter& interp, std::vector<Val> args);
+Val replace(op::interpreter& interp, std::vector<Val> args);
+
+} // namespace text
+
+#endif
@@ -1,7 +1,56 @@
 #include <iostream>
+#include <mutex>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "token_type.h"
+#include "token.h"
+
+const std::unordered_map<std::string_view, loxc::token_type> loxc::keywords_map =
+    {
+        {"and", loxc::AND},
+        {"abort", loxc::ABORT},
+        {"or", loxc::OR},
+        {"if", loxc::IF},
+        {"else", loxc::ELSE},
+        {"class", loxc::CLASS},
+        {"true", loxc::TRUE},
+        {"false", loxc::FALSE},
+        {"fun", loxc::FUN},
+        {"anon", loxc::ANON},
+        {"for", loxc::FOR},
+        {"nil", loxc::NIL},
+        {"or", loxc::OR},
+        {"print", loxc::PRINT},
+        {"return", loxc::RETURN},
+        {"super", loxc::SUPER},
+        {"this", loxc::THIS},
+        {"var", loxc::VAR},
+        {"while", loxc::WHILE},
+        {"yield", loxc::YIELD},
+        {"import", loxc::IMPORT}};
+
+const std::string *loxc::intern(std::string_view s)
+{
+  static std::mutex lock;
+  // Nodes of an unordered_set never move, so the pointers handed out stay
+  // valid as the table grows.
+  static std::unordered_set<std::string> table;
+  // What this thread has interned already, viewing the table's copies, so
+  // parsers on several threads mostly don't contend for the lock.
+  thread_local std::unordered_map<std::string_view, const std::string *> seen;
+
+  if (auto found = seen.find(s); found != seen.end())
+    return found->second;
+
+  const std::string *interned;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    interned = &*table.emplace(s).first;
+  }
+  seen.emplace(*interned, interned);
+  return interned;
+}
 
 std::ostream &operator<<(std::ostream &o, loxc::token_type n)
 {
@@ -77,6 +126,10 @@ std::ostream &operator<<(std::ostream &o, loxc::token_type n)
     return o << "VAR";
   case loxc::WHILE:
     return o << "WHILE";
+  case loxc::YIELD:
+    return o << "YIELD";
+  case loxc::IMPORT:
+    return o << "IMPORT";
   case loxc::ID:
     return o << "ID";
   case loxc::STRING:
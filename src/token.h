@@ -1,15 +1,20 @@
-// the parser generates tokens. a token has a type, data, a lexme, and a line.
-// the type informs how the data should be interpreted later.
+// the scanner generates tokens. a token has a type, a line and the span of
+// source it came from. the parser keeps a lexeme of the tokens it needs.
 
 #ifndef token_h
 #define token_h
 
-#include <memory>   // std::unique_ptr
-#include <optional> // std::optional
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
 #include "token_type.h"
+#include "source.h"
 #include "val.h"
 
 std::ostream &operator<<(std::ostream &o, loxc::token_type n);
@@ -18,47 +23,104 @@ namespace loxc
 {
 
 /**
- * A token in loxc.
- * 
- * TODO: the current representation of data does not work.
+ * A token in loxc. Tokens are 16 bytes and own nothing: their text is the
+ * span [offset, offset + length) of the source they were scanned from,
+ * and the value of a string or number literal lives in the literal table
+ * next to them (see token_list).
+ *
+ * Keeping them that small limits a source to max_source bytes and
+ * max_line lines; the scanner refuses anything larger.
  */
 struct token
 {
-  loxc::token_type type;
-  std::optional<Val> data;
-  std::string lexme;
-  int line;
+  static constexpr uint32_t no_literal = UINT32_MAX;
+  static constexpr size_t max_source = UINT32_MAX;
+  static constexpr size_t max_line = (1u << 24) - 1;
+
+  uint32_t offset;
+  uint32_t length;
+  uint32_t line : 24;
+  loxc::token_type type : 8;
+  uint32_t literal;
+};
 
-  token(loxc::token_type t, Val d, std::string lex, int l)
-      : type(t), data(std::move(d)), lexme(std::move(lex)), line(l) {}
+static_assert(sizeof(token) == 16, "tokens should stay small");
+
+/**
+ * The scanner's output: the source, its tokens and the literal values
+ * they refer to.
+ */
+struct token_list
+{
+  // shared so that function declarations can keep their text (see
+  // loxc::source_span) after the tokens are gone.
+  std::shared_ptr<const std::string> source;
+  std::vector<token> tokens;
+  std::vector<Val> literals;
 
-  friend std::ostream &operator<<(std::ostream &os, const loxc::token &tok)
+  std::string_view text(const token &t) const
   {
-    return os << "'" << tok.lexme << "'";
+    return std::string_view(*source).substr(t.offset, t.length);
   }
 };
 
-const std::unordered_map<std::string, loxc::token_type> keywords_map =
-    {
-        {"and", loxc::AND},
-        {"abort", loxc::ABORT},
-        {"or", loxc::OR},
-        {"if", loxc::IF},
-        {"else", loxc::ELSE},
-        {"class", loxc::CLASS},
-        {"true", loxc::TRUE},
-        {"false", loxc::FALSE},
-        {"fun", loxc::FUN},
-        {"anon", loxc::ANON},
-        {"for", loxc::FOR},
-        {"nil", loxc::NIL},
-        {"or", loxc::OR},
-        {"print", loxc::PRINT},
-        {"return", loxc::RETURN},
-        {"super", loxc::SUPER},
-        {"this", loxc::THIS},
-        {"var", loxc::VAR},
-        {"while", loxc::WHILE}};
+/**
+ * A function body the parser skipped over, to be parsed if the function
+ * is ever called: the index of its '{' in a token list kept alive for it.
+ *
+ * The first call parses it, on whichever thread makes the call, holding
+ * lock. A body that fails to parse is not tried again; it keeps the
+ * errors it reported, and every call raises them.
+ */
+struct deferred_body
+{
+  enum status : uint8_t { PENDING, PARSED, FAILED };
+
+  std::shared_ptr<const token_list> tokens;
+  size_t first;
+
+  std::atomic<status> state{PENDING};
+  std::mutex lock;
+  std::string errors;
+
+  deferred_body(std::shared_ptr<const token_list> tokens, size_t first)
+  : tokens(std::move(tokens)), first(first) {}
+
+  bool parsed() const { return state.load(std::memory_order_acquire) == PARSED; }
+};
+
+/**
+ * @return the one copy of s that every caller interning equal text gets.
+ * Interned strings live for the rest of the process, so the pointers can
+ * be compared and hashed directly. Safe to call from any thread.
+ */
+const std::string *intern(std::string_view s);
+
+/**
+ * What the syntax tree keeps of a token: its type, its line and its text,
+ * interned. Enough to look a name up and to report an error, with no
+ * reference to the source.
+ */
+struct lexeme
+{
+  loxc::token_type type;
+  int line;
+  const std::string *text;
+
+  const std::string &str() const { return *text; }
+};
+
+/**
+ * @return the source from the start of first to the end of last.
+ */
+inline source_span span(const token_list &list, const token &first, const token &last)
+{
+  return {list.source, first.offset, last.offset + last.length - first.offset};
+}
+
+// Every reserved word. Filled in before main and only read after, so
+// scanners on any number of threads share the one copy.
+extern const std::unordered_map<std::string_view, loxc::token_type> keywords_map;
 
 } // namespace loxc
 
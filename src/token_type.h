@@ -50,6 +50,8 @@ enum token_type
   TRUE,
   VAR,
   WHILE,
+  YIELD,
+  IMPORT,
   ABORT,
   ANON,
 
@@ -4,6 +4,10 @@
 
 #include "val.h"
 #include "callable.h"
+#include "object.h"
+#include "output.h"
+#include "number.h"
+#include "array.h"
 
 std::ostream &operator<<(std::ostream &o, const Val& v)
 {
@@ -12,13 +16,52 @@ std::ostream &operator<<(std::ostream &o, const Val& v)
         case 0:
             o << "<nil>"; break;
         case 1:
-            o << std::get<double>(v); break;
+            {
+            char tmp[loxc::number_buffer_size];
+            o.write(tmp, loxc::format_number(std::get<double>(v), tmp));
+            break;
+            }
         case 2:
             o << std::get<std::string>(v); break;
         case 3:
             o << std::get<bool>(v); break;
         case 4:
             o << std::get<std::shared_ptr<loxc::callable>>(v)->str; break;
+        case 5:
+            o << "<" << std::get<std::shared_ptr<loxc::instance>>(v)->cls->name << " instance>"; break;
+        case 6:
+            o << "<Float64Array " << std::get<std::shared_ptr<loxc::float64_array>>(v)->size() << ">"; break;
+        case 7:
+            o << "<list " << std::get<std::shared_ptr<loxc::list>>(v)->items.size() << ">"; break;
+        case 8:
+            o << "<map " << std::get<std::shared_ptr<loxc::map>>(v)->entries.size() << ">"; break;
+    }
+
+    return o;
+}
+
+loxc::output &operator<<(loxc::output &o, const Val& v)
+{
+    switch(v.index())
+    {
+        case 0:
+            o << "<nil>"; break;
+        case 1:
+            o << std::get<double>(v); break;
+        case 2:
+            o << std::get<std::string>(v); break;
+        case 3:
+            o << (std::get<bool>(v) ? '1' : '0'); break;
+        case 4:
+            o << std::get<std::shared_ptr<loxc::callable>>(v)->str; break;
+        case 5:
+            o << "<" << std::get<std::shared_ptr<loxc::instance>>(v)->cls->name << " instance>"; break;
+        case 6:
+            o << "<Float64Array " << std::get<std::shared_ptr<loxc::float64_array>>(v)->size() << ">"; break;
+        case 7:
+            o << "<list " << std::get<std::shared_ptr<loxc::list>>(v)->items.size() << ">"; break;
+        case 8:
+            o << "<map " << std::get<std::shared_ptr<loxc::map>>(v)->entries.size() << ">"; break;
     }
 
     return o;
@@ -10,6 +10,11 @@
 namespace loxc
 {
     struct callable;
+    struct instance;
+    class float64_array;
+    struct list;
+    struct map;
+    class output;
 }
 
 using Val = std::variant<
@@ -17,9 +22,14 @@ using Val = std::variant<
     double,
     std::string,
     bool,
-    std::shared_ptr<loxc::callable> >;
+    std::shared_ptr<loxc::callable>,
+    std::shared_ptr<loxc::instance>,
+    std::shared_ptr<loxc::float64_array>,
+    std::shared_ptr<loxc::list>,
+    std::shared_ptr<loxc::map> >;
 
 std::ostream &operator<<(std::ostream &o, const Val& v);
+loxc::output &operator<<(loxc::output &o, const Val& v);
 
 bool is_truthy(const Val& v);
 
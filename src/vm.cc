@@ -0,0 +1,1145 @@
+#include <algorithm>
+#include <iomanip>
+#include <iterator>
+#include <string>
+#include <utility>
+
+#include "vm.h"
+#include "numeric.h"
+#include "op.h"
+#include "callable.h"
+#include "output.h"
+#include "stats.h"
+
+namespace
+{
+    const char* opcode_names[] = {
+#define LOXC_OPCODE_NAME(name, effect) #name,
+        LOXC_OPCODES(LOXC_OPCODE_NAME)
+#undef LOXC_OPCODE_NAME
+    };
+
+    const int opcode_effects[] = {
+#define LOXC_OPCODE_EFFECT(name, effect) effect,
+        LOXC_OPCODES(LOXC_OPCODE_EFFECT)
+#undef LOXC_OPCODE_EFFECT
+    };
+
+#ifdef LOXC_VM_PROFILE
+    // pairs[a][b] counts b running straight after a. Row OPCODE_COUNT
+    // counts the first instruction of each run.
+    uint64_t pairs[vm::OPCODE_COUNT + 1][vm::OPCODE_COUNT];
+#endif
+
+    /**
+     * COMPILER
+     */
+
+    // What a statement does with its value. Only a statement that can be
+    // the last one a body runs needs one: in the tail of the body it
+    // returns it, in the tail of a loop body it leaves it in the result
+    // register in case the loop turns out to be the last thing run, and in
+    // the tail of an inlined body it leaves it on the stack and jumps past
+    // the body.
+    enum tail_t
+    {
+        NO_TAIL,
+        RETURN_TAIL,
+        RECORD_TAIL,
+        INLINE_TAIL,
+    };
+
+    // The most nodes a function's body can have and still be inlined.
+    const size_t max_inline_nodes = 32;
+
+    const Expr& strip_grouping(const Expr& e)
+    {
+        if (auto g = std::get_if<std::shared_ptr<GroupingExpr>>(&e))
+            return strip_grouping((*g)->expression);
+        return e;
+    }
+
+    const double* number_of(const Expr& e)
+    {
+        auto lit = std::get_if<std::shared_ptr<LiteralExpr>>(&strip_grouping(e));
+        return lit ? std::get_if<double>(&(*lit)->value) : nullptr;
+    }
+
+    /**
+     * Whether a body is small enough to inline and holds only what the
+     * vm runs itself: no loops, whose values would need the result
+     * register, no calls, which would need a frame of their own in a
+     * backtrace, and nothing left to the tree walker, which knows only
+     * the function's own slots.
+     */
+    class inline_check
+    {
+    public:
+        bool stmt(const Stmt& s)
+        {
+            if (std::holds_alternative<std::monostate>(s))
+                return true;
+            return count() && std::visit(*this, s);
+        }
+
+        bool expr(const Expr& e)
+        {
+            if (std::holds_alternative<std::monostate>(e))
+                return true;
+            return count() && std::visit(*this, e);
+        }
+
+        bool operator()(const std::shared_ptr<BinaryExpr>& e)
+        {
+            return expr(e->left) && expr(e->right);
+        }
+        bool operator()(const std::shared_ptr<GroupingExpr>& e) { return expr(e->expression); }
+        bool operator()(const std::shared_ptr<LiteralExpr>&) { return true; }
+        bool operator()(const std::shared_ptr<UnaryExpr>& e) { return expr(e->right); }
+        bool operator()(const std::shared_ptr<VarExpr>& e) { return plain(e->bind); }
+        bool operator()(const std::shared_ptr<RedefExpr>& e)
+        {
+            return plain(e->bind) && expr(e->value);
+        }
+        bool operator()(const std::shared_ptr<LogicExpr>& e)
+        {
+            return expr(e->left) && expr(e->right);
+        }
+
+        bool operator()(const std::shared_ptr<PrintStmt>& s) { return expr(s->expression); }
+        bool operator()(const std::shared_ptr<ExprStmt>& s) { return expr(s->expression); }
+        bool operator()(const std::shared_ptr<VarStmt>& s)
+        {
+            return s->bind.kind == loxc::binding::SLOT && expr(s->initializer);
+        }
+        bool operator()(const std::shared_ptr<BlockStmt>& s)
+        {
+            for (const Stmt& inner : s->stmt_list)
+                if ( ! stmt(inner) )
+                    return false;
+            return true;
+        }
+        bool operator()(const std::shared_ptr<IfStmt>& s)
+        {
+            return expr(s->condition) && stmt(s->t_branch) && stmt(s->f_branch);
+        }
+        bool operator()(const std::shared_ptr<ReturnStmt>& s) { return expr(s->value); }
+
+        template <typename Node>
+        bool operator()(const Node&) { return false; }
+
+    private:
+        size_t budget = max_inline_nodes;
+
+        bool count()
+        {
+            if (budget == 0)
+                return false;
+            --budget;
+            return true;
+        }
+
+        static bool plain(const loxc::binding& bind)
+        {
+            return bind.kind == loxc::binding::SLOT || bind.kind == loxc::binding::GLOBAL;
+        }
+    };
+
+    class compiler
+    {
+    public:
+        compiler(vm::chunk& c, bool fuse, const vm::inline_table* inlinable, int slots)
+        : c(c), fuse(fuse), inlinable(inlinable), frame_slots(slots) {}
+
+        void stmt(const Stmt& s, tail_t t)
+        {
+            if (std::holds_alternative<std::monostate>(s))
+            {
+                // An empty else branch: the if's value is nil.
+                if (t != NO_TAIL)
+                {
+                    nil();
+                    finish(t);
+                }
+                return;
+            }
+            tail = t;
+            std::visit(*this, s);
+        }
+
+        void expr(const Expr& e)
+        {
+            std::visit(*this, e);
+        }
+
+        void emit(vm::opcode op, const loxc::lexeme& where = {}, int a = 0,
+            int b = 0, int target = 0)
+        {
+            c.code.push_back({op, a, b, target});
+            c.where.push_back(where);
+
+            depth += opcode_effects[op];
+            if (op == vm::CALL)
+                depth -= a;
+            c.depth = std::max(c.depth, size_t(depth));
+        }
+
+        // Points the jump at `at` to the next instruction emitted.
+        void land(size_t at)
+        {
+            target(c.code[at]) = c.code.size();
+        }
+
+        /**
+         * EXPRESSIONS
+         */
+
+        void operator()(std::shared_ptr<BinaryExpr> e)
+        {
+            int slot = slot_of(e->left);
+            const double* n = number_of(e->right);
+            if (fuse && slot >= 0 && n && e->op.type == loxc::PLUS)
+                return emit(vm::ADD_SLOT_NUM, e->op, slot, number(*n));
+            if (fuse && slot >= 0 && n && e->op.type == loxc::MINUS)
+                return emit(vm::SUBTRACT_SLOT_NUM, e->op, slot, number(*n));
+
+            expr(e->left);
+            expr(e->right);
+            switch (e->op.type)
+            {
+                case loxc::PLUS: return emit(vm::ADD, e->op);
+                case loxc::MINUS: return emit(vm::SUBTRACT, e->op);
+                case loxc::STAR: return emit(vm::MULTIPLY, e->op);
+                case loxc::SLASH: return emit(vm::DIVIDE, e->op);
+                case loxc::LESS: return emit(vm::LESS, e->op);
+                case loxc::LESS_EQUAL: return emit(vm::LESS_EQUAL, e->op);
+                case loxc::GREATER: return emit(vm::GREATER, e->op);
+                case loxc::GREATER_EQUAL: return emit(vm::GREATER_EQUAL, e->op);
+                case loxc::EQUAL_EQUAL: return emit(vm::EQUAL, e->op);
+                case loxc::BANG_EQUAL: return emit(vm::NOT_EQUAL, e->op);
+            }
+            throw op::runtime_error(e->op, "Invalid operator.");
+        }
+
+        void operator()(std::shared_ptr<GroupingExpr> e)
+        {
+            expr(e->expression);
+        }
+
+        void operator()(std::shared_ptr<LiteralExpr> e)
+        {
+            emit(vm::CONST, {}, constant(e->value));
+        }
+
+        void operator()(std::shared_ptr<UnaryExpr> e)
+        {
+            expr(e->right);
+            emit(e->op.type == loxc::MINUS ? vm::NEGATE : vm::NOT, e->op);
+        }
+
+        void operator()(std::shared_ptr<VarExpr> e)
+        {
+            access(e->name, e->bind, vm::GET_SLOT, vm::GET_CELL,
+                vm::GET_UPVALUE, vm::GET_GLOBAL);
+        }
+
+        void operator()(std::shared_ptr<RedefExpr> e)
+        {
+            expr(e->value);
+            access(e->name, e->bind, vm::SET_SLOT, vm::SET_CELL,
+                vm::SET_UPVALUE, vm::SET_GLOBAL);
+        }
+
+        void operator()(std::shared_ptr<LogicExpr> e)
+        {
+            expr(e->left);
+            size_t jump = c.code.size();
+            emit(e->op.type == loxc::OR ? vm::OR : vm::AND, e->op);
+            expr(e->right);
+            land(jump);
+        }
+
+        void operator()(std::shared_ptr<CallExpr> e)
+        {
+            // Method calls skip making a bound method, which only the tree
+            // walker knows how to do.
+            if (std::holds_alternative<std::shared_ptr<GetExpr>>(e->callee))
+                return eval(e);
+            if (inline_call(*e))
+                return;
+
+            expr(e->callee);
+            for (const Expr& arg : e->args)
+                expr(arg);
+            emit(vm::CALL, e->closing_paren, e->args.size());
+        }
+
+        void operator()(std::shared_ptr<GetExpr> e) { eval(e); }
+        void operator()(std::shared_ptr<SetExpr> e) { eval(e); }
+        void operator()(std::shared_ptr<SuperExpr> e) { eval(e); }
+        void operator()(std::shared_ptr<FunExpr> e) { eval(e); }
+
+        // A missing expression, such as a variable's initializer.
+        void operator()(std::monostate) { nil(); }
+
+        /**
+         * STATEMENTS
+         */
+
+        void operator()(std::shared_ptr<PrintStmt> s)
+        {
+            tail_t t = tail;
+            expr(s->expression);
+            emit(vm::PRINT);
+            if (t != NO_TAIL)
+            {
+                nil();
+                finish(t);
+            }
+        }
+
+        void operator()(std::shared_ptr<ExprStmt> s)
+        {
+            tail_t t = tail;
+            auto redef = std::get_if<std::shared_ptr<RedefExpr>>(&s->expression);
+            if (fuse && t == NO_TAIL && redef && (*redef)->bind.kind == loxc::binding::SLOT)
+            {
+                int slot = local((*redef)->bind.index);
+                auto sum = std::get_if<std::shared_ptr<BinaryExpr>>(&(*redef)->value);
+                const double* n = sum ? number_of((*sum)->right) : nullptr;
+                if (n && (*sum)->op.type == loxc::PLUS && slot_of((*sum)->left) == slot)
+                    return emit(vm::INCREMENT_SLOT, (*sum)->op, slot, number(*n));
+
+                expr((*redef)->value);
+                return emit(vm::SET_SLOT_POP, {}, slot);
+            }
+
+            expr(s->expression);
+            finish(t);
+        }
+
+        void operator()(std::shared_ptr<VarStmt> s)
+        {
+            tail_t t = tail;
+            switch (s->bind.kind)
+            {
+                case loxc::binding::SLOT:
+                    expr(s->initializer);
+                    if (t == NO_TAIL && fuse)
+                        return emit(vm::SET_SLOT_POP, {}, local(s->bind.index));
+                    emit(vm::SET_SLOT, {}, local(s->bind.index));
+                    break;
+                case loxc::binding::CELL:
+                    // The cell goes first, so a closure in the initializer
+                    // captures the variable being declared. A redeclaration
+                    // keeps the cell closures already share.
+                    if ( ! s->bind.redeclares )
+                        emit(vm::NEW_CELL, {}, s->bind.index);
+                    expr(s->initializer);
+                    emit(vm::SET_CELL, {}, s->bind.index);
+                    break;
+                default:
+                    expr(s->initializer);
+                    emit(vm::DEFINE_GLOBAL, {}, global(s->name));
+            }
+            finish(t);
+        }
+
+        void operator()(std::shared_ptr<BlockStmt> s)
+        {
+            tail_t t = tail;
+            if (s->stmt_list.empty())
+                return stmt(Stmt(), t);
+
+            for (int cell : s->hoisted_cells)
+                emit(vm::NEW_CELL, {}, cell);
+            for (size_t i = 0; i + 1 < s->stmt_list.size(); ++i)
+                stmt(s->stmt_list[i], NO_TAIL);
+            stmt(s->stmt_list.back(), t);
+        }
+
+        void operator()(std::shared_ptr<IfStmt> s)
+        {
+            tail_t t = tail;
+            size_t skip_then = jump_if_false(s->condition);
+            stmt(s->t_branch, t);
+
+            if (std::holds_alternative<std::monostate>(s->f_branch) && t == NO_TAIL)
+                return land(skip_then);
+
+            size_t skip_else = c.code.size();
+            emit(vm::JUMP);
+            land(skip_then);
+            stmt(s->f_branch, t);
+            land(skip_else);
+        }
+
+        void operator()(std::shared_ptr<WhileStmt> s)
+        {
+            tail_t t = tail;
+            // A loop's value is that of its body's last run, or nil if the
+            // body never ran.
+            if (t != NO_TAIL)
+            {
+                nil();
+                emit(vm::SET_RESULT);
+            }
+
+            size_t loop = c.code.size();
+            size_t exit = jump_if_false(s->condition);
+            stmt(s->body, t == NO_TAIL ? NO_TAIL : RECORD_TAIL);
+            emit(vm::JUMP, {}, loop);
+            land(exit);
+
+            if (t == RETURN_TAIL)
+                emit(vm::RETURN_RESULT);
+        }
+
+        void operator()(std::shared_ptr<ReturnStmt> s)
+        {
+            expr(s->value);
+            if (inline_exits)
+                return finish(INLINE_TAIL);
+            emit(vm::RETURN, s->keyword);
+        }
+
+        void operator()(std::shared_ptr<YieldStmt> s)
+        {
+            tail_t t = tail;
+            expr(s->value);
+            emit(vm::YIELD, s->keyword);
+            if (t != NO_TAIL)
+            {
+                nil();
+                finish(t);
+            }
+        }
+
+        void operator()(std::shared_ptr<FuncStmt> s) { exec(s); }
+        void operator()(std::shared_ptr<ImportStmt> s) { exec(s); }
+        void operator()(std::shared_ptr<ClassStmt> s) { exec(s); }
+
+    private:
+        vm::chunk& c;
+        bool fuse;
+        const vm::inline_table* inlinable;
+        const int frame_slots;
+        tail_t tail = NO_TAIL;
+        int depth = 0;
+        int nil_constant = -1;
+        // While compiling an inlined body: where its locals start, and its
+        // jumps past the end.
+        int slot_offset = 0;
+        std::vector<size_t>* inline_exits = nullptr;
+
+        static int32_t& target(vm::instr& jump)
+        {
+            if (jump.op == vm::JUMP_IF_NOT_LESS_SLOT_NUM ||
+                jump.op == vm::JUMP_IF_NOT_LESS_SLOT_SLOT ||
+                jump.op == vm::GUARD_INLINE)
+                return jump.c;
+            return jump.a;
+        }
+
+        static bool is_jump(vm::opcode op)
+        {
+            switch (op)
+            {
+                case vm::JUMP: case vm::JUMP_IF_FALSE: case vm::AND: case vm::OR:
+                case vm::GUARD_INLINE: case vm::JUMP_IF_NOT_LESS:
+                case vm::JUMP_IF_NOT_LESS_SLOT_NUM: case vm::JUMP_IF_NOT_LESS_SLOT_SLOT:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        // The slot a local of the body being compiled lives in.
+        int local(int index)
+        {
+            return index + slot_offset;
+        }
+
+        // The slot of a local read, or -1.
+        int slot_of(const Expr& e)
+        {
+            auto var = std::get_if<std::shared_ptr<VarExpr>>(&strip_grouping(e));
+            if (var && (*var)->bind.kind == loxc::binding::SLOT)
+                return local((*var)->bind.index);
+            return -1;
+        }
+
+        /**
+         * Compiles a call to a global function in the inline table as
+         * its body, behind a guard that the global still holds it:
+         *
+         *         GUARD_INLINE f -> inline
+         *         GET_GLOBAL f; args; CALL; JUMP done
+         *     inline:
+         *         args; SET_SLOT_POP each parameter, last first
+         *         body, each exit leaving its value and jumping to done
+         *     done:
+         *
+         * Arguments are all evaluated before any is stored, as an
+         * argument might itself be an inlined call using the same slots.
+         *
+         * @return false if the call can't be inlined.
+         */
+        bool inline_call(const CallExpr& e)
+        {
+            auto var = std::get_if<std::shared_ptr<VarExpr>>(&strip_grouping(e.callee));
+            if ( ! inlinable || inline_exits || ! var ||
+                 (*var)->bind.kind != loxc::binding::GLOBAL )
+                return false;
+            auto found = inlinable->find((*var)->name.text);
+            if (found == inlinable->end())
+                return false;
+            const FuncStmt& f = *found->second;
+            if (f.params.size() != e.args.size() || ! vm::can_inline(f))
+                return false;
+
+            const loxc::lexeme& name = (*var)->name;
+            int g = global(name);
+            c.inlined.push_back(found->second);
+            c.inline_slots = std::max(c.inline_slots, size_t(f.layout.slots));
+            const int before = depth;
+
+            size_t guard = c.code.size();
+            emit(vm::GUARD_INLINE, name, g, c.inlined.size() - 1);
+            std::vector<size_t> exits;
+
+            emit(vm::GET_GLOBAL, name, g);
+            for (const Expr& arg : e.args)
+                expr(arg);
+            emit(vm::CALL, e.closing_paren, e.args.size());
+            exits.push_back(c.code.size());
+            emit(vm::JUMP);
+
+            depth = before;
+            land(guard);
+            for (const Expr& arg : e.args)
+                expr(arg);
+            for (size_t i = f.layout.params.size(); i-- > 0; )
+                emit(vm::SET_SLOT_POP, {}, frame_slots + f.layout.params[i].index);
+
+            slot_offset = frame_slots;
+            inline_exits = &exits;
+            stmt(f.body, INLINE_TAIL);
+            slot_offset = 0;
+            inline_exits = nullptr;
+
+            // The last exit can fall through to done instead. Jumps in the
+            // body past it, left from branches that all exit, follow.
+            size_t end = c.code.size();
+            if (exits.back() == end - 1)
+            {
+                c.code.pop_back();
+                c.where.pop_back();
+                exits.pop_back();
+                for (size_t i = guard; i < c.code.size(); ++i)
+                    if (is_jump(c.code[i].op) && size_t(target(c.code[i])) == end)
+                        target(c.code[i]) = c.code.size();
+            }
+            for (size_t at : exits)
+                land(at);
+
+            depth = before + 1;
+            return true;
+        }
+
+        void nil()
+        {
+            if (nil_constant < 0)
+            {
+                nil_constant = c.constants.size();
+                c.constants.emplace_back();
+            }
+            emit(vm::CONST, {}, nil_constant);
+        }
+
+        // Does what t says with the value on top of the stack.
+        void finish(tail_t t)
+        {
+            switch (t)
+            {
+                case NO_TAIL: return emit(vm::POP);
+                case RETURN_TAIL: return emit(vm::RETURN);
+                case RECORD_TAIL: return emit(vm::SET_RESULT);
+                case INLINE_TAIL:
+                    inline_exits->push_back(c.code.size());
+                    emit(vm::JUMP);
+                    // Code after the jump starts without the value.
+                    --depth;
+                    return;
+            }
+        }
+
+        // Emits a test of cond that jumps when it is false.
+        // @return the jump, to be landed.
+        size_t jump_if_false(const Expr& cond)
+        {
+            auto less = std::get_if<std::shared_ptr<BinaryExpr>>(&strip_grouping(cond));
+            if (fuse && less && (*less)->op.type == loxc::LESS)
+            {
+                const BinaryExpr& e = **less;
+                int left = slot_of(e.left);
+                int right = slot_of(e.right);
+                const double* n = number_of(e.right);
+                size_t at = c.code.size();
+                if (left >= 0 && n)
+                    emit(vm::JUMP_IF_NOT_LESS_SLOT_NUM, e.op, left, number(*n));
+                else if (left >= 0 && right >= 0)
+                    emit(vm::JUMP_IF_NOT_LESS_SLOT_SLOT, e.op, left, right);
+                else
+                {
+                    expr(e.left);
+                    expr(e.right);
+                    at = c.code.size();
+                    emit(vm::JUMP_IF_NOT_LESS, e.op);
+                }
+                return at;
+            }
+
+            expr(cond);
+            size_t at = c.code.size();
+            emit(vm::JUMP_IF_FALSE);
+            return at;
+        }
+
+        void access(const loxc::lexeme& name, const loxc::binding& bind,
+            vm::opcode slot, vm::opcode cell, vm::opcode upvalue, vm::opcode global_op)
+        {
+            switch (bind.kind)
+            {
+                case loxc::binding::SLOT: return emit(slot, name, local(bind.index));
+                case loxc::binding::CELL: return emit(cell, name, bind.index);
+                case loxc::binding::UPVALUE: return emit(upvalue, name, bind.index);
+                default: return emit(global_op, name, global(name));
+            }
+        }
+
+        void eval(Expr e)
+        {
+            c.exprs.push_back(std::move(e));
+            emit(vm::EVAL, {}, c.exprs.size() - 1);
+        }
+
+        void exec(Stmt s)
+        {
+            tail_t t = tail;
+            c.stmts.push_back(std::move(s));
+            emit(vm::EXEC, {}, c.stmts.size() - 1);
+            finish(t);
+        }
+
+        int constant(Val v)
+        {
+            c.constants.push_back(std::move(v));
+            return c.constants.size() - 1;
+        }
+
+        int number(double d)
+        {
+            c.numbers.push_back(d);
+            return c.numbers.size() - 1;
+        }
+
+        // References to the same global share an inline cache.
+        int global(const loxc::lexeme& name)
+        {
+            for (size_t i = 0; i < c.globals.size(); ++i)
+                if (c.globals[i].name.text == name.text)
+                    return i;
+            c.globals.push_back({name, loxc::binding{loxc::binding::GLOBAL}});
+            return c.globals.size() - 1;
+        }
+    };
+
+    /**
+     * DISPATCH LOOP
+     */
+
+    inline bool is_number(const Val& v)
+    {
+        return std::holds_alternative<double>(v);
+    }
+
+    inline double& num(Val& v)
+    {
+        return *std::get_if<double>(&v);
+    }
+
+    // Copies a value without going through the variant's assignment when
+    // both sides hold numbers, which is nearly always in arithmetic code:
+    // the general assignment dispatches on the types through a table.
+    inline void copy(Val& to, const Val& from)
+    {
+        if (is_number(from) && is_number(to))
+            num(to) = *std::get_if<double>(&from);
+        else
+            to = from;
+    }
+
+    /**
+     * Runs c. With threaded set every instruction jumps straight to the
+     * next through a table of label addresses; otherwise every
+     * instruction goes back to one switch.
+     *
+     * The operand stack sits on the interpreter's value stack just above
+     * the frame's slots. Anything that can run lox code can grow the
+     * value stack and move it, so the stack pointers are saved as offsets
+     * around calls and reloaded after.
+     *
+     * Popped values are not cleared; they are overwritten by the next push
+     * or dropped with the frame.
+     *
+     * A generator passes where it stopped in `at`, which a YIELD fills in.
+     * Its frame is its own between runs, so the stack is just as it was
+     * left.
+     */
+    template <bool threaded>
+    Val execute(op::interpreter& interp, vm::chunk& c, vm::resume_point* at = nullptr)
+    {
+        std::vector<Val>& values = interp.values;
+        const vm::instr* const code = c.code.data();
+        const vm::instr* ip = code;
+        size_t stack_base;
+        size_t depth = 0;
+        Val result;
+        if (at && at->suspended)
+        {
+            stack_base = at->stack_base;
+            depth = at->sp - stack_base;
+            ip = code + at->ip;
+            result = std::move(at->result);
+            at->suspended = false;
+        }
+        else
+        {
+            // Inlined functions' locals go between the frame and the stack.
+            stack_base = values.size() + c.inline_slots;
+            values.resize(stack_base + c.depth);
+        }
+
+        Val* slots = values.data() + interp.base;
+        Val* sp = values.data() + stack_base + depth;
+
+#ifdef LOXC_VM_PROFILE
+        int prev = vm::OPCODE_COUNT;
+#define PROFILE() (++pairs[prev][ip->op], prev = ip->op)
+#else
+#define PROFILE() ((void)0)
+#endif
+
+#ifdef LOXC_THREADED_DISPATCH
+        [[maybe_unused]] static void* const labels[] = {
+#define LOXC_OPCODE_LABEL(name, effect) &&L_##name,
+            LOXC_OPCODES(LOXC_OPCODE_LABEL)
+#undef LOXC_OPCODE_LABEL
+        };
+#define CASE(name) case vm::name: L_##name
+#define DISPATCH() do { PROFILE(); if constexpr (threaded) goto *labels[ip->op]; else goto dispatch; } while (0)
+#else
+#define CASE(name) case vm::name
+#define DISPATCH() do { PROFILE(); goto dispatch; } while (0)
+#endif
+
+#define NEXT() do { ++ip; DISPATCH(); } while (0)
+#define JUMP_TO(target) do { ip = code + (target); DISPATCH(); } while (0)
+#define WHERE() (c.where[ip - code])
+#define SAVE_STACK() size_t saved_sp = sp - values.data()
+#define RELOAD_STACK() (slots = values.data() + interp.base, sp = values.data() + saved_sp)
+#define NUMERIC(l, r) do { if ( ! is_number(l) || ! is_number(r) ) \
+        throw op::runtime_error(WHERE(), "Operands must be numbers."); } while (0)
+
+        // The first instruction always goes through the switch.
+        goto dispatch;
+
+    dispatch:
+        switch (ip->op)
+        {
+            CASE(CONST):
+                LOXC_COUNT(value_copies, 1);
+                copy(*sp++, c.constants[ip->a]);
+                NEXT();
+            CASE(POP):
+                --sp;
+                NEXT();
+
+            CASE(GET_SLOT):
+                LOXC_COUNT(value_copies, 1);
+                copy(*sp++, slots[ip->a]);
+                NEXT();
+            CASE(SET_SLOT):
+                copy(slots[ip->a], sp[-1]);
+                NEXT();
+            CASE(GET_CELL):
+                LOXC_COUNT(value_copies, 1);
+                copy(*sp++, *interp.cells[interp.cell_base + ip->a]);
+                NEXT();
+            CASE(SET_CELL):
+                *interp.cells[interp.cell_base + ip->a] = sp[-1];
+                NEXT();
+            CASE(NEW_CELL):
+                LOXC_COUNT(cells, 1);
+                interp.cells[interp.cell_base + ip->a] = std::make_shared<Val>();
+                NEXT();
+            CASE(GET_UPVALUE):
+                LOXC_COUNT(value_copies, 1);
+                copy(*sp++, *(*interp.upvalues)[ip->a]);
+                NEXT();
+            CASE(SET_UPVALUE):
+                *(*interp.upvalues)[ip->a] = sp[-1];
+                NEXT();
+
+            CASE(GET_GLOBAL):
+            {
+                vm::global_ref& g = c.globals[ip->a];
+                Val* slot = interp.globals->lookup(g.name.str(), g.bind);
+                if ( ! slot )
+                    throw op::runtime_error(g.name, "Undefined variable '" + g.name.str() + "'.");
+                LOXC_COUNT(value_copies, 1);
+                copy(*sp++, *slot);
+                NEXT();
+            }
+            CASE(SET_GLOBAL):
+            {
+                vm::global_ref& g = c.globals[ip->a];
+                Val* slot = interp.globals->lookup(g.name.str(), g.bind);
+                if ( ! slot )
+                    throw op::runtime_error(g.name, "Undefined variable '" + g.name.str() + "'.");
+                *slot = sp[-1];
+                NEXT();
+            }
+            CASE(DEFINE_GLOBAL):
+                interp.globals->define(c.globals[ip->a].name.str(), sp[-1]);
+                NEXT();
+
+            CASE(ADD):
+            {
+                Val& l = sp[-2];
+                Val& r = sp[-1];
+                if (is_number(l) && is_number(r))
+                    num(l) += num(r);
+                else if (std::holds_alternative<std::string>(l) &&
+                         std::holds_alternative<std::string>(r))
+                {
+                    std::string& joined = std::get<std::string>(l);
+                    joined += std::get<std::string>(r);
+                    LOXC_COUNT(strings, 1);
+                    LOXC_COUNT(string_bytes, joined.size());
+                }
+                else
+                    throw op::runtime_error(WHERE(), "Operands must be numbers or strings.");
+                --sp;
+                NEXT();
+            }
+            CASE(SUBTRACT):
+                NUMERIC(sp[-2], sp[-1]);
+                num(sp[-2]) -= num(sp[-1]);
+                --sp;
+                NEXT();
+            CASE(MULTIPLY):
+                NUMERIC(sp[-2], sp[-1]);
+                num(sp[-2]) *= num(sp[-1]);
+                --sp;
+                NEXT();
+            CASE(DIVIDE):
+                NUMERIC(sp[-2], sp[-1]);
+                num(sp[-2]) /= num(sp[-1]);
+                --sp;
+                NEXT();
+
+            CASE(LESS):
+                NUMERIC(sp[-2], sp[-1]);
+                sp[-2] = num(sp[-2]) < num(sp[-1]);
+                --sp;
+                NEXT();
+            CASE(LESS_EQUAL):
+                NUMERIC(sp[-2], sp[-1]);
+                sp[-2] = num(sp[-2]) <= num(sp[-1]);
+                --sp;
+                NEXT();
+            CASE(GREATER):
+                NUMERIC(sp[-2], sp[-1]);
+                sp[-2] = num(sp[-2]) > num(sp[-1]);
+                --sp;
+                NEXT();
+            CASE(GREATER_EQUAL):
+                NUMERIC(sp[-2], sp[-1]);
+                sp[-2] = num(sp[-2]) >= num(sp[-1]);
+                --sp;
+                NEXT();
+            CASE(EQUAL):
+                sp[-2] = sp[-2] == sp[-1];
+                --sp;
+                NEXT();
+            CASE(NOT_EQUAL):
+                sp[-2] = sp[-2] != sp[-1];
+                --sp;
+                NEXT();
+
+            CASE(NEGATE):
+                if ( ! is_number(sp[-1]) )
+                    throw op::runtime_error(WHERE(), "Operand must be a number.");
+                num(sp[-1]) = -num(sp[-1]);
+                NEXT();
+            CASE(NOT):
+                sp[-1] = ! is_truthy(sp[-1]);
+                NEXT();
+
+            CASE(JUMP):
+                JUMP_TO(ip->a);
+            CASE(JUMP_IF_FALSE):
+                if ( ! is_truthy(*--sp) )
+                    JUMP_TO(ip->a);
+                NEXT();
+            CASE(AND):
+                if ( ! is_truthy(sp[-1]) )
+                    JUMP_TO(ip->a);
+                --sp;
+                NEXT();
+            CASE(OR):
+                if (is_truthy(sp[-1]))
+                    JUMP_TO(ip->a);
+                --sp;
+                NEXT();
+
+            CASE(CALL):
+            {
+                Val* callee = sp - ip->a - 1;
+                std::vector<Val> args(std::make_move_iterator(callee + 1),
+                    std::make_move_iterator(sp));
+                auto f = std::get_if<std::shared_ptr<loxc::callable>>(callee);
+                if ( ! f )
+                    throw op::runtime_error(WHERE(), "Object is not callable.");
+
+                // The callee's slot keeps it alive through the call.
+                const loxc::callable& fn = **f;
+                sp = callee;
+                SAVE_STACK();
+                Val v = interp.call_value(fn, std::move(args), WHERE());
+                RELOAD_STACK();
+                *sp++ = std::move(v);
+                NEXT();
+            }
+            CASE(GUARD_INLINE):
+            {
+                vm::global_ref& g = c.globals[ip->a];
+                const Val* slot = interp.globals->lookup(g.name.str(), g.bind);
+                auto f = slot ? std::get_if<std::shared_ptr<loxc::callable>>(slot) : nullptr;
+                if (f && (*f)->declaration() == c.inlined[ip->b].get())
+                    JUMP_TO(ip->c);
+                NEXT();
+            }
+            CASE(EVAL):
+            {
+                SAVE_STACK();
+                Val v = std::visit(interp, c.exprs[ip->a]);
+                RELOAD_STACK();
+                *sp++ = std::move(v);
+                NEXT();
+            }
+            CASE(EXEC):
+            {
+                SAVE_STACK();
+                Val v = std::visit(interp, c.stmts[ip->a]);
+                RELOAD_STACK();
+                *sp++ = std::move(v);
+                NEXT();
+            }
+
+            CASE(PRINT):
+            {
+                loxc::output::record line(loxc::out());
+                loxc::out() << sp[-1] << '\n';
+                loxc::out().sync();
+            }
+                --sp;
+                NEXT();
+            CASE(YIELD):
+                if ( ! at )
+                    throw op::runtime_error(WHERE(), "Can only yield inside a function.");
+                at->ip = ip + 1 - code;
+                at->stack_base = stack_base;
+                at->sp = sp - 1 - values.data();
+                at->result = std::move(result);
+                at->suspended = true;
+                return std::move(sp[-1]);
+            CASE(SET_RESULT):
+                result = std::move(*--sp);
+                NEXT();
+            CASE(RETURN):
+                return std::move(sp[-1]);
+            CASE(RETURN_RESULT):
+                return result;
+            CASE(RETURN_NIL):
+                return std::monostate{};
+
+            CASE(SET_SLOT_POP):
+                --sp;
+                if (is_number(*sp) && is_number(slots[ip->a]))
+                    num(slots[ip->a]) = num(*sp);
+                else
+                    slots[ip->a] = std::move(*sp);
+                NEXT();
+            CASE(ADD_SLOT_NUM):
+            {
+                Val& x = slots[ip->a];
+                if ( ! is_number(x) )
+                    throw op::runtime_error(WHERE(), "Operands must be numbers or strings.");
+                *sp++ = num(x) + c.numbers[ip->b];
+                NEXT();
+            }
+            CASE(SUBTRACT_SLOT_NUM):
+            {
+                Val& x = slots[ip->a];
+                if ( ! is_number(x) )
+                    throw op::runtime_error(WHERE(), "Operands must be numbers.");
+                *sp++ = num(x) - c.numbers[ip->b];
+                NEXT();
+            }
+            CASE(INCREMENT_SLOT):
+            {
+                Val& x = slots[ip->a];
+                if ( ! is_number(x) )
+                    throw op::runtime_error(WHERE(), "Operands must be numbers or strings.");
+                num(x) += c.numbers[ip->b];
+                NEXT();
+            }
+            CASE(JUMP_IF_NOT_LESS):
+                NUMERIC(sp[-2], sp[-1]);
+                sp -= 2;
+                if ( ! (num(sp[0]) < num(sp[1])) )
+                    JUMP_TO(ip->a);
+                NEXT();
+            CASE(JUMP_IF_NOT_LESS_SLOT_NUM):
+            {
+                Val& x = slots[ip->a];
+                if ( ! is_number(x) )
+                    throw op::runtime_error(WHERE(), "Operands must be numbers.");
+                if ( ! (num(x) < c.numbers[ip->b]) )
+                    JUMP_TO(ip->c);
+                NEXT();
+            }
+            CASE(JUMP_IF_NOT_LESS_SLOT_SLOT):
+            {
+                Val& x = slots[ip->a];
+                Val& y = slots[ip->b];
+                NUMERIC(x, y);
+                if ( ! (num(x) < num(y)) )
+                    JUMP_TO(ip->c);
+                NEXT();
+            }
+        }
+
+        // Every chunk ends in a return.
+        return std::monostate{};
+
+#undef PROFILE
+#undef CASE
+#undef DISPATCH
+#undef NEXT
+#undef JUMP_TO
+#undef WHERE
+#undef SAVE_STACK
+#undef RELOAD_STACK
+#undef NUMERIC
+    }
+}
+
+const char* vm::name(opcode op)
+{
+    return op < OPCODE_COUNT ? opcode_names[op] : "?";
+}
+
+std::shared_ptr<vm::chunk> vm::compile(const Stmt& body, bool fuse,
+    const inline_table* inlinable, size_t slots)
+{
+    auto c = std::make_shared<chunk>();
+    compiler comp(*c, fuse, inlinable, slots);
+    comp.stmt(body, RETURN_TAIL);
+    comp.emit(RETURN_NIL);
+    return c;
+}
+
+std::shared_ptr<vm::chunk> vm::compile(const std::vector<Stmt>& program, bool fuse,
+    const inline_table* inlinable, size_t slots)
+{
+    auto c = std::make_shared<chunk>();
+    compiler comp(*c, fuse, inlinable, slots);
+    for (const Stmt& s : program)
+        comp.stmt(s, NO_TAIL);
+    comp.emit(RETURN_NIL);
+    return c;
+}
+
+bool vm::can_inline(const FuncStmt& f)
+{
+    return ( ! f.deferred || f.deferred->parsed() ) && ! f.layout.receiver && f.layout.cells == 0 &&
+        f.layout.captures.empty() && inline_check().stmt(f.body);
+}
+
+Val vm::run(op::interpreter& interp, chunk& c)
+{
+    return run(interp, c, interp.exec);
+}
+
+Val vm::run(op::interpreter& interp, chunk& c, mode m)
+{
+    if (c.numeric && accepts(interp, *c.numeric))
+        return run_numeric(interp, *c.numeric, m == THREADED);
+#ifdef LOXC_THREADED_DISPATCH
+    if (m == THREADED)
+        return execute<true>(interp, c);
+#endif
+    return execute<false>(interp, c);
+}
+
+Val vm::resume(op::interpreter& interp, chunk& c, resume_point& at)
+{
+#ifdef LOXC_THREADED_DISPATCH
+    if (interp.exec != SWITCH)
+        return execute<true>(interp, c, &at);
+#endif
+    return execute<false>(interp, c, &at);
+}
+
+bool vm::threaded_dispatch()
+{
+#ifdef LOXC_THREADED_DISPATCH
+    return true;
+#else
+    return false;
+#endif
+}
+
+void vm::report_profile(std::ostream& o)
+{
+#ifdef LOXC_VM_PROFILE
+    struct pair_count
+    {
+        int first, second;
+        uint64_t count;
+    };
+    std::vector<pair_count> counts;
+    for (int a = 0; a < OPCODE_COUNT; ++a)
+        for (int b = 0; b < OPCODE_COUNT; ++b)
+            if (pairs[a][b])
+                counts.push_back({a, b, pairs[a][b]});
+    std::sort(counts.begin(), counts.end(),
+        [](const pair_count& x, const pair_count& y) { return x.count > y.count; });
+
+    const size_t shown = 24;
+    o << "[vm] instruction pair                                  count\n";
+    for (size_t i = 0; i < counts.size() && i < shown; ++i)
+    {
+        std::string pair = std::string(name(opcode(counts[i].first))) + " " +
+            name(opcode(counts[i].second));
+        o << "[vm]   " << std::left << std::setw(42) << pair
+          << std::right << std::setw(14) << counts[i].count << "\n";
+    }
+#else
+    (void)o;
+#endif
+}
@@ -0,0 +1,234 @@
+// a bytecode tier for lox code, run by a threaded dispatch loop.
+#ifndef vm_h
+#define vm_h
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "expr.h"
+#include "stmt.h"
+#include "token.h"
+#include "binding.h"
+#include "val.h"
+
+// Computed gotos are a GNU extension. Configuring with
+// -DLOXC_COMPUTED_GOTO=OFF defines LOXC_NO_COMPUTED_GOTO to compare
+// against the switch alone.
+#if defined(__GNUC__) && ! defined(LOXC_NO_COMPUTED_GOTO)
+#define LOXC_THREADED_DISPATCH
+#endif
+
+namespace op
+{
+    struct interpreter;
+}
+
+/**
+ * Walking the AST dispatches every node through std::visit, an indirect
+ * jump from one shared table that the branch predictor can do little
+ * with. The vm flattens a function body (or a program) into a chunk of
+ * instructions on first call and runs that instead.
+ *
+ * The loop is compiled twice: once with a switch, and once, where the
+ * compiler supports it (GCC and clang), with computed gotos, so that every
+ * instruction ends in its own indirect jump to the next and each gets its
+ * own history in the predictor. Frequent sequences picked out by the
+ * op pair profile (see LOXC_VM_PROFILE) have superinstructions that do
+ * the work of several in one dispatch.
+ *
+ * Only the everyday nodes get instructions: literals, variables,
+ * arithmetic, logic, calls, control flow, print and return. Anything
+ * else (closures, classes, properties) is handed back to the tree
+ * walker one node at a time, which is why a chunk keeps those nodes.
+ */
+namespace vm
+{
+
+enum mode
+{
+    TREE,     // walk the AST, as before the vm
+    SWITCH,   // switch dispatch
+    THREADED, // computed goto dispatch, or switch where unsupported
+};
+
+// X(name, stack effect). CALL pops its arguments on top of the effect
+// given here.
+#define LOXC_OPCODES(X) \
+    X(CONST, 1)           /* push constants[a] */ \
+    X(POP, -1) \
+    X(GET_SLOT, 1)        /* push slot a */ \
+    X(SET_SLOT, 0)        /* slot a = top, leaving it */ \
+    X(GET_CELL, 1) \
+    X(SET_CELL, 0) \
+    X(NEW_CELL, 0)        /* give cell a a fresh box */ \
+    X(GET_UPVALUE, 1) \
+    X(SET_UPVALUE, 0) \
+    X(GET_GLOBAL, 1)      /* push globals[a] */ \
+    X(SET_GLOBAL, 0) \
+    X(DEFINE_GLOBAL, 0) \
+    X(ADD, -1) \
+    X(SUBTRACT, -1) \
+    X(MULTIPLY, -1) \
+    X(DIVIDE, -1) \
+    X(LESS, -1) \
+    X(LESS_EQUAL, -1) \
+    X(GREATER, -1) \
+    X(GREATER_EQUAL, -1) \
+    X(EQUAL, -1) \
+    X(NOT_EQUAL, -1) \
+    X(NEGATE, 0) \
+    X(NOT, 0) \
+    X(JUMP, 0)            /* to a */ \
+    X(JUMP_IF_FALSE, -1)  /* pop, to a if falsey */ \
+    X(AND, -1)            /* to a keeping top if falsey, else pop */ \
+    X(OR, -1)             /* to a keeping top if truthy, else pop */ \
+    X(CALL, 0)            /* call with a arguments */ \
+    X(GUARD_INLINE, 0)    /* to c if globals[a] is still inlined[b] */ \
+    X(EVAL, 1)            /* push the tree walker's value of exprs[a] */ \
+    X(EXEC, 1)            /* push the tree walker's value of stmts[a] */ \
+    X(PRINT, -1) \
+    X(YIELD, -1)          /* suspend the generator, handing it top */ \
+    X(SET_RESULT, -1)     /* pop into the result register */ \
+    X(RETURN, -1) \
+    X(RETURN_RESULT, 0) \
+    X(RETURN_NIL, 0) \
+    /* superinstructions */ \
+    X(SET_SLOT_POP, -1)          /* SET_SLOT a; POP */ \
+    X(ADD_SLOT_NUM, 1)           /* GET_SLOT a; CONST numbers[b]; ADD */ \
+    X(SUBTRACT_SLOT_NUM, 1)      /* GET_SLOT a; CONST numbers[b]; SUBTRACT */ \
+    X(INCREMENT_SLOT, 0)         /* slot a = slot a + numbers[b], as a statement */ \
+    X(JUMP_IF_NOT_LESS, -2)      /* LESS; JUMP_IF_FALSE a */ \
+    X(JUMP_IF_NOT_LESS_SLOT_NUM, 0) /* GET_SLOT a; CONST numbers[b]; LESS; JUMP_IF_FALSE c */ \
+    X(JUMP_IF_NOT_LESS_SLOT_SLOT, 0) /* GET_SLOT a; GET_SLOT b; LESS; JUMP_IF_FALSE c */
+
+enum opcode : uint8_t
+{
+#define LOXC_OPCODE_ENUM(name, effect) name,
+    LOXC_OPCODES(LOXC_OPCODE_ENUM)
+#undef LOXC_OPCODE_ENUM
+    OPCODE_COUNT
+};
+
+const char* name(opcode op);
+
+struct instr
+{
+    opcode op;
+    int32_t a = 0;
+    int32_t b = 0;
+    int32_t c = 0;
+};
+
+struct numeric_chunk;
+
+// A global a chunk refers to, with the inline cache its instructions
+// share. See globals.h.
+struct global_ref
+{
+    loxc::lexeme name;
+    loxc::binding bind;
+};
+
+/**
+ * A compiled function body or program. `where` runs parallel to `code`
+ * and holds the token each instruction reports its errors at.
+ */
+struct chunk
+{
+    std::vector<instr> code;
+    std::vector<loxc::lexeme> where;
+    std::vector<Val> constants;
+    // operands of the numeric superinstructions, unboxed.
+    std::vector<double> numbers;
+    std::vector<global_ref> globals;
+    // nodes left to the tree walker.
+    std::vector<Expr> exprs;
+    std::vector<Stmt> stmts;
+    // the deepest the operand stack gets.
+    size_t depth = 0;
+    // the body in register code, if it qualifies. See numeric.h.
+    std::shared_ptr<numeric_chunk> numeric;
+    // functions whose bodies were inlined, and the slots past the frame's
+    // that their locals use.
+    std::vector<std::shared_ptr<FuncStmt>> inlined;
+    size_t inline_slots = 0;
+};
+
+/**
+ * Top level functions by name, which calls to may be inlined.
+ *
+ * A call to a global that names a small function here, whose body has no
+ * loops, calls, closures or properties, is compiled to the function's body
+ * with its locals in slots past the caller's. The call first checks that
+ * the global still holds the function declared there and makes the call
+ * as written if not, so a reassigned or redeclared global never runs
+ * stale code.
+ */
+using inline_table = std::unordered_map<const std::string*, std::shared_ptr<FuncStmt>>;
+
+// Whether f's body is small and plain enough to inline.
+bool can_inline(const FuncStmt& f);
+
+/**
+ * Compiles a function body. Falling off its end returns the value of the
+ * last statement run, as the tree walker does.
+ *
+ * @param fuse whether to use superinstructions.
+ * @param inlinable functions to inline calls to, if any.
+ * @param slots the slots in the body's frame.
+ */
+std::shared_ptr<chunk> compile(const Stmt& body, bool fuse = true,
+    const inline_table* inlinable = nullptr, size_t slots = 0);
+
+/**
+ * Compiles a program to run at the top level.
+ */
+std::shared_ptr<chunk> compile(const std::vector<Stmt>& program, bool fuse = true,
+    const inline_table* inlinable = nullptr, size_t slots = 0);
+
+/**
+ * Runs c in the interpreter's current frame, using the interpreter's
+ * mode to pick the loop.
+ */
+Val run(op::interpreter& interp, chunk& c);
+Val run(op::interpreter& interp, chunk& c, mode m);
+
+/**
+ * Where a generator's code stopped: the instruction after its YIELD and
+ * the extent of its operand stack, as offsets into its frame.
+ */
+struct resume_point
+{
+    size_t ip = 0;
+    size_t stack_base = 0;
+    size_t sp = 0;
+    // the result register, which a loop's value may be left in.
+    Val result;
+    // whether the last run stopped at a YIELD rather than returning.
+    bool suspended = false;
+};
+
+/**
+ * Runs a generator's code in the interpreter's current frame, from the
+ * start or from where it last yielded, until it yields or returns.
+ * Generator bodies always run here, whatever the mode, as the tree walker
+ * keeps its place on the native stack and can't stop partway.
+ */
+Val resume(op::interpreter& interp, chunk& c, resume_point& at);
+
+// Whether THREADED really uses computed gotos in this build.
+bool threaded_dispatch();
+
+/**
+ * Writes the most frequent pairs of consecutive instructions run so far.
+ * Only builds with LOXC_VM_PROFILE count them.
+ */
+void report_profile(std::ostream& o);
+
+} // namespace vm
+
+#endif
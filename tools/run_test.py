@@ -0,0 +1,77 @@
+# runs a lox script from tests/ and checks what it printed.
+#
+# usage: run_test.py loxc script [option...]
+#
+# A script states what it should print in comments, in order:
+#
+#   // expect: text          the next line printed is text
+#   // expect error: text    the next line printed is an error containing
+#                            text, and loxc exits with an error
+#   // args: --lazy-parse    options to run loxc with, after any given on
+#                            the command line; paths in them are relative
+#                            to the script
+#   // image: modules/a.lox  run a.lox (relative to the script) first, save
+#                            its globals to an image and start from that
+#
+# A backtrace printed after an error is not compared.
+
+import os
+import subprocess
+import sys
+import tempfile
+
+def main ():
+    loxc, script = os.path.abspath(sys.argv[1]), os.path.abspath(sys.argv[2])
+    options = sys.argv[3:]
+
+    expected = []
+    prelude = None
+    for line in open(script, "r"):
+        if "// expect: " in line:
+            expected.append(("line", line.split("// expect: ", 1)[1].rstrip("\n")))
+        elif "// expect error: " in line:
+            expected.append(("error", line.split("// expect error: ", 1)[1].rstrip("\n")))
+        elif line.startswith("// args: "):
+            options += line[len("// args: "):].split()
+        elif line.startswith("// image: "):
+            prelude = os.path.join(os.path.dirname(script), line[len("// image: "):].strip())
+
+    with tempfile.TemporaryDirectory() as scratch:
+        if prelude:
+            image = os.path.join(scratch, "prelude.img")
+            dump = subprocess.run([loxc] + sys.argv[3:] + ["--dump-image", image, prelude],
+                stdout=subprocess.PIPE, stderr=subprocess.PIPE, timeout=60)
+            if dump.returncode != 0:
+                print("could not save an image of " + prelude + ":")
+                sys.stdout.write(dump.stdout.decode() + dump.stderr.decode())
+                sys.exit(1)
+            options += ["--image", image]
+        check(loxc, script, options, expected)
+
+def check (loxc, script, options, expected):
+    run = subprocess.run([loxc] + options + [script], cwd=os.path.dirname(script),
+        stdout=subprocess.PIPE, stderr=subprocess.PIPE, timeout=60)
+    out = run.stdout.decode().splitlines()
+    if "[backtrace] most recent call first" in out:
+        out = out[:out.index("[backtrace] most recent call first")]
+
+    def matches (want, got):
+        kind, text = want
+        return got == text if kind == "line" else text in got
+
+    ok = len(out) == len(expected) and all(map(matches, expected, out))
+    fails = any(kind == "error" for kind, _ in expected)
+    ok = ok and (run.returncode != 0) == fails
+
+    if not ok:
+        print("expected:")
+        for kind, text in expected:
+            print("  " + ("error containing: " if kind == "error" else "") + text)
+        print("got (exit code {}):".format(run.returncode))
+        for line in out:
+            print("  " + line)
+        sys.stdout.write(run.stderr.decode())
+    sys.exit(0 if ok else 1)
+
+if __name__ == "__main__":
+    main()
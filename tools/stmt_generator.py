@@ -25,6 +25,7 @@ def make_init ():
 def make_stmt (class_name, rest):
     out = ""
     rest = rest.split(":", 1)[1]
+    rest, annotations = split_annotations(rest)
     arguments = []
     arguments = rest.split(",")
     arguments = [a.strip().split() for a in arguments]
@@ -42,9 +43,27 @@ def make_stmt (class_name, rest):
         out += ")\n\t\t: "
         out += ", ".join([ "{}(std::move({}_in))".format(arg[1], arg[1]) for arg in arguments])
         out += " {}\n"
+    out += make_annotations(annotations)
 
     return out + "};\n\n"
 
+def split_annotations (rest):
+    # Fields after a '|' are annotations: they are filled in by later passes
+    # rather than the parser, so they are left out of the constructor.
+    if "|" not in rest:
+        return rest, []
+    rest, annotations = rest.split("|", 1)
+    annotations = [a.strip().split() for a in annotations.split(",")]
+    return rest, annotations
+
+def make_annotations (annotations):
+    if not annotations:
+        return ""
+    out = "\n\t// annotations\n"
+    for arg in annotations:
+        out += "\t{} {}{{}};\n".format(arg[0], arg[1])
+    return out
+
 def make_expr_using_declaration (names):
     out = "using Stmt = std::variant<\n\tstd::monostate,\n\t"
     out += ",\n\t".join(["std::shared_ptr<struct {}>".format(name) for name in names])